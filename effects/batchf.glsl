@@ -0,0 +1,13 @@
+#version 140
+
+in vec2 UV;
+in vec4 tint;
+out vec4 color;
+
+uniform sampler2D sampler;
+uniform vec4 colorMod;
+
+void main()
+{
+    color = texture(sampler, UV).rgba * tint * colorMod;
+}
\ No newline at end of file
@@ -0,0 +1,17 @@
+#version 140
+
+in vec3 vertexPosition_modelspace;
+in vec2 vertexUV;
+in vec4 vertexColor;
+
+out vec2 UV;
+out vec4 tint;
+
+uniform mat4 MVP;
+
+void main()
+{
+    gl_Position = MVP * vec4(vertexPosition_modelspace, 1);
+    UV = vertexUV;
+    tint = vertexColor;
+}
\ No newline at end of file
@@ -0,0 +1,45 @@
+/*
+Author: Vladimir Slav
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+ Console benchmarks for the engine subsystems that have more than one implementation. Every benchmark
+ builds its scenes from a fixed seed, so runs are comparable between builds and machines.
+*/
+
+#ifndef __BENCHMARK_H__
+#define __BENCHMARK_H__
+
+#include "..\SDL2\include\SDL.h"
+
+// milliseconds since start, a value of SDL_GetPerformanceCounter
+inline double GetElapsedMs(Uint64 start)
+{
+    return static_cast<double>(SDL_GetPerformanceCounter() - start) * 1000.0 / static_cast<double>(SDL_GetPerformanceFrequency());
+}
+
+// CollisionGrid, SweepAndPrune and CollisionTree on uniform and clustered scenes
+void RunCollisionBenchmark();
+// CollisionGrid::Sweep and Move per object, by displacement length and object density
+void RunSweepBenchmark();
+// Astar against jump point search, 4 and 8-connected, on open fields, mazes and rooms
+void RunPathfindingBenchmark();
+// D* Lite repairs after single tile changes, against a fresh Astar and a fresh D* Lite plan
+void RunReplanningBenchmark();
+
+#endif
@@ -0,0 +1,290 @@
+/*
+Author: Vladimir Slav
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <vector>
+#include <random>
+#include <memory>
+#include <algorithm>
+#include <cmath>
+#include "benchmark.h"
+#include "..\base\collisiongrid.h"
+#include "..\base\sweepandprune.h"
+#include "..\base\collisiontree.h"
+
+namespace
+{
+    const int WORLD_SIZE = 4096;
+    const size_t SQUARE_SIZE = 32;
+    const int OBJECT_SIZE = 16;
+    const int FRAMES = 100;
+
+    class BenchmarkObject : public Collideable
+    {
+    private:
+        size_t* collisions;
+
+    public:
+        BenchmarkObject(double x, double y, size_t* collision_counter, int size = OBJECT_SIZE)
+            : Collideable(x, y, size, size, 0, nullptr, SQUARE_SIZE)
+            , collisions(collision_counter)
+        {
+        }
+
+        virtual bool Collide(Collideable* target) override
+        {
+            (*collisions)++;
+            return false;
+        }
+    };
+
+    struct Body
+    {
+        double x;
+        double y;
+        double vx;
+        double vy;
+    };
+
+    // uniform: spread over the whole world; clustered: the same amount packed around a few centers
+    std::vector<Body> MakeScene(size_t amount, bool clustered, unsigned seed)
+    {
+        std::mt19937 random(seed);
+        std::uniform_real_distribution<double> world(0.0, WORLD_SIZE - OBJECT_SIZE - 1.0);
+        std::uniform_real_distribution<double> speed(-2.0, 2.0);
+        std::normal_distribution<double> spread(0.0, 120.0);
+
+        const int clusters = 8;
+        std::vector<Body> centers(clusters);
+        for (auto& center : centers)
+        {
+            center.x = world(random);
+            center.y = world(random);
+        }
+
+        std::vector<Body> bodies(amount);
+        for (size_t i = 0; i < amount; i++)
+        {
+            Body& body = bodies[i];
+            if (clustered)
+            {
+                const Body& center = centers[i % clusters];
+                body.x = std::min(std::max(center.x + spread(random), 0.0), WORLD_SIZE - OBJECT_SIZE - 1.0);
+                body.y = std::min(std::max(center.y + spread(random), 0.0), WORLD_SIZE - OBJECT_SIZE - 1.0);
+            }
+            else
+            {
+                body.x = world(random);
+                body.y = world(random);
+            }
+            body.vx = speed(random);
+            body.vy = speed(random);
+        }
+        return bodies;
+    }
+
+    // bounces off the world borders, so objects never leave the grid
+    void Step(Body* body)
+    {
+        body->x += body->vx;
+        body->y += body->vy;
+        if (body->x < 0.0 || body->x > WORLD_SIZE - OBJECT_SIZE - 1.0)
+        {
+            body->vx = -body->vx;
+            body->x += 2.0 * body->vx;
+        }
+        if (body->y < 0.0 || body->y > WORLD_SIZE - OBJECT_SIZE - 1.0)
+        {
+            body->vy = -body->vy;
+            body->y += 2.0 * body->vy;
+        }
+    }
+
+    void RunScene(const char* backend_name, CollisionGrid* grid, std::vector<Body> bodies)
+    {
+        size_t collisions = 0;
+        std::vector<Collideable*> objects;
+        objects.reserve(bodies.size());
+
+        Uint64 start = SDL_GetPerformanceCounter();
+        for (auto& body : bodies)
+        {
+            Collideable* obj = new BenchmarkObject(body.x, body.y, &collisions);
+            grid->AddObject(obj);
+            objects.push_back(obj);
+        }
+        double addMs = GetElapsedMs(start);
+
+        // the first check sorts or builds everything from scratch, keep it apart from the steady state
+        start = SDL_GetPerformanceCounter();
+        grid->CheckCollissions();
+        double firstMs = GetElapsedMs(start);
+
+        start = SDL_GetPerformanceCounter();
+        for (int frame = 0; frame < FRAMES; frame++)
+        {
+            for (size_t i = 0; i < bodies.size(); i++)
+            {
+                Step(&bodies[i]);
+                objects[i]->SetCoords(bodies[i].x, bodies[i].y);
+            }
+            grid->CheckCollissions();
+        }
+        double frameMs = GetElapsedMs(start) / FRAMES;
+
+        // same scene and same moves, so every backend has to report the same amount of collisions
+        printf("  %-14s add %8.3f ms  first check %8.3f ms  per frame %8.3f ms  collisions %lu\n",
+               backend_name, addMs, firstMs, frameMs, static_cast<unsigned long>(collisions));
+    }
+
+    const int BULLET_SIZE = 4;
+    const int SWEEPS = 10000;
+
+    struct Shot
+    {
+        double x;
+        double y;
+        double dx;
+        double dy;
+    };
+
+    // random bullets flying length pixels in random directions, start and end inside the world
+    std::vector<Shot> MakeShots(double length, unsigned seed)
+    {
+        std::mt19937 random(seed);
+        std::uniform_real_distribution<double> world(0.0, WORLD_SIZE - BULLET_SIZE - 1.0);
+        std::uniform_real_distribution<double> angle(0.0, 6.283185307179586);
+
+        std::vector<Shot> shots;
+        shots.reserve(SWEEPS);
+        while (shots.size() < SWEEPS)
+        {
+            Shot shot;
+            shot.x = world(random);
+            shot.y = world(random);
+            double a = angle(random);
+            shot.dx = std::cos(a) * length;
+            shot.dy = std::sin(a) * length;
+
+            double endX = shot.x + shot.dx;
+            double endY = shot.y + shot.dy;
+            if (endX >= 0.0 && endY >= 0.0 && endX < WORLD_SIZE - BULLET_SIZE - 1.0 && endY < WORLD_SIZE - BULLET_SIZE - 1.0)
+            {
+                shots.push_back(shot);
+            }
+        }
+        return shots;
+    }
+
+    // microseconds per Sweep call, hits receives the amount of shots that hit something
+    double TimeSweeps(CollisionGrid* grid, Collideable* bullet, const std::vector<Shot>& shots, size_t* hits)
+    {
+        *hits = 0;
+        SweepHit hit;
+        Uint64 start = SDL_GetPerformanceCounter();
+        for (auto& shot : shots)
+        {
+            bullet->SetCoords(shot.x, shot.y);
+            if (grid->Sweep(bullet, shot.dx, shot.dy, &hit))
+            {
+                (*hits)++;
+            }
+        }
+        return GetElapsedMs(start) * 1000.0 / shots.size();
+    }
+
+    // microseconds per Move call, which sweeps only when the shot skips a square
+    double TimeMoves(CollisionGrid* grid, Collideable* bullet, const std::vector<Shot>& shots)
+    {
+        Uint64 start = SDL_GetPerformanceCounter();
+        for (auto& shot : shots)
+        {
+            bullet->SetCoords(shot.x, shot.y);
+            grid->Move(bullet, shot.x + shot.dx, shot.y + shot.dy);
+        }
+        return GetElapsedMs(start) * 1000.0 / shots.size();
+    }
+}
+
+void RunCollisionBenchmark()
+{
+    const size_t amounts[] = { 1000, 4000, 16000 };
+    for (int clustered = 0; clustered < 2; clustered++)
+    {
+        for (auto amount : amounts)
+        {
+            printf("%s scene, %lu objects, %d frames:\n", clustered ? "clustered" : "uniform", static_cast<unsigned long>(amount), FRAMES);
+            std::vector<Body> bodies = MakeScene(amount, clustered != 0, 1234);
+
+            std::unique_ptr<CollisionGrid> grid(new CollisionGrid(0, 0, WORLD_SIZE, WORLD_SIZE, SQUARE_SIZE, SQUARE_SIZE));
+            RunScene("grid", grid.get(), bodies);
+
+            std::unique_ptr<CollisionGrid> sweepX(new SweepAndPrune(0, 0, WORLD_SIZE, WORLD_SIZE, SQUARE_SIZE, SQUARE_SIZE, false));
+            RunScene("sweep&prune", sweepX.get(), bodies);
+
+            std::unique_ptr<CollisionGrid> tree(new CollisionTree(0, 0, WORLD_SIZE, WORLD_SIZE, SQUARE_SIZE, SQUARE_SIZE, 4.0));
+            RunScene("tree", tree.get(), bodies);
+        }
+    }
+}
+
+void RunSweepBenchmark()
+{
+    // share of the world area covered by the static objects
+    const double densities[] = { 0.01, 0.05, 0.2 };
+    const double lengths[] = { 16.0, 64.0, 256.0, 1024.0, 4096.0 };
+
+    for (auto density : densities)
+    {
+        size_t amount = static_cast<size_t>(density * WORLD_SIZE * WORLD_SIZE / (OBJECT_SIZE * OBJECT_SIZE));
+        printf("density %.0f%%, %lu objects, %d shots of a %dx%d bullet per length:\n",
+               density * 100.0, static_cast<unsigned long>(amount), SWEEPS, BULLET_SIZE, BULLET_SIZE);
+
+        size_t collisions = 0;
+        std::unique_ptr<CollisionGrid> grid(new CollisionGrid(0, 0, WORLD_SIZE, WORLD_SIZE, SQUARE_SIZE, SQUARE_SIZE));
+        std::unique_ptr<CollisionGrid> tree(new CollisionTree(0, 0, WORLD_SIZE, WORLD_SIZE, SQUARE_SIZE, SQUARE_SIZE, 4.0));
+        for (auto& body : MakeScene(amount, false, 4321))
+        {
+            grid->AddObject(new BenchmarkObject(body.x, body.y, &collisions));
+            tree->AddObject(new BenchmarkObject(body.x, body.y, &collisions));
+        }
+
+        // the bullets are added before the check, Move needs them in the grid
+        BenchmarkObject* gridBullet = new BenchmarkObject(0.0, 0.0, &collisions, BULLET_SIZE);
+        BenchmarkObject* treeBullet = new BenchmarkObject(0.0, 0.0, &collisions, BULLET_SIZE);
+        grid->AddObject(gridBullet);
+        tree->AddObject(treeBullet);
+        grid->CheckCollissions();
+        tree->CheckCollissions();
+
+        for (auto length : lengths)
+        {
+            std::vector<Shot> shots = MakeShots(length, 99);
+
+            size_t gridHits = 0;
+            size_t treeHits = 0;
+            double gridSweep = TimeSweeps(grid.get(), gridBullet, shots, &gridHits);
+            double treeSweep = TimeSweeps(tree.get(), treeBullet, shots, &treeHits);
+            double gridMove = TimeMoves(grid.get(), gridBullet, shots);
+
+            printf("  length %6.0f px  grid sweep %8.3f us  tree sweep %8.3f us  grid move %8.3f us  hits %5.1f%% / %5.1f%%\n",
+                   length, gridSweep, treeSweep, gridMove, gridHits * 100.0 / shots.size(), treeHits * 100.0 / shots.size());
+        }
+    }
+}
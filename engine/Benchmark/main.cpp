@@ -0,0 +1,73 @@
+/*
+Author: Vladimir Slav
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "benchmark.h"
+
+struct BenchmarkEntry
+{
+    const char* name;
+    void(*run)();
+};
+
+static const BenchmarkEntry BENCHMARKS[] =
+{
+    { "collision", RunCollisionBenchmark },
+    { "sweep", RunSweepBenchmark },
+    { "pathfinding", RunPathfindingBenchmark },
+    { "replanning", RunReplanningBenchmark },
+};
+
+static const size_t BENCHMARK_AMOUNT = sizeof(BENCHMARKS) / sizeof(BENCHMARKS[0]);
+
+// benchmark [name...], without names every benchmark runs
+int main(int argc, char* argv[])
+{
+    bool ranAny = false;
+    for (size_t i = 0; i < BENCHMARK_AMOUNT; i++)
+    {
+        bool selected = argc < 2;
+        for (int arg = 1; arg < argc; arg++)
+        {
+            selected = selected || strcmp(argv[arg], BENCHMARKS[i].name) == 0;
+        }
+
+        if (selected)
+        {
+            printf("== %s ==\n", BENCHMARKS[i].name);
+            BENCHMARKS[i].run();
+            printf("\n");
+            ranAny = true;
+        }
+    }
+
+    if (ranAny == false)
+    {
+        printf("usage: benchmark [name...], names:");
+        for (size_t i = 0; i < BENCHMARK_AMOUNT; i++)
+        {
+            printf(" %s", BENCHMARKS[i].name);
+        }
+        printf("\n");
+        return 1;
+    }
+
+    return 0;
+}
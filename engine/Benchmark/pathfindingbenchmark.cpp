@@ -0,0 +1,380 @@
+/*
+Author: Vladimir Slav
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include "benchmark.h"
+#include "..\base\pathfinding.h"
+#include "..\base\walkabilitygrid.h"
+#include "..\base\jps.h"
+#include "..\base\weightedpathfinding.h"
+#include "..\base\dstarlite.h"
+
+namespace
+{
+    const int MAP_SIZE = 512;
+    const int QUERIES = 200;
+    const int REPLAN_SIZE = 256;
+    const int CHANGES = 200;
+
+    // single blocked tiles, percent of the map
+    std::vector<bool> MakeScatteredWalls(int size, int percent, unsigned seed)
+    {
+        std::mt19937 random(seed);
+        std::vector<bool> walkable(size * size, true);
+        for (size_t i = 0; i < walkable.size(); i++)
+        {
+            walkable[i] = static_cast<int>(random() % 100) >= percent;
+        }
+        return walkable;
+    }
+
+    // corridors one tile wide between walls one tile wide, carved by a depth first walk over the odd tiles
+    std::vector<bool> MakeMaze(unsigned seed)
+    {
+        std::mt19937 random(seed);
+        std::vector<bool> walkable(MAP_SIZE * MAP_SIZE, false);
+        const int cells = MAP_SIZE / 2;
+        const int dirX[] = { 1, -1, 0, 0 };
+        const int dirY[] = { 0, 0, 1, -1 };
+
+        std::vector<bool> visited(cells * cells, false);
+        std::vector<int> stack(1, 0);
+        visited[0] = true;
+        walkable[MAP_SIZE + 1] = true;
+        while (stack.empty() == false)
+        {
+            int cell = stack.back();
+            int cx = cell % cells;
+            int cy = cell / cells;
+
+            int options[4];
+            int amount = 0;
+            for (int dir = 0; dir < 4; dir++)
+            {
+                int nx = cx + dirX[dir];
+                int ny = cy + dirY[dir];
+                if (nx >= 0 && nx < cells - 1 && ny >= 0 && ny < cells - 1 && visited[ny * cells + nx] == false)
+                {
+                    options[amount++] = dir;
+                }
+            }
+
+            if (amount == 0)
+            {
+                stack.pop_back();
+                continue;
+            }
+
+            int dir = options[random() % amount];
+            int nx = cx + dirX[dir];
+            int ny = cy + dirY[dir];
+            visited[ny * cells + nx] = true;
+            walkable[(cy * 2 + 1 + dirY[dir]) * MAP_SIZE + cx * 2 + 1 + dirX[dir]] = true;
+            walkable[(ny * 2 + 1) * MAP_SIZE + nx * 2 + 1] = true;
+            stack.push_back(ny * cells + nx);
+        }
+        return walkable;
+    }
+
+    // rooms of 32x32 tiles, every wall has a door two tiles wide at a random place
+    std::vector<bool> MakeRooms(unsigned seed)
+    {
+        const int ROOM_SIZE = 32;
+        std::mt19937 random(seed);
+        std::vector<bool> walkable(MAP_SIZE * MAP_SIZE, true);
+        for (int y = 0; y < MAP_SIZE; y++)
+        {
+            for (int x = 0; x < MAP_SIZE; x++)
+            {
+                walkable[y * MAP_SIZE + x] = (x % ROOM_SIZE != 0 && y % ROOM_SIZE != 0);
+            }
+        }
+
+        for (int roomY = 0; roomY < MAP_SIZE; roomY += ROOM_SIZE)
+        {
+            for (int roomX = 0; roomX < MAP_SIZE; roomX += ROOM_SIZE)
+            {
+                int door = 1 + random() % (ROOM_SIZE - 3);
+                if (roomX > 0)
+                {
+                    walkable[(roomY + door) * MAP_SIZE + roomX] = true;
+                    walkable[(roomY + door + 1) * MAP_SIZE + roomX] = true;
+                }
+                door = 1 + random() % (ROOM_SIZE - 3);
+                if (roomY > 0)
+                {
+                    walkable[roomY * MAP_SIZE + roomX + door] = true;
+                    walkable[roomY * MAP_SIZE + roomX + door + 1] = true;
+                }
+            }
+        }
+        return walkable;
+    }
+
+    struct Query
+    {
+        TileCoords start;
+        TileCoords dest;
+    };
+
+    std::vector<Query> MakeQueries(const WalkabilityGrid& grid, unsigned seed)
+    {
+        std::mt19937 random(seed);
+        auto pick = [&]()
+        {
+            TileCoords tile;
+            do
+            {
+                tile.x = random() % MAP_SIZE;
+                tile.y = random() % MAP_SIZE;
+            } while (grid.IsWalkable(tile.x, tile.y) == false);
+            return tile;
+        };
+
+        std::vector<Query> queries(QUERIES);
+        for (auto& query : queries)
+        {
+            query.start = pick();
+            query.dest = pick();
+        }
+        return queries;
+    }
+
+    // cost of a path in the Astar order that includes the destination, with the JPS costs
+    int PathCost(const TileCoords& start, const tile_list& path)
+    {
+        int cost = 0;
+        TileCoords previous = start;
+        for (auto it = path.rbegin(); it != path.rend(); ++it)
+        {
+            bool diagonal = it->x != previous.x && it->y != previous.y;
+            cost += diagonal ? JPS_DIAGONAL_COST : JPS_STRAIGHT_COST;
+            previous = *it;
+        }
+        return cost;
+    }
+
+    struct Result
+    {
+        double ms;
+        size_t expanded;
+        std::vector<int> costs;
+    };
+
+    // search(const Query&, tile_list* path) on a fresh context, -1 for queries without a path
+    template <typename Search> Result TimeQueries(const std::vector<Query>& queries, PathfinderContext* context, Search search)
+    {
+        Result result;
+        tile_list path;
+        context->ResetStats();
+        Uint64 start = SDL_GetPerformanceCounter();
+        for (auto& query : queries)
+        {
+            bool found = search(query, &path);
+            result.costs.push_back(found ? PathCost(query.start, path) : -1);
+        }
+        result.ms = GetElapsedMs(start) / queries.size();
+        result.expanded = context->GetStats().expanded / queries.size();
+        return result;
+    }
+
+    size_t CountMismatches(const Result& a, const Result& b)
+    {
+        size_t mismatches = 0;
+        for (size_t i = 0; i < a.costs.size(); i++)
+        {
+            mismatches += (a.costs[i] != b.costs[i]) ? 1 : 0;
+        }
+        return mismatches;
+    }
+
+    void RunMap(const char* name, const std::vector<bool>& walkable)
+    {
+        WalkabilityGrid grid(MAP_SIZE, MAP_SIZE);
+        grid.Build([&](int x, int y) { return walkable[y * MAP_SIZE + x]; });
+        std::vector<Query> queries = MakeQueries(grid, 777);
+        std::vector<uint8_t> costs(MAP_SIZE * MAP_SIZE, 1);
+        ClearanceCheck fits(&grid, 1);
+        PathfinderContext context(MAP_SIZE, MAP_SIZE);
+
+        Result astar = TimeQueries(queries, &context, [&](const Query& query, tile_list* path)
+        {
+            return context.FindPath(fits, query.start.x, query.start.y, query.dest.x, query.dest.y, true, path);
+        });
+        Result jps4 = TimeQueries(queries, &context, [&](const Query& query, tile_list* path)
+        {
+            return FindJumpPointPath(&context, fits, false, query.start.x, query.start.y, query.dest.x, query.dest.y, true, path);
+        });
+        Result octile = TimeQueries(queries, &context, [&](const Query& query, tile_list* path)
+        {
+            return FindWeightedPath<OctileHeuristic, DiagonalMovement::NO_CORNER_CUTTING>(&context, fits, costs.data(),
+                query.start.x, query.start.y, query.dest.x, query.dest.y, true, path);
+        });
+        Result jps8 = TimeQueries(queries, &context, [&](const Query& query, tile_list* path)
+        {
+            return FindJumpPointPath(&context, fits, true, query.start.x, query.start.y, query.dest.x, query.dest.y, true, path);
+        });
+
+        printf("%s:\n", name);
+        printf("  4-connected  astar %8.3f ms %7lu expanded  jps %8.3f ms %7lu expanded  cost mismatches %lu\n",
+               astar.ms, static_cast<unsigned long>(astar.expanded), jps4.ms, static_cast<unsigned long>(jps4.expanded),
+               static_cast<unsigned long>(CountMismatches(astar, jps4)));
+        printf("  8-connected  astar %8.3f ms %7lu expanded  jps %8.3f ms %7lu expanded  cost mismatches %lu\n",
+               octile.ms, static_cast<unsigned long>(octile.expanded), jps8.ms, static_cast<unsigned long>(jps8.expanded),
+               static_cast<unsigned long>(CountMismatches(octile, jps8)));
+    }
+
+    struct ReplanTotals
+    {
+        double repairMs;
+        size_t repairExpanded;
+        double astarMs;
+        size_t astarExpanded;
+        double planMs;
+        size_t planExpanded;
+        size_t changes;
+    };
+
+    // one benchmark agent: D* Lite kept up to date, against a fresh Astar and a fresh Plan on the same grid
+    class Replanner
+    {
+    private:
+        WalkabilityGrid* grid;
+        TileCoords start;
+        TileCoords dest;
+        DStarLite dstar;
+        DStarLite fresh;
+        PathfinderContext context;
+        tile_list path;
+        tile_list scratch;
+
+    public:
+        Replanner(WalkabilityGrid* _grid, const TileCoords& _start, const TileCoords& _dest)
+            : grid(_grid)
+            , start(_start)
+            , dest(_dest)
+            , dstar(_grid)
+            , fresh(_grid)
+            , context(_grid->GetWidth(), _grid->GetHeight())
+        {
+            dstar.Plan(start.x, start.y, dest.x, dest.y);
+            dstar.GetPath(true, &path);
+        }
+
+        const tile_list& GetPath() const { return path; }
+
+        void Change(int x, int y, bool walkable, ReplanTotals* totals)
+        {
+            grid->SetWalkable(x, y, walkable);
+
+            size_t expanded = dstar.GetExpandedAmount();
+            Uint64 begin = SDL_GetPerformanceCounter();
+            dstar.OnTileChanged(x, y);
+            dstar.GetPath(true, &path);
+            totals->repairMs += GetElapsedMs(begin);
+            totals->repairExpanded += dstar.GetExpandedAmount() - expanded;
+
+            context.ResetStats();
+            begin = SDL_GetPerformanceCounter();
+            context.FindPath(ClearanceCheck(grid, 1), start.x, start.y, dest.x, dest.y, true, &scratch);
+            totals->astarMs += GetElapsedMs(begin);
+            totals->astarExpanded += context.GetStats().expanded;
+
+            begin = SDL_GetPerformanceCounter();
+            fresh.Plan(start.x, start.y, dest.x, dest.y);
+            fresh.GetPath(true, &scratch);
+            totals->planMs += GetElapsedMs(begin);
+            totals->planExpanded += fresh.GetExpandedAmount();
+
+            totals->changes++;
+        }
+    };
+
+    void PrintReplanTotals(const char* name, const ReplanTotals& totals)
+    {
+        size_t changes = std::max<size_t>(totals.changes, 1);
+        printf("  %-22s repair %7.3f ms %6lu expanded  astar %7.3f ms %6lu expanded  plan %7.3f ms %6lu expanded\n", name,
+               totals.repairMs / changes, static_cast<unsigned long>(totals.repairExpanded / changes),
+               totals.astarMs / changes, static_cast<unsigned long>(totals.astarExpanded / changes),
+               totals.planMs / changes, static_cast<unsigned long>(totals.planExpanded / changes));
+    }
+}
+
+void RunPathfindingBenchmark()
+{
+    printf("%dx%d maps, %d queries between random walkable tiles, time and expanded tiles per query:\n", MAP_SIZE, MAP_SIZE, QUERIES);
+    RunMap("open field", MakeScatteredWalls(MAP_SIZE, 1, 11));
+    RunMap("maze", MakeMaze(12));
+    RunMap("rooms", MakeRooms(13));
+}
+
+void RunReplanningBenchmark()
+{
+    std::vector<bool> walkable = MakeScatteredWalls(REPLAN_SIZE, 20, 21);
+    WalkabilityGrid grid(REPLAN_SIZE, REPLAN_SIZE);
+    grid.Build([&](int x, int y) { return walkable[y * REPLAN_SIZE + x]; });
+
+    // from near one corner to near the other, moved until the ends are open and connected
+    TileCoords start = { 2, 2 };
+    TileCoords dest = { REPLAN_SIZE - 3, REPLAN_SIZE - 3 };
+    while (Astar(grid, start.x, start.y, dest.x, dest.y, true, 1).empty())
+    {
+        start.x++;
+        dest.x--;
+    }
+
+    Replanner replanner(&grid, start, dest);
+    std::mt19937 random(22);
+    ReplanTotals blocked = {};
+    ReplanTotals freed = {};
+    ReplanTotals blockedOff = {};
+    ReplanTotals freedOff = {};
+    for (int change = 0; change < CHANGES; change++)
+    {
+        // a tile of the current path, the destination and the tile next to the start stay open
+        const tile_list& path = replanner.GetPath();
+        if (path.size() > 2)
+        {
+            TileCoords tile = path[1 + random() % (path.size() - 2)];
+            replanner.Change(tile.x, tile.y, false, &blocked);
+            replanner.Change(tile.x, tile.y, true, &freed);
+        }
+
+        // and an open tile the path doesn't go through
+        TileCoords tile;
+        do
+        {
+            tile.x = random() % REPLAN_SIZE;
+            tile.y = random() % REPLAN_SIZE;
+        } while (grid.IsWalkable(tile.x, tile.y) == false ||
+                 std::find(path.begin(), path.end(), tile) != path.end() || (tile.x == start.x && tile.y == start.y));
+        replanner.Change(tile.x, tile.y, false, &blockedOff);
+        replanner.Change(tile.x, tile.y, true, &freedOff);
+    }
+
+    printf("%dx%d map with 20%% walls, path of %lu tiles, %d changes of each kind, per change:\n",
+           REPLAN_SIZE, REPLAN_SIZE, static_cast<unsigned long>(replanner.GetPath().size()), CHANGES);
+    PrintReplanTotals("block a path tile", blocked);
+    PrintReplanTotals("free it again", freed);
+    PrintReplanTotals("block another tile", blockedOff);
+    PrintReplanTotals("free it again", freedOff);
+}
@@ -22,6 +22,7 @@ OTHER DEALINGS IN THE SOFTWARE.
 #include "..\base\graph.h"
 #include "..\base\Timer.h"
 #include "..\base\particles.h"
+#include "..\base\particlesystem.h"
 #include "..\base\input.h"
 #include "..\base\gamescreen.h"
 
@@ -31,81 +32,6 @@ static const int SCREEN_W = 640;
 
 static const int SPEED = 5;
 
-class DustParticle : public EngineParticles::Particle
-{
-private:
-    unsigned int frame;
-    unsigned int frame_time; //How fast do frames flip
-    unsigned int last_time;
-
-    unsigned short frames_horizontal;
-    unsigned short frames_vertical;
-
-    unsigned short frame_w;
-    unsigned short frame_h;
-
-    unsigned short last_frame;
-
-    SDL_Rect frame_r;
-public:
-
-    DustParticle(sprite_id _texture, int _x, int _y, int _life, int _time, Graph* g)
-        : Particle(_texture, _x, _y, _life, _time)
-        , frame(0)
-        , frame_time(100)
-        , last_time(_time)
-        , frames_horizontal(6)
-        , frames_vertical(1)
-    {
-        int w = 0;
-        int h = 0;
-        
-        SDL_assert_release(SDL_QueryTexture(g->GetTexture(_texture), NULL, NULL, &w, &h) == 0);
-
-        frame_w = w / frames_horizontal;
-        frame_h = h / frames_vertical;
-
-        frame_r.w = frame_w;
-        frame_r.h = frame_h;
-
-        last_frame = frames_horizontal * frames_vertical - 1;
-    }
-
-    virtual void Update(int new_time)
-    {
-        Particle::Update(new_time);
-        if (new_time - last_time > frame_time)
-        {
-            last_time = new_time;
-            frame++;
-        }
-    }
-
-    virtual bool IsDead()
-    {
-        return frame > last_frame;
-    }
-
-    SDL_Rect* GetFrame()
-    {
-
-        if (frame < last_frame)
-        {
-            frame_r.x = (frame % frames_horizontal) * frame_w;
-            frame_r.y = (frame / frames_horizontal) * frame_h;
-        }
-        else
-        {
-            frame_r.x = (last_frame % frames_horizontal) * frame_w;
-            frame_r.y = (last_frame / frames_horizontal) * frame_h;
-        }
-
-        return &frame_r;
-    }
-
-
-};
-
 class MainScreen : public GameScreen
 {
 
@@ -118,6 +44,7 @@ private:
     Timer particle_timer;
     sprite_id basilisk;
     sprite_id dust;
+    std::unique_ptr<EngineParticles::FlipbookSheet> dustSheet;
 
 public:
 
@@ -126,6 +53,11 @@ public:
         particle_timer.Reset();
         basilisk = g.LoadTextureAlphaPink("res\\sprite\\basilisk.png");
         dust = g.LoadTextureAlphaPink("res\\sprite\\dust.png");
+
+        size_t dustW = 0;
+        size_t dustH = 0;
+        g.GetTextureSize(dust, &dustW, &dustH);
+        dustSheet.reset(new EngineParticles::FlipbookSheet(&g, dust, dustW / 6, dustH, 6, 100));
         SDL_Color bgcolor;
         bgcolor.a = 255;
         bgcolor.r = 0;
@@ -228,7 +160,7 @@ public:
                     face_right = false;
                     break;
                 case SDLK_q:
-                    EngineParticles::Add(new DustParticle(dust, 100, 100, 1, particle_timer.GetTicks(), g));
+                    EngineParticles::GetDefaultSystem().AddFlipbook(*dustSheet, 100, 100, 0, 0, particle_timer.GetTicks());
                 }
                 break;
             }
@@ -0,0 +1,443 @@
+/*
+Author: Vladimir Slav
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "aabbtree.h"
+#include "..\SDL2\include\SDL.h"
+
+double AABB::RayFraction(double x0, double y0, double dx, double dy, double max_fraction) const
+{
+	double tMin = 0.0;
+	double tMax = max_fraction;
+
+	// slab test on both axes
+	const double origin[2] = { x0, y0 };
+	const double direction[2] = { dx, dy };
+	const double boxMin[2] = { minX, minY };
+	const double boxMax[2] = { maxX, maxY };
+	for (int axis = 0; axis < 2; axis++)
+	{
+		if (std::abs(direction[axis]) < 1e-12)
+		{
+			if (origin[axis] < boxMin[axis] || origin[axis] > boxMax[axis])
+			{
+				return -1.0;
+			}
+			continue;
+		}
+
+		double t1 = (boxMin[axis] - origin[axis]) / direction[axis];
+		double t2 = (boxMax[axis] - origin[axis]) / direction[axis];
+		tMin = std::max(tMin, std::min(t1, t2));
+		tMax = std::min(tMax, std::max(t1, t2));
+		if (tMin > tMax)
+		{
+			return -1.0;
+		}
+	}
+
+	return tMin;
+}
+
+double AABB::SweepFraction(const AABB& moving, double dx, double dy, double max_fraction) const
+{
+	double tMin = 0.0;
+	double tMax = max_fraction;
+
+	// slab test of the moving box against this one grown by its size, in the same form as the sweep of objects
+	const double movingMin[2] = { moving.minX, moving.minY };
+	const double movingMax[2] = { moving.maxX, moving.maxY };
+	const double boxMin[2] = { minX, minY };
+	const double boxMax[2] = { maxX, maxY };
+	const double displacement[2] = { dx, dy };
+	for (int axis = 0; axis < 2; axis++)
+	{
+		double d = displacement[axis];
+		if (d == 0.0)
+		{
+			if (movingMin[axis] > boxMax[axis] || boxMin[axis] > movingMax[axis])
+			{
+				return -1.0;
+			}
+			continue;
+		}
+
+		double entry = ((d > 0.0) ? boxMin[axis] - movingMax[axis] : boxMax[axis] - movingMin[axis]) / d;
+		double exit = ((d > 0.0) ? boxMax[axis] - movingMin[axis] : boxMin[axis] - movingMax[axis]) / d;
+		tMin = std::max(tMin, entry);
+		tMax = std::min(tMax, exit);
+		if (tMin > tMax)
+		{
+			return -1.0;
+		}
+	}
+
+	return tMin;
+}
+
+AABBTree::AABBTree(double margin)
+	: root(NULL_NODE)
+	, freeList(NULL_NODE)
+	, margin(margin)
+{
+}
+
+void AABBTree::Clear()
+{
+	nodes.clear();
+	root = NULL_NODE;
+	freeList = NULL_NODE;
+}
+
+int AABBTree::AllocateNode()
+{
+	int id;
+	if (freeList != NULL_NODE)
+	{
+		id = freeList;
+		freeList = nodes[id].parent;
+	}
+	else
+	{
+		id = static_cast<int>(nodes.size());
+		nodes.push_back(Node());
+	}
+
+	Node& node = nodes[id];
+	node.userData = nullptr;
+	node.parent = NULL_NODE;
+	node.child1 = NULL_NODE;
+	node.child2 = NULL_NODE;
+	node.height = 0;
+	return id;
+}
+
+void AABBTree::FreeNode(int node)
+{
+	nodes[node].parent = freeList;
+	nodes[node].height = -1;
+	freeList = node;
+}
+
+int AABBTree::CreateProxy(const AABB& aabb, void* user_data)
+{
+	int proxy = AllocateNode();
+	Node& node = nodes[proxy];
+	node.aabb.minX = aabb.minX - margin;
+	node.aabb.minY = aabb.minY - margin;
+	node.aabb.maxX = aabb.maxX + margin;
+	node.aabb.maxY = aabb.maxY + margin;
+	node.userData = user_data;
+
+	InsertLeaf(proxy);
+	return proxy;
+}
+
+void AABBTree::DestroyProxy(int proxy_id)
+{
+	SDL_assert_release(proxy_id >= 0 && proxy_id < static_cast<int>(nodes.size()) && nodes[proxy_id].IsLeaf());
+	RemoveLeaf(proxy_id);
+	FreeNode(proxy_id);
+}
+
+bool AABBTree::MoveProxy(int proxy_id, const AABB& aabb)
+{
+	SDL_assert_release(proxy_id >= 0 && proxy_id < static_cast<int>(nodes.size()) && nodes[proxy_id].IsLeaf());
+	if (nodes[proxy_id].aabb.Contains(aabb))
+	{
+		return false;
+	}
+
+	RemoveLeaf(proxy_id);
+	Node& node = nodes[proxy_id];
+	node.aabb.minX = aabb.minX - margin;
+	node.aabb.minY = aabb.minY - margin;
+	node.aabb.maxX = aabb.maxX + margin;
+	node.aabb.maxY = aabb.maxY + margin;
+	InsertLeaf(proxy_id);
+	return true;
+}
+
+void* AABBTree::GetUserData(int proxy_id) const
+{
+	return nodes[proxy_id].userData;
+}
+
+const AABB& AABBTree::GetFatAABB(int proxy_id) const
+{
+	return nodes[proxy_id].aabb;
+}
+
+int AABBTree::GetHeight() const
+{
+	return (root == NULL_NODE) ? 0 : nodes[root].height;
+}
+
+void AABBTree::InsertLeaf(int leaf)
+{
+	if (root == NULL_NODE)
+	{
+		root = leaf;
+		nodes[root].parent = NULL_NODE;
+		return;
+	}
+
+	// find the best sibling by the surface area heuristic (perimeter in 2d)
+	AABB leafAABB = nodes[leaf].aabb;
+	int index = root;
+	while (nodes[index].IsLeaf() == false)
+	{
+		int child1 = nodes[index].child1;
+		int child2 = nodes[index].child2;
+
+		double area = nodes[index].aabb.Perimeter();
+		double combinedArea = AABB::Union(nodes[index].aabb, leafAABB).Perimeter();
+
+		// cost of creating a new parent for this node and the new leaf
+		double cost = 2.0 * combinedArea;
+		// minimum cost of pushing the leaf further down the tree
+		double inheritanceCost = 2.0 * (combinedArea - area);
+
+		double childCost[2];
+		int children[2] = { child1, child2 };
+		for (int i = 0; i < 2; i++)
+		{
+			const Node& child = nodes[children[i]];
+			double unionArea = AABB::Union(leafAABB, child.aabb).Perimeter();
+			childCost[i] = child.IsLeaf() ? unionArea + inheritanceCost : (unionArea - child.aabb.Perimeter()) + inheritanceCost;
+		}
+
+		if (cost < childCost[0] && cost < childCost[1])
+		{
+			break;
+		}
+
+		index = (childCost[0] < childCost[1]) ? child1 : child2;
+	}
+
+	int sibling = index;
+	int oldParent = nodes[sibling].parent;
+	int newParent = AllocateNode();
+	nodes[newParent].parent = oldParent;
+	nodes[newParent].aabb = AABB::Union(leafAABB, nodes[sibling].aabb);
+	nodes[newParent].height = nodes[sibling].height + 1;
+	nodes[newParent].child1 = sibling;
+	nodes[newParent].child2 = leaf;
+	nodes[sibling].parent = newParent;
+	nodes[leaf].parent = newParent;
+
+	if (oldParent != NULL_NODE)
+	{
+		if (nodes[oldParent].child1 == sibling)
+		{
+			nodes[oldParent].child1 = newParent;
+		}
+		else
+		{
+			nodes[oldParent].child2 = newParent;
+		}
+	}
+	else
+	{
+		root = newParent;
+	}
+
+	// walk back up fixing heights and boxes
+	index = nodes[leaf].parent;
+	while (index != NULL_NODE)
+	{
+		index = Balance(index);
+
+		int child1 = nodes[index].child1;
+		int child2 = nodes[index].child2;
+		nodes[index].height = 1 + std::max(nodes[child1].height, nodes[child2].height);
+		nodes[index].aabb = AABB::Union(nodes[child1].aabb, nodes[child2].aabb);
+
+		index = nodes[index].parent;
+	}
+}
+
+void AABBTree::RemoveLeaf(int leaf)
+{
+	if (leaf == root)
+	{
+		root = NULL_NODE;
+		return;
+	}
+
+	int parent = nodes[leaf].parent;
+	int grandParent = nodes[parent].parent;
+	int sibling = (nodes[parent].child1 == leaf) ? nodes[parent].child2 : nodes[parent].child1;
+
+	if (grandParent != NULL_NODE)
+	{
+		// the sibling takes the place of the parent
+		if (nodes[grandParent].child1 == parent)
+		{
+			nodes[grandParent].child1 = sibling;
+		}
+		else
+		{
+			nodes[grandParent].child2 = sibling;
+		}
+		nodes[sibling].parent = grandParent;
+		FreeNode(parent);
+
+		int index = grandParent;
+		while (index != NULL_NODE)
+		{
+			index = Balance(index);
+
+			int child1 = nodes[index].child1;
+			int child2 = nodes[index].child2;
+			nodes[index].aabb = AABB::Union(nodes[child1].aabb, nodes[child2].aabb);
+			nodes[index].height = 1 + std::max(nodes[child1].height, nodes[child2].height);
+
+			index = nodes[index].parent;
+		}
+	}
+	else
+	{
+		root = sibling;
+		nodes[sibling].parent = NULL_NODE;
+		FreeNode(parent);
+	}
+}
+
+// rotates the subtree if it is imbalanced, returns the new subtree root
+int AABBTree::Balance(int iA)
+{
+	Node* A = &nodes[iA];
+	if (A->IsLeaf() || A->height < 2)
+	{
+		return iA;
+	}
+
+	int iB = A->child1;
+	int iC = A->child2;
+	Node* B = &nodes[iB];
+	Node* C = &nodes[iC];
+
+	int balance = C->height - B->height;
+
+	// rotate C up
+	if (balance > 1)
+	{
+		int iF = C->child1;
+		int iG = C->child2;
+		Node* F = &nodes[iF];
+		Node* G = &nodes[iG];
+
+		C->child1 = iA;
+		C->parent = A->parent;
+		A->parent = iC;
+
+		if (C->parent != NULL_NODE)
+		{
+			if (nodes[C->parent].child1 == iA)
+			{
+				nodes[C->parent].child1 = iC;
+			}
+			else
+			{
+				nodes[C->parent].child2 = iC;
+			}
+		}
+		else
+		{
+			root = iC;
+		}
+
+		if (F->height > G->height)
+		{
+			C->child2 = iF;
+			A->child2 = iG;
+			G->parent = iA;
+			A->aabb = AABB::Union(B->aabb, G->aabb);
+			C->aabb = AABB::Union(A->aabb, F->aabb);
+			A->height = 1 + std::max(B->height, G->height);
+			C->height = 1 + std::max(A->height, F->height);
+		}
+		else
+		{
+			C->child2 = iG;
+			A->child2 = iF;
+			F->parent = iA;
+			A->aabb = AABB::Union(B->aabb, F->aabb);
+			C->aabb = AABB::Union(A->aabb, G->aabb);
+			A->height = 1 + std::max(B->height, F->height);
+			C->height = 1 + std::max(A->height, G->height);
+		}
+
+		return iC;
+	}
+
+	// rotate B up
+	if (balance < -1)
+	{
+		int iD = B->child1;
+		int iE = B->child2;
+		Node* D = &nodes[iD];
+		Node* E = &nodes[iE];
+
+		B->child1 = iA;
+		B->parent = A->parent;
+		A->parent = iB;
+
+		if (B->parent != NULL_NODE)
+		{
+			if (nodes[B->parent].child1 == iA)
+			{
+				nodes[B->parent].child1 = iB;
+			}
+			else
+			{
+				nodes[B->parent].child2 = iB;
+			}
+		}
+		else
+		{
+			root = iB;
+		}
+
+		if (D->height > E->height)
+		{
+			B->child2 = iD;
+			A->child1 = iE;
+			E->parent = iA;
+			A->aabb = AABB::Union(C->aabb, E->aabb);
+			B->aabb = AABB::Union(A->aabb, D->aabb);
+			A->height = 1 + std::max(C->height, E->height);
+			B->height = 1 + std::max(A->height, D->height);
+		}
+		else
+		{
+			B->child2 = iE;
+			A->child1 = iD;
+			D->parent = iA;
+			A->aabb = AABB::Union(C->aabb, D->aabb);
+			B->aabb = AABB::Union(A->aabb, E->aabb);
+			A->height = 1 + std::max(C->height, D->height);
+			B->height = 1 + std::max(A->height, E->height);
+		}
+
+		return iB;
+	}
+
+	return iA;
+}
@@ -0,0 +1,287 @@
+/*
+Author: Vladimir Slav
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+ Dynamic bounding volume tree: every leaf stores a "fat" box, enlarged by a margin, so objects can move a bit
+ without the tree being touched. A leaf is reinserted only when its object leaves the fat box.
+ Inner nodes are kept balanced with rotations, queries walk the tree with an explicit stack.
+*/
+
+#ifndef __AABBTREE_H__
+#define __AABBTREE_H__
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+struct AABB
+{
+	double minX;
+	double minY;
+	double maxX;
+	double maxY;
+
+	bool Overlaps(const AABB& other) const
+	{
+		return minX < other.maxX && other.minX < maxX && minY < other.maxY && other.minY < maxY;
+	}
+
+	bool Contains(const AABB& other) const
+	{
+		return minX <= other.minX && minY <= other.minY && other.maxX <= maxX && other.maxY <= maxY;
+	}
+
+	bool Contains(double x, double y) const
+	{
+		return minX <= x && x < maxX && minY <= y && y < maxY;
+	}
+
+	double Perimeter() const
+	{
+		return 2.0 * ((maxX - minX) + (maxY - minY));
+	}
+
+	// entry fraction of the segment (x0, y0) + t * (dx, dy), t in [0, max_fraction], or -1 if it misses
+	double RayFraction(double x0, double y0, double dx, double dy, double max_fraction) const;
+	// same for the box moving by t * (dx, dy), touching counts
+	double SweepFraction(const AABB& moving, double dx, double dy, double max_fraction) const;
+
+	static AABB Union(const AABB& a, const AABB& b)
+	{
+		AABB result = { std::min(a.minX, b.minX), std::min(a.minY, b.minY), std::max(a.maxX, b.maxX), std::max(a.maxY, b.maxY) };
+		return result;
+	}
+};
+
+class AABBTree
+{
+public:
+	static const int NULL_NODE = -1;
+
+	explicit AABBTree(double margin);
+
+	int CreateProxy(const AABB& aabb, void* user_data);
+	void DestroyProxy(int proxy_id);
+	// returns true if the leaf had to be reinserted
+	bool MoveProxy(int proxy_id, const AABB& aabb);
+
+	void* GetUserData(int proxy_id) const;
+	const AABB& GetFatAABB(int proxy_id) const;
+	int GetHeight() const;
+	void Clear();
+
+	// callback(int proxy_id) returns false to stop the query
+	template <typename T> void Query(const AABB& aabb, T callback) const;
+	template <typename T> void QueryPoint(double x, double y, T callback) const;
+	// callback(int proxy_id, double max_fraction) returns the new max fraction: 0 stops, negative ignores the proxy
+	template <typename T> void RayCast(double x0, double y0, double x1, double y1, T callback) const;
+	// callback(int proxy_id, double max_fraction) returns the new max fraction, subtrees the box enters later are skipped
+	template <typename T> void BoxCast(const AABB& box, double dx, double dy, T callback) const;
+
+private:
+	struct Node
+	{
+		AABB aabb;
+		void* userData;
+		int parent; // next free node while the node is unused
+		int child1;
+		int child2;
+		int height; // leaf = 0, free node = -1
+
+		bool IsLeaf() const
+		{
+			return child1 == NULL_NODE;
+		}
+	};
+
+	// traversal stack that only touches the heap for very deep trees
+	class Stack
+	{
+		int fixed[64];
+		std::vector<int> extra;
+		int* data;
+		size_t capacity;
+		size_t count;
+	public:
+		Stack() : data(fixed), capacity(64), count(0) {}
+		bool Empty() const { return count == 0; }
+		int Pop() { return data[--count]; }
+		void Push(int value)
+		{
+			if (count == capacity)
+			{
+				// only the inline buffer has to be copied, once on the heap resize keeps the contents
+				if (data == fixed)
+				{
+					extra.assign(fixed, fixed + count);
+				}
+				extra.resize(capacity * 2);
+				data = extra.data();
+				capacity *= 2;
+			}
+			data[count++] = value;
+		}
+	};
+
+	std::vector<Node> nodes;
+	int root;
+	int freeList;
+	double margin;
+
+	int AllocateNode();
+	void FreeNode(int node);
+	void InsertLeaf(int leaf);
+	void RemoveLeaf(int leaf);
+	int Balance(int node);
+};
+
+template <typename T> void AABBTree::Query(const AABB& aabb, T callback) const
+{
+	Stack stack;
+	if (root != NULL_NODE)
+	{
+		stack.Push(root);
+	}
+
+	while (stack.Empty() == false)
+	{
+		const Node& node = nodes[stack.Pop()];
+		if (node.aabb.Overlaps(aabb) == false)
+		{
+			continue;
+		}
+
+		if (node.IsLeaf())
+		{
+			if (callback(static_cast<int>(&node - nodes.data())) == false)
+			{
+				return;
+			}
+		}
+		else
+		{
+			stack.Push(node.child1);
+			stack.Push(node.child2);
+		}
+	}
+}
+
+template <typename T> void AABBTree::QueryPoint(double x, double y, T callback) const
+{
+	Stack stack;
+	if (root != NULL_NODE)
+	{
+		stack.Push(root);
+	}
+
+	while (stack.Empty() == false)
+	{
+		const Node& node = nodes[stack.Pop()];
+		if (node.aabb.Contains(x, y) == false)
+		{
+			continue;
+		}
+
+		if (node.IsLeaf())
+		{
+			if (callback(static_cast<int>(&node - nodes.data())) == false)
+			{
+				return;
+			}
+		}
+		else
+		{
+			stack.Push(node.child1);
+			stack.Push(node.child2);
+		}
+	}
+}
+
+template <typename T> void AABBTree::RayCast(double x0, double y0, double x1, double y1, T callback) const
+{
+	double dx = x1 - x0;
+	double dy = y1 - y0;
+	double maxFraction = 1.0;
+
+	Stack stack;
+	if (root != NULL_NODE)
+	{
+		stack.Push(root);
+	}
+
+	while (stack.Empty() == false)
+	{
+		const Node& node = nodes[stack.Pop()];
+		if (node.aabb.RayFraction(x0, y0, dx, dy, maxFraction) < 0.0)
+		{
+			continue;
+		}
+
+		if (node.IsLeaf())
+		{
+			double fraction = callback(static_cast<int>(&node - nodes.data()), maxFraction);
+			if (fraction == 0.0)
+			{
+				return;
+			}
+			if (fraction > 0.0)
+			{
+				// closer hits only from now on
+				maxFraction = std::min(maxFraction, fraction);
+			}
+		}
+		else
+		{
+			stack.Push(node.child1);
+			stack.Push(node.child2);
+		}
+	}
+}
+
+template <typename T> void AABBTree::BoxCast(const AABB& box, double dx, double dy, T callback) const
+{
+	double maxFraction = 1.0;
+
+	Stack stack;
+	if (root != NULL_NODE)
+	{
+		stack.Push(root);
+	}
+
+	while (stack.Empty() == false)
+	{
+		const Node& node = nodes[stack.Pop()];
+		if (node.aabb.SweepFraction(box, dx, dy, maxFraction) < 0.0)
+		{
+			continue;
+		}
+
+		if (node.IsLeaf())
+		{
+			maxFraction = std::min(maxFraction, callback(static_cast<int>(&node - nodes.data()), maxFraction));
+		}
+		else
+		{
+			stack.Push(node.child1);
+			stack.Push(node.child2);
+		}
+	}
+}
+
+#endif
@@ -17,10 +17,15 @@ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
 OTHER DEALINGS IN THE SOFTWARE.
 */
 
-#include <string.h>
-
 #include "collisiongrid.h"
+#include "threadpool.h"
 #include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include "..\SDL2\include\SDL.h"
+
+static const uint32_t INVALID_EVENT_REF = 0xFFFFFFFF;
 
 Collideable::Collideable(double x, double y, int width, int height, int type, bool** CollisionGrid, size_t grid_tile_size)
 	: x(x)
@@ -28,20 +33,28 @@ Collideable::Collideable(double x, double y, int width, int height, int type, bo
 	, width(width)
 	, height(height)
 	, type(type)
+	, fullMask(true)
 	, needsToBeDeleted(false)
+	, pixelMask(nullptr)
+	, layers(1)
+	, collidesWith(0xFFFFFFFF)
+	, owner(nullptr)
+	, slot(0)
+	, objectIndex(0)
+	, proxyId(0)
 {
 	GridW = (width + grid_tile_size - 1) / grid_tile_size;
 	GridH = (height + grid_tile_size - 1) / grid_tile_size;
 
-	if (CollisionGrid == nullptr)
+	collisionMask.assign((GridW * GridH + 31) / 32, 0xFFFFFFFF);
+
+	if (CollisionGrid != nullptr)
 	{
-		this->CollisionGrid = new bool*[GridW];
 		for (size_t i = 0; i < GridW; i++)
 		{
-			this->CollisionGrid[i] = new bool[GridH];
 			for (size_t j = 0; j < GridH; j++)
 			{
-				this->CollisionGrid[i][j] = true;
+				SetMask(i, j, CollisionGrid[i][j]);
 			}
 		}
 	}
@@ -64,11 +77,6 @@ int Collideable::GetType() const
 
 Collideable::~Collideable()
 {
-	for (size_t i = 0; i < GridW; i++)
-	{
-		delete [] CollisionGrid[i];
-	}
-	delete[] CollisionGrid;
 }
 
 
@@ -92,9 +100,30 @@ size_t Collideable::GetGridH() const
 	return GridH;
 }
 
-bool** Collideable::GetGrid() const
+bool Collideable::IsMaskSet(size_t x, size_t y) const
+{
+	size_t bit = y * GridW + x;
+	return (collisionMask[bit / 32] & (1u << (bit % 32))) != 0;
+}
+
+void Collideable::SetMask(size_t x, size_t y, bool value)
 {
-	return CollisionGrid;
+	SDL_assert_release(x < GridW && y < GridH);
+	size_t bit = y * GridW + x;
+	if (value)
+	{
+		collisionMask[bit / 32] |= (1u << (bit % 32));
+	}
+	else
+	{
+		collisionMask[bit / 32] &= ~(1u << (bit % 32));
+		fullMask = false;
+	}
+}
+
+bool Collideable::IsMaskFull() const
+{
+	return fullMask;
 }
 
 
@@ -112,12 +141,20 @@ void Collideable::SetCoords(double x, double y)
 {
 	this->x = x;
 	this->y = y;
+	if (owner != nullptr)
+	{
+		owner->OnObjectMoved(this);
+	}
 }
 
 void Collideable::Move(double dx, double dy)
 {
 	this->x += dx;
 	this->y += dy;
+	if (owner != nullptr)
+	{
+		owner->OnObjectMoved(this);
+	}
 }
 
 bool Collideable::ShouldBeDeleted()
@@ -130,45 +167,519 @@ void Collideable::DeleteOnNextCheck()
     needsToBeDeleted = true;
 }
 
+void Collideable::SetPixelMask(const PixelMask* mask)
+{
+	pixelMask = mask;
+}
+
+const PixelMask* Collideable::GetPixelMask() const
+{
+	return pixelMask;
+}
+
+void Collideable::SetLayers(uint32_t layers)
+{
+	this->layers = layers;
+}
+
+uint32_t Collideable::GetLayers() const
+{
+	return layers;
+}
+
+void Collideable::SetCollidesWith(uint32_t layers)
+{
+	collidesWith = layers;
+}
+
+uint32_t Collideable::GetCollidesWith() const
+{
+	return collidesWith;
+}
+
 CollisionGrid::CollisionGrid(int top_border, int left_border, int w_in_pixels, int h_in_pixels, size_t square_w, size_t square_h)
 	: wPixels(w_in_pixels)
 	, hPixels(h_in_pixels)
-	, squareWidth(square_w)
-	, squareHeight(square_h)
-	, wSquares(w_in_pixels / square_w + ((w_in_pixels % square_w > 0) ? 1 : 0))
-	, hSquares(h_in_pixels / square_h + ((h_in_pixels % square_w > 0) ? 1 : 0))
 	, topBorder(top_border)
 	, leftBorder(left_border)
+	, unbounded(false)
+	, wSquares(w_in_pixels / square_w + ((w_in_pixels % square_w > 0) ? 1 : 0))
+	, hSquares(h_in_pixels / square_h + ((h_in_pixels % square_h > 0) ? 1 : 0))
+	, squareWidth(square_w)
+	, squareHeight(square_h)
+	, generation(1)
+	, cellsValid(false)
+	, queryGeneration(1)
+	, checking(false)
+	, threadPool(nullptr)
+	, typeFilterSize(0)
+	, eventMode(false)
+	, contactFrame(0)
+	, eventRefsValid(false)
+{
+	ResetLayerStats();
+}
+
+CollisionGrid::CollisionGrid(size_t square_w, size_t square_h)
+	: wPixels(0)
+	, hPixels(0)
+	, topBorder(0)
+	, leftBorder(0)
+	, unbounded(true)
+	, wSquares(0)
+	, hSquares(0)
+	, squareWidth(square_w)
+	, squareHeight(square_h)
+	, generation(1)
+	, cellsValid(false)
+	, queryGeneration(1)
+	, checking(false)
+	, threadPool(nullptr)
+	, typeFilterSize(0)
+	, eventMode(false)
+	, contactFrame(0)
+	, eventRefsValid(false)
 {
-	objMap = new Collideable**[wSquares];
-	for (size_t i = 0; i < wSquares; i++)
+	ResetLayerStats();
+}
+
+CollisionGrid::~CollisionGrid()
+{
+	for (auto obj : objects)
 	{
-		objMap[i] = new Collideable*[hSquares];
-		memset(objMap[i], 0, sizeof(Collideable*) * hSquares);
+		delete obj;
 	}
 }
 
-CollisionGrid::~CollisionGrid()
+size_t CollisionGrid::CellIndex(size_t x, size_t y) const
 {
-	for (size_t i = 0; i < wSquares; i++)
+	return y * wSquares + x;
+}
+
+void CollisionGrid::ClearCells()
+{
+	generation++;
+	if (generation == 0)
 	{
-		delete[] objMap[i];
+		// counter wrapped around, stale stamps could match again
+		std::fill(cellStamps.begin(), cellStamps.end(), 0);
+		generation = 1;
 	}
-	delete[] objMap;
+	occupiedCells.clear();
+	cellsValid = false;
+}
 
-	for (auto obj : objects)
+void CollisionGrid::NextQuery()
+{
+	if (queryStamps.size() < objects.size())
 	{
-		delete obj;
+		queryStamps.resize(objects.size(), 0);
+	}
+
+	queryGeneration++;
+	if (queryGeneration == 0)
+	{
+		std::fill(queryStamps.begin(), queryStamps.end(), 0);
+		queryGeneration = 1;
+	}
+}
+
+bool CollisionGrid::GetCellRange(const Collideable* obj, int* x0, int* y0, int* x1, int* y1) const
+{
+	if (unbounded)
+	{
+		*x0 = static_cast<int>(std::floor(obj->GetX() / squareWidth));
+		*y0 = static_cast<int>(std::floor(obj->GetY() / squareHeight));
+		*x1 = *x0 + static_cast<int>(obj->GetGridW());
+		*y1 = *y0 + static_cast<int>(obj->GetGridH());
+		return *x0 < *x1 && *y0 < *y1;
+	}
+
+	int initialX = std::max((static_cast<int>(obj->GetX()) - leftBorder) / static_cast<int>(squareWidth), 0);
+	int initialY = std::max((static_cast<int>(obj->GetY()) - topBorder) / static_cast<int>(squareHeight), 0);
+	*x0 = initialX;
+	*y0 = initialY;
+	*x1 = std::min(initialX + static_cast<int>(obj->GetGridW()), static_cast<int>(wSquares));
+	*y1 = std::min(initialY + static_cast<int>(obj->GetGridH()), static_cast<int>(hSquares));
+	return *x0 < *x1 && *y0 < *y1;
+}
+
+void CollisionGrid::BuildCells()
+{
+	// allocated on first use, so broadphases that never build the cells don't pay for the grid area
+	if (cellStamps.empty())
+	{
+		cellStart.assign(wSquares * hSquares, 0);
+		cellCount.assign(wSquares * hSquares, 0);
+		cellStamps.assign(wSquares * hSquares, 0);
+	}
+
+	ClearCells();
+	if (unbounded)
+	{
+		// nothing to fill, queries on an unbounded world are answered by the derived broadphase
+		cellsValid = true;
+		return;
+	}
+
+	// first pass: count objects per cell, remembering which cells were touched
+	objectCells.resize(objects.size());
+	int x0, y0, x1, y1;
+	for (size_t i = 0; i < objects.size(); i++)
+	{
+		Collideable* obj = objects[i];
+		bool inside = GetCellRange(obj, &x0, &y0, &x1, &y1);
+		CellRange& range = objectCells[i];
+		range.x0 = x0;
+		range.y0 = y0;
+		range.x1 = x1;
+		range.y1 = y1;
+		if (inside == false)
+		{
+			continue;
+		}
+
+		bool fullMask = obj->IsMaskFull();
+		for (int y = y0; y < y1; y++)
+		{
+			size_t cell = CellIndex(x0, y);
+			for (int x = x0; x < x1; x++, cell++)
+			{
+				if (fullMask == false && obj->IsMaskSet(x - x0, y - y0) == false)
+				{
+					continue;
+				}
+
+				if (cellStamps[cell] != generation)
+				{
+					cellStamps[cell] = generation;
+					cellCount[cell] = 0;
+					occupiedCells.push_back(static_cast<uint32_t>(cell));
+				}
+				cellCount[cell]++;
+			}
+		}
+	}
+
+	// prefix sum over the occupied cells only, counts are reused as fill cursors
+	uint32_t total = 0;
+	for (auto cell : occupiedCells)
+	{
+		cellStart[cell] = total;
+		total += cellCount[cell];
+		cellCount[cell] = 0;
+	}
+	cellEntries.resize(total);
+
+	// second pass: scatter object indices, every cell run ends up sorted by object index
+	for (size_t i = 0; i < objects.size(); i++)
+	{
+		Collideable* obj = objects[i];
+		const CellRange& range = objectCells[i];
+		x0 = range.x0;
+		y0 = range.y0;
+		x1 = range.x1;
+		y1 = range.y1;
+		if (x0 >= x1 || y0 >= y1)
+		{
+			continue;
+		}
+
+		bool fullMask = obj->IsMaskFull();
+		for (int y = y0; y < y1; y++)
+		{
+			size_t cell = CellIndex(x0, y);
+			for (int x = x0; x < x1; x++, cell++)
+			{
+				if (fullMask == false && obj->IsMaskSet(x - x0, y - y0) == false)
+				{
+					continue;
+				}
+
+				cellEntries[cellStart[cell] + cellCount[cell]++] = static_cast<uint32_t>(i);
+			}
+		}
+	}
+
+	cellsValid = true;
+}
+
+uint32_t CollisionGrid::GetProxyId(const Collideable* obj)
+{
+	return obj->proxyId;
+}
+
+void CollisionGrid::SetProxyId(Collideable* obj, uint32_t id)
+{
+	obj->proxyId = id;
+}
+
+uint32_t CollisionGrid::GetObjectIndex(const Collideable* obj)
+{
+	return obj->objectIndex;
+}
+
+void CollisionGrid::OnObjectRemoved(Collideable* obj)
+{
+}
+
+void CollisionGrid::OnObjectMoved(Collideable* obj)
+{
+}
+
+bool CollisionGrid::SharesCell(uint32_t first, const CellRange& a, uint32_t second, const CellRange& b) const
+{
+	int x0 = std::max(a.x0, b.x0);
+	int y0 = std::max(a.y0, b.y0);
+	int x1 = std::min(a.x1, b.x1);
+	int y1 = std::min(a.y1, b.y1);
+	if (x0 >= x1 || y0 >= y1)
+	{
+		return false;
+	}
+
+	const Collideable* firstObj = objects[first];
+	const Collideable* secondObj = objects[second];
+	if (firstObj->IsMaskFull() && secondObj->IsMaskFull())
+	{
+		return true;
+	}
+
+	for (int y = y0; y < y1; y++)
+	{
+		for (int x = x0; x < x1; x++)
+		{
+			if (firstObj->IsMaskSet(x - a.x0, y - a.y0) && secondObj->IsMaskSet(x - b.x0, y - b.y0))
+			{
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+bool CollisionGrid::PixelsOverlap(const Collideable* first, const Collideable* second)
+{
+	const PixelMask* firstMask = first->pixelMask;
+	const PixelMask* secondMask = second->pixelMask;
+	if (firstMask == nullptr && secondMask == nullptr)
+	{
+		return true;
+	}
+
+	int offsetX = static_cast<int>(std::floor(second->x - first->x));
+	int offsetY = static_cast<int>(std::floor(second->y - first->y));
+	if (firstMask != nullptr && secondMask != nullptr)
+	{
+		return firstMask->Overlaps(*secondMask, offsetX, offsetY);
+	}
+
+	if (firstMask != nullptr)
+	{
+		return firstMask->OverlapsRect(offsetX, offsetY, second->GetWidth(), second->GetHeight());
+	}
+	return secondMask->OverlapsRect(-offsetX, -offsetY, first->GetWidth(), first->GetHeight());
+}
+
+bool CollisionGrid::IsFirstSharedCell(uint32_t first, uint32_t second, int x, int y) const
+{
+	const CellRange& a = objectCells[first];
+	const CellRange& b = objectCells[second];
+	int x0 = std::max(a.x0, b.x0);
+	int y0 = std::max(a.y0, b.y0);
+	if (objects[first]->IsMaskFull() && objects[second]->IsMaskFull())
+	{
+		return x == x0 && y == y0;
+	}
+
+	int x1 = std::min(a.x1, b.x1);
+	int y1 = std::min(a.y1, b.y1);
+	for (int cy = y0; cy < y1; cy++)
+	{
+		for (int cx = x0; cx < x1; cx++)
+		{
+			if (objects[first]->IsMaskSet(cx - a.x0, cy - a.y0) && objects[second]->IsMaskSet(cx - b.x0, cy - b.y0))
+			{
+				return cx == x && cy == y;
+			}
+		}
+	}
+
+	return false;
+}
+
+void CollisionGrid::SetThreadPool(EngineRoutines::ThreadPool* pool)
+{
+	threadPool = pool;
+}
+
+void CollisionGrid::SetTypesCollide(int first_type, int second_type, bool collide)
+{
+	SDL_assert_release(first_type >= 0 && second_type >= 0);
+
+	size_t needed = static_cast<size_t>(std::max(first_type, second_type)) + 1;
+	if (needed > typeFilterSize)
+	{
+		std::vector<uint8_t> grown(needed * needed, 1);
+		for (size_t a = 0; a < typeFilterSize; a++)
+		{
+			for (size_t b = 0; b < typeFilterSize; b++)
+			{
+				grown[a * needed + b] = typeFilter[a * typeFilterSize + b];
+			}
+		}
+		typeFilter.swap(grown);
+		typeFilterSize = needed;
+	}
+
+	typeFilter[first_type * typeFilterSize + second_type] = collide ? 1 : 0;
+	typeFilter[second_type * typeFilterSize + first_type] = collide ? 1 : 0;
+}
+
+bool CollisionGrid::TypesCollide(int first_type, int second_type) const
+{
+	if (first_type < 0 || second_type < 0 ||
+		static_cast<size_t>(first_type) >= typeFilterSize || static_cast<size_t>(second_type) >= typeFilterSize)
+	{
+		return true;
+	}
+	return typeFilter[first_type * typeFilterSize + second_type] != 0;
+}
+
+const CollisionLayerStats& CollisionGrid::GetLayerStats(int layer) const
+{
+	SDL_assert_release(layer >= 0 && layer < COLLISION_LAYER_AMOUNT);
+	return layerStats[layer];
+}
+
+void CollisionGrid::ResetLayerStats()
+{
+	for (int i = 0; i < COLLISION_LAYER_AMOUNT; i++)
+	{
+		layerStats[i].tested = 0;
+		layerStats[i].accepted = 0;
+	}
+}
+
+bool CollisionGrid::PairAllowed(const Collideable* first, const Collideable* second) const
+{
+	return (first->layers & second->collidesWith) != 0 &&
+		   (second->layers & first->collidesWith) != 0 &&
+		   TypesCollide(first->type, second->type);
+}
+
+bool CollisionGrid::FilterPair(const Collideable* first, const Collideable* second, CollisionLayerStats* stats) const
+{
+	bool accepted = PairAllowed(first, second);
+
+	uint32_t bits = first->layers | second->layers;
+	for (int layer = 0; bits != 0; layer++, bits >>= 1)
+	{
+		if ((bits & 1) != 0)
+		{
+			stats[layer].tested++;
+			if (accepted)
+			{
+				stats[layer].accepted++;
+			}
+		}
 	}
+
+	return accepted;
+}
+
+void CollisionGrid::GeneratePairsInChunks(size_t item_amount, const PairJob& job, std::vector<uint64_t>* result)
+{
+	result->clear();
+
+	// small batches aren't worth waking the workers up
+	static const size_t MIN_CHUNK_SIZE = 256;
+	if (threadPool == nullptr || item_amount < MIN_CHUNK_SIZE * 2)
+	{
+		job(0, item_amount, result, layerStats);
+		return;
+	}
+
+	// a few chunks per thread so uneven cells even out
+	size_t chunkAmount = std::min(threadPool->GetThreadAmount() * 4, item_amount / MIN_CHUNK_SIZE);
+	size_t chunkSize = (item_amount + chunkAmount - 1) / chunkAmount;
+	if (chunks.size() < chunkAmount)
+	{
+		chunks.resize(chunkAmount);
+	}
+
+	threadPool->ParallelFor(chunkAmount, [&](size_t chunk)
+	{
+		PairChunk& current = chunks[chunk];
+		current.pairs.clear();
+		for (int i = 0; i < COLLISION_LAYER_AMOUNT; i++)
+		{
+			current.stats[i].tested = 0;
+			current.stats[i].accepted = 0;
+		}
+
+		size_t begin = chunk * chunkSize;
+		size_t end = std::min(begin + chunkSize, item_amount);
+		if (begin < end)
+		{
+			job(begin, end, &current.pairs, current.stats);
+		}
+	});
+
+	size_t total = 0;
+	for (size_t i = 0; i < chunkAmount; i++)
+	{
+		total += chunks[i].pairs.size();
+	}
+	result->reserve(total);
+	for (size_t i = 0; i < chunkAmount; i++)
+	{
+		result->insert(result->end(), chunks[i].pairs.begin(), chunks[i].pairs.end());
+		for (int layer = 0; layer < COLLISION_LAYER_AMOUNT; layer++)
+		{
+			layerStats[layer].tested += chunks[i].stats[layer].tested;
+			layerStats[layer].accepted += chunks[i].stats[layer].accepted;
+		}
+	}
+}
+
+void CollisionGrid::UpdateGrid()
+{
+	BuildCells();
 }
 
 bool CollisionGrid::Move(Collideable* obj, double x, double y)
 {
+	double dx = x - obj->GetX();
+	double dy = y - obj->GetY();
+
+	// a discrete check is enough as long as the object can't skip a whole square
+	SweepHit hit;
+	bool hitSomething = (std::abs(dx) > squareWidth || std::abs(dy) > squareHeight) && Sweep(obj, dx, dy, &hit);
+	if (hitSomething)
+	{
+		x = obj->GetX() + dx * hit.time;
+		y = obj->GetY() + dy * hit.time;
+	}
+
 	bool collidesWithBoundary = CollidesWithBoundary(obj, x, y);
 
 	if (collidesWithBoundary == false)
 	{
 		obj->SetCoords(x, y);
+		if (hitSomething && obj->ShouldBeDeleted() == false && hit.target->ShouldBeDeleted() == false)
+		{
+			if (eventMode)
+			{
+				AddEvent(CollisionEventType::SWEEP, obj, hit.target);
+			}
+			else
+			{
+				obj->Collide(hit.target);
+				hit.target->Collide(obj);
+			}
+		}
 		return true;
 	}
 
@@ -180,8 +691,166 @@ bool CollisionGrid::Move(Collideable* obj, double x, double y)
 	return false;
 }
 
+bool CollisionGrid::GetTimeOfImpact(const Collideable* obj, double dx, double dy, const Collideable* target, double* time)
+{
+	const double objMin[2] = { obj->GetX(), obj->GetY() };
+	const double objMax[2] = { obj->GetX() + obj->GetWidth(), obj->GetY() + obj->GetHeight() };
+	const double targetMin[2] = { target->GetX(), target->GetY() };
+	const double targetMax[2] = { target->GetX() + target->GetWidth(), target->GetY() + target->GetHeight() };
+	const double displacement[2] = { dx, dy };
+
+	if (objMin[0] < targetMax[0] && targetMin[0] < objMax[0] && objMin[1] < targetMax[1] && targetMin[1] < objMax[1])
+	{
+		// already overlapping, that's for the discrete check
+		return false;
+	}
+
+	double entry = 0.0;
+	double exit = 1.0;
+	for (int axis = 0; axis < 2; axis++)
+	{
+		double d = displacement[axis];
+		if (d == 0.0)
+		{
+			if (objMin[axis] >= targetMax[axis] || targetMin[axis] >= objMax[axis])
+			{
+				return false;
+			}
+			continue;
+		}
+
+		double axisEntry = ((d > 0.0) ? targetMin[axis] - objMax[axis] : targetMax[axis] - objMin[axis]) / d;
+		double axisExit = ((d > 0.0) ? targetMax[axis] - objMin[axis] : targetMin[axis] - objMax[axis]) / d;
+		entry = std::max(entry, axisEntry);
+		exit = std::min(exit, axisExit);
+		if (entry >= exit)
+		{
+			return false;
+		}
+	}
+
+	*time = entry;
+	return true;
+}
+
+void CollisionGrid::ConsiderSweepCandidate(Collideable* obj, double dx, double dy, uint32_t index, SweepHit* best, uint32_t* best_index) const
+{
+	Collideable* target = objects[index];
+	double time;
+	if (target == obj || target->ShouldBeDeleted() || PairAllowed(obj, target) == false ||
+		GetTimeOfImpact(obj, dx, dy, target, &time) == false)
+	{
+		return;
+	}
+
+	// ties go to the lower index, so the result doesn't depend on the traversal order
+	if (best->target == nullptr || time < best->time || (time == best->time && index < *best_index))
+	{
+		best->target = target;
+		best->time = time;
+		*best_index = index;
+	}
+}
+
+bool CollisionGrid::Sweep(Collideable* obj, double dx, double dy, SweepHit* hit)
+{
+	if (cellsValid == false)
+	{
+		BuildCells();
+	}
+
+	SweepHit best = { nullptr, 1.0 };
+	uint32_t bestIndex = 0;
+
+	// walk the squares under the center of the object (Amanatides-Woo), and look at every square the object and
+	// its targets can reach from there: half of its size plus one square, since targets stick out of their squares
+	double sw = static_cast<double>(squareWidth);
+	double sh = static_cast<double>(squareHeight);
+	double cx = obj->GetX() + obj->GetWidth() * 0.5 - leftBorder;
+	double cy = obj->GetY() + obj->GetHeight() * 0.5 - topBorder;
+	int reachX = static_cast<int>(std::ceil(obj->GetWidth() * 0.5 / sw)) + 1;
+	int reachY = static_cast<int>(std::ceil(obj->GetHeight() * 0.5 / sh)) + 1;
+
+	int gx = static_cast<int>(std::floor(cx / sw));
+	int gy = static_cast<int>(std::floor(cy / sh));
+	int stepX = (dx > 0.0) ? 1 : ((dx < 0.0) ? -1 : 0);
+	int stepY = (dy > 0.0) ? 1 : ((dy < 0.0) ? -1 : 0);
+	double infinity = std::numeric_limits<double>::infinity();
+	double nextX = (stepX > 0) ? ((gx + 1) * sw - cx) / dx : ((stepX < 0) ? (gx * sw - cx) / dx : infinity);
+	double nextY = (stepY > 0) ? ((gy + 1) * sh - cy) / dy : ((stepY < 0) ? (gy * sh - cy) / dy : infinity);
+	double deltaX = (stepX != 0) ? sw / std::abs(dx) : infinity;
+	double deltaY = (stepY != 0) ? sh / std::abs(dy) : infinity;
+	double entered = 0.0;
+
+	NextQuery();
+	while (entered <= 1.0)
+	{
+		// a contact at time t is found from the square holding the center at t, nothing later can beat it
+		if (best.target != nullptr && best.time < entered)
+		{
+			break;
+		}
+
+		int x0 = std::max(gx - reachX, 0);
+		int y0 = std::max(gy - reachY, 0);
+		int x1 = std::min(gx + reachX + 1, static_cast<int>(wSquares));
+		int y1 = std::min(gy + reachY + 1, static_cast<int>(hSquares));
+		for (int y = y0; y < y1; y++)
+		{
+			for (int x = x0; x < x1; x++)
+			{
+				size_t cell = CellIndex(x, y);
+				if (cellStamps[cell] != generation)
+				{
+					continue;
+				}
+
+				const uint32_t* run = cellEntries.data() + cellStart[cell];
+				for (uint32_t i = 0; i < cellCount[cell]; i++)
+				{
+					uint32_t index = run[i];
+					if (queryStamps[index] != queryGeneration)
+					{
+						queryStamps[index] = queryGeneration;
+						ConsiderSweepCandidate(obj, dx, dy, index, &best, &bestIndex);
+					}
+				}
+			}
+		}
+
+		if (nextX < nextY)
+		{
+			entered = nextX;
+			nextX += deltaX;
+			gx += stepX;
+		}
+		else
+		{
+			entered = nextY;
+			nextY += deltaY;
+			gy += stepY;
+		}
+	}
+
+	if (best.target == nullptr)
+	{
+		return false;
+	}
+
+	if (hit != nullptr)
+	{
+		*hit = best;
+	}
+	return true;
+}
+
 bool CollisionGrid::CollidesWithBoundary(Collideable* obj, double nx, double ny)
 {
+	if (unbounded)
+	{
+		return false;
+	}
+
 	return (nx + obj->GetWidth() < wPixels &&
 		    ny + obj->GetHeight() < hPixels &&
 		    nx >= leftBorder &&
@@ -193,99 +862,377 @@ bool CollisionGrid::Check(Collideable* obj, double nx, double ny)
 	return CollidesWithBoundary(obj, nx, ny);
 }
 
-void CollisionGrid::AddObject(Collideable* new_obj)
+CollideableHandle CollisionGrid::AddObject(Collideable* new_obj)
 {
+	uint32_t slot;
+	if (freeSlots.empty())
+	{
+		slot = static_cast<uint32_t>(slotObjects.size());
+		slotObjects.push_back(nullptr);
+		slotGenerations.push_back(0);
+	}
+	else
+	{
+		slot = freeSlots.back();
+		freeSlots.pop_back();
+	}
+	slotObjects[slot] = new_obj;
+
+	new_obj->owner = this;
+	new_obj->slot = slot;
+	new_obj->objectIndex = static_cast<uint32_t>(objects.size());
 	objects.push_back(new_obj);
+	cellsValid = false;
+
+	CollideableHandle handle = { slot, slotGenerations[slot] };
+	return handle;
 }
 
-std::vector<Collideable*>* CollisionGrid::GetObjects()
+Collideable* CollisionGrid::GetObjectByHandle(CollideableHandle handle) const
 {
-	return &objects;
+	if (handle.slot < slotObjects.size() && slotGenerations[handle.slot] == handle.generation)
+	{
+		return slotObjects[handle.slot];
+	}
+	return nullptr;
 }
 
-void CollisionGrid::CheckCollissions(bool do_cleanup)
+CollideableHandle CollisionGrid::GetHandle(const Collideable* obj) const
+{
+	SDL_assert_release(obj->owner == this);
+	CollideableHandle handle = { obj->slot, slotGenerations[obj->slot] };
+	return handle;
+}
+
+void CollisionGrid::ReleaseObject(Collideable* obj)
+{
+	OnObjectRemoved(obj);
+	slotObjects[obj->slot] = nullptr;
+	slotGenerations[obj->slot]++;
+	freeSlots.push_back(obj->slot);
+	delete obj;
+	cellsValid = false;
+}
+
+void CollisionGrid::RemoveObject(CollideableHandle handle)
+{
+	Collideable* obj = GetObjectByHandle(handle);
+	if (obj == nullptr)
+	{
+		return;
+	}
+
+	if (checking)
+	{
+		// pair indices are in use, keep the object array as it is until the cleanup
+		obj->DeleteOnNextCheck();
+		return;
+	}
+
+	if (eventMode)
+	{
+		ClearEventObjects(obj->slot);
+	}
+
+	// swap and pop
+	uint32_t index = obj->objectIndex;
+	objects[index] = objects.back();
+	objects[index]->objectIndex = index;
+	objects.pop_back();
+	ReleaseObject(obj);
+}
+
+void CollisionGrid::RemoveObjectsIf(const std::function<bool(Collideable*)>& predicate)
 {
-	size_t i = 0;
-	while (i < objects.size())
+	size_t kept = 0;
+	bool removed = false;
+	// size is read every time, the callbacks may add objects
+	for (size_t i = 0; i < objects.size(); i++)
 	{
-		bool collideWithBoundary = CollidesWithBoundary(objects[i], objects[i]->GetX(), objects[i]->GetY());
-		if (collideWithBoundary)
+		Collideable* obj = objects[i];
+		if (predicate(obj))
 		{
-			if (objects[i]->CollideWithBoundary())
-			{
-				delete objects[i];
-				objects.erase(objects.begin() + i);
-				continue;
-			}
+			ReleaseObject(obj);
+			removed = true;
+		}
+		else
+		{
+			obj->objectIndex = static_cast<uint32_t>(kept);
+			objects[kept++] = obj;
 		}
-
-		i++;
 	}
+	objects.resize(kept);
 
-	for (i = 0; i < wSquares; i++)
+	// once for the whole batch; this also covers sweep events queued by Move, which the next check publishes
+	if (removed && eventMode)
 	{
-		memset(objMap[i], 0, sizeof(Collideable*) * hSquares);
+		RefreshEventObjects();
 	}
+}
 
-	i = 0;
-	while (i < objects.size())
+std::vector<Collideable*>* CollisionGrid::GetObjects()
+{
+	return &objects;
+}
+
+void CollisionGrid::CheckBoundaries()
+{
+	RemoveObjectsIf([this](Collideable* obj)
+	{
+		return CollidesWithBoundary(obj, obj->GetX(), obj->GetY()) && obj->CollideWithBoundary();
+	});
+}
+
+void CollisionGrid::GeneratePairs(std::vector<uint64_t>* result)
+{
+	BuildCells();
+
+	GeneratePairsInChunks(occupiedCells.size(), [this](size_t begin, size_t end, std::vector<uint64_t>* out, CollisionLayerStats* stats)
 	{
-		bool** gridMap = objects[i]->GetGrid();
-		size_t objW = objects[i]->GetGridW();
-		size_t objH = objects[i]->GetGridH();
-		int initialX = std::max((static_cast<int>(objects[i]->GetX()) - leftBorder) / static_cast<int>(squareWidth), 0);
-		for (int x = initialX; x < std::min(initialX + static_cast<int>(objW), static_cast<int>(wSquares) - 1); x++)
+		for (size_t c = begin; c < end; c++)
 		{
-			int initialY = std::max((static_cast<int>(objects[i]->GetY()) - topBorder) / static_cast<int>(squareHeight), 0);
-			for (int y = initialY; y < std::min(initialY + static_cast<int>(objH), static_cast<int>(hSquares) - 1); y++)
+			uint32_t cell = occupiedCells[c];
+			const uint32_t* run = cellEntries.data() + cellStart[cell];
+			uint32_t amount = cellCount[cell];
+			int x = static_cast<int>(cell % wSquares);
+			int y = static_cast<int>(cell / wSquares);
+			for (uint32_t i = 0; i < amount; i++)
 			{
-				if (gridMap[x - initialX][y - initialY])
+				uint64_t first = static_cast<uint64_t>(run[i]) << 32;
+				for (uint32_t j = i + 1; j < amount; j++)
 				{
-					if (objMap[x][y] == nullptr)
-					{
-						objMap[x][y] = objects[i];
-					}
-					else
+					// objects sharing several cells would otherwise report the same pair several times
+					if (IsFirstSharedCell(run[i], run[j], x, y) && FilterPair(objects[run[i]], objects[run[j]], stats) &&
+						PixelsOverlap(objects[run[i]], objects[run[j]]))
 					{
-						if (objects[i]->ShouldBeDeleted() == false && objMap[x][y]->ShouldBeDeleted() == false)
-						{
-							objects[i]->Collide(objMap[x][y]);
-							objMap[x][y]->Collide(objects[i]);
-						}
+						out->push_back(first | run[j]);
 					}
 				}
 			}
 		}
-		i++;
+	}, result);
+}
+
+void CollisionGrid::SetEventMode(bool enabled)
+{
+	eventMode = enabled;
+	contacts.clear();
+	events.clear();
+	sweepEvents.clear();
+	eventRefsValid = false;
+}
+
+bool CollisionGrid::IsInEventMode() const
+{
+	return eventMode;
+}
+
+const std::vector<CollisionEvent>& CollisionGrid::GetEvents() const
+{
+	return events;
+}
+
+void CollisionGrid::AddEvent(CollisionEventType type, Collideable* first, Collideable* second)
+{
+	CollisionEvent event = { type, GetHandle(first), GetHandle(second), first, second };
+	bool sweep = type == CollisionEventType::SWEEP;
+	std::vector<CollisionEvent>& target = sweep ? sweepEvents : events;
+	target.push_back(event);
+	if (eventRefsValid)
+	{
+		AddEventRefs(static_cast<uint32_t>(target.size() - 1), sweep);
+	}
+}
+
+void CollisionGrid::RefreshEventObjects()
+{
+	for (auto& event : events)
+	{
+		event.firstObj = GetObjectByHandle(event.first);
+		event.secondObj = GetObjectByHandle(event.second);
 	}
-	
+	for (auto& event : sweepEvents)
+	{
+		event.firstObj = GetObjectByHandle(event.first);
+		event.secondObj = GetObjectByHandle(event.second);
+	}
+}
+
+void CollisionGrid::BuildEventRefs()
+{
+	eventRefHeads.assign(slotObjects.size(), INVALID_EVENT_REF);
+	eventRefs.clear();
+	for (size_t i = 0; i < events.size(); i++)
+	{
+		AddEventRefs(static_cast<uint32_t>(i), false);
+	}
+	for (size_t i = 0; i < sweepEvents.size(); i++)
+	{
+		AddEventRefs(static_cast<uint32_t>(i), true);
+	}
+	eventRefsValid = true;
+}
+
+void CollisionGrid::AddEventRefs(uint32_t position, bool sweep)
+{
+	const CollisionEvent& event = sweep ? sweepEvents[position] : events[position];
+	const uint32_t slots[2] = { event.first.slot, event.second.slot };
+	for (uint32_t side = 0; side < 2; side++)
+	{
+		uint32_t slot = slots[side];
+		if (slot >= eventRefHeads.size())
+		{
+			eventRefHeads.resize(slot + 1, INVALID_EVENT_REF);
+		}
+
+		EventRef ref = { (position << 2) | (sweep ? 2u : 0u) | side, eventRefHeads[slot] };
+		eventRefHeads[slot] = static_cast<uint32_t>(eventRefs.size());
+		eventRefs.push_back(ref);
+	}
+}
+
+void CollisionGrid::ClearEventObjects(uint32_t slot)
+{
+	if (eventRefsValid == false)
+	{
+		BuildEventRefs();
+	}
+
+	if (slot >= eventRefHeads.size())
+	{
+		return;
+	}
+
+	// events naming an older object in the slot already hold nullptr, so the whole list can be cleared
+	for (uint32_t i = eventRefHeads[slot]; i != INVALID_EVENT_REF; i = eventRefs[i].next)
+	{
+		uint32_t ref = eventRefs[i].ref;
+		CollisionEvent& event = ((ref & 2) != 0) ? sweepEvents[ref >> 2] : events[ref >> 2];
+		if ((ref & 1) != 0)
+		{
+			event.secondObj = nullptr;
+		}
+		else
+		{
+			event.firstObj = nullptr;
+		}
+	}
+}
+
+void CollisionGrid::UpdateContacts(const std::vector<uint64_t>& candidates)
+{
+	contactFrame++;
+	events.clear();
+	events.swap(sweepEvents);
+	eventRefsValid = false;
+
+	for (auto pair : candidates)
+	{
+		Collideable* first = objects[static_cast<size_t>(pair >> 32)];
+		Collideable* second = objects[static_cast<size_t>(pair & 0xFFFFFFFF)];
+		if (first->ShouldBeDeleted() || second->ShouldBeDeleted())
+		{
+			continue;
+		}
+
+		// slots don't move with the object array, so the key stays the same between checks
+		if (first->slot > second->slot)
+		{
+			std::swap(first, second);
+		}
+		uint64_t key = (static_cast<uint64_t>(first->slot) << 32) | second->slot;
+		uint32_t firstGeneration = slotGenerations[first->slot];
+		uint32_t secondGeneration = slotGenerations[second->slot];
+
+		auto found = contacts.find(key);
+		if (found == contacts.end())
+		{
+			Contact contact = { firstGeneration, secondGeneration, contactFrame };
+			contacts.emplace(key, contact);
+			AddEvent(CollisionEventType::ENTER, first, second);
+			continue;
+		}
+
+		Contact& contact = found->second;
+		if (contact.firstGeneration != firstGeneration || contact.secondGeneration != secondGeneration)
+		{
+			// a slot was reused, the old pair is gone
+			CollisionEvent exit = { CollisionEventType::EXIT, { first->slot, contact.firstGeneration }, { second->slot, contact.secondGeneration }, nullptr, nullptr };
+			events.push_back(exit);
+			contact.firstGeneration = firstGeneration;
+			contact.secondGeneration = secondGeneration;
+			contact.frame = contactFrame;
+			AddEvent(CollisionEventType::ENTER, first, second);
+			continue;
+		}
+
+		contact.frame = contactFrame;
+		AddEvent(CollisionEventType::STAY, first, second);
+	}
+
+	// pairs not seen during this check have ended; sorted so the order doesn't depend on the hash table
+	endedContacts.clear();
+	for (auto& contact : contacts)
+	{
+		if (contact.second.frame != contactFrame)
+		{
+			endedContacts.push_back(contact.first);
+		}
+	}
+	std::sort(endedContacts.begin(), endedContacts.end());
+
+	for (auto key : endedContacts)
+	{
+		const Contact& contact = contacts[key];
+		CollideableHandle first = { static_cast<uint32_t>(key >> 32), contact.firstGeneration };
+		CollideableHandle second = { static_cast<uint32_t>(key & 0xFFFFFFFF), contact.secondGeneration };
+		CollisionEvent exit = { CollisionEventType::EXIT, first, second, GetObjectByHandle(first), GetObjectByHandle(second) };
+		events.push_back(exit);
+		contacts.erase(key);
+	}
+}
+
+void CollisionGrid::ProcessPairs(const std::vector<uint64_t>& candidates)
+{
+	if (eventMode)
+	{
+		UpdateContacts(candidates);
+		return;
+	}
+
+	for (auto pair : candidates)
+	{
+		Collideable* first = objects[static_cast<size_t>(pair >> 32)];
+		Collideable* second = objects[static_cast<size_t>(pair & 0xFFFFFFFF)];
+		if (first->ShouldBeDeleted() == false && second->ShouldBeDeleted() == false)
+		{
+			first->Collide(second);
+			second->Collide(first);
+		}
+	}
+}
+
+void CollisionGrid::CheckCollissions(bool do_cleanup)
+{
+	checking = true;
+	ResetLayerStats();
+	CheckBoundaries();
+	GeneratePairs(&pairs);
+	ProcessPairs(pairs);
+	checking = false;
+
     if (do_cleanup)
     {
         Cleanup();
     }
-	//for (int i = 0; i < objects.size())
 }
 
 void CollisionGrid::Cleanup()
 {
-    size_t i = 0;
-    while (i < objects.size())
+    RemoveObjectsIf([](Collideable* obj)
     {
-        if (objects[i]->ShouldBeDeleted())
-        {
-            delete objects[i];
-            objects.erase(objects.begin() + i);
-        }
-        else
-        {
-            i++;
-        }
-    }
-
-	for (i = 0; i < wSquares; i++)
-	{
-		memset(objMap[i], 0, sizeof(Collideable*) * hSquares);
-	}
+        return obj->ShouldBeDeleted();
+    });
 }
 
 int CollisionGrid::GetTopBorder() const
@@ -305,7 +1252,7 @@ Collideable* CollisionGrid::GetObjectFromCoordinates(int x, int y)
     if (gridX >= 0 && gridX < static_cast<int>(wSquares) && 
         gridY >= 0 && gridY < static_cast<int>(hSquares))
     {
-        return objMap[gridX][gridY];
+        return GetObjectFromGridCoordinates(gridX, gridY);
     }
 
     return nullptr;
@@ -313,16 +1260,150 @@ Collideable* CollisionGrid::GetObjectFromCoordinates(int x, int y)
 
 Collideable* CollisionGrid::GetObjectFromGridCoordinates(int x, int y)
 {
+    if (cellsValid == false)
+    {
+        BuildCells();
+    }
 
     if (x >= 0 && x < static_cast<int>(wSquares) &&
         y >= 0 && y < static_cast<int>(hSquares))
     {
-        return objMap[x][y];
+        size_t cell = CellIndex(x, y);
+        if (cellStamps[cell] == generation && cellCount[cell] > 0)
+        {
+            return objects[cellEntries[cellStart[cell]]];
+        }
     }
 
     return nullptr;
 }
 
+void CollisionGrid::GetObjectsFromCoordinates(int x, int y, std::vector<Collideable*>* result)
+{
+    QueryRect(x, y, 1, 1, result);
+}
+
+void CollisionGrid::QueryRect(int x, int y, int w, int h, std::vector<Collideable*>* result)
+{
+    result->clear();
+    if (cellsValid == false)
+    {
+        BuildCells();
+    }
+
+    int x0 = std::max((x - leftBorder) / static_cast<int>(squareWidth), 0);
+    int y0 = std::max((y - topBorder) / static_cast<int>(squareHeight), 0);
+    int x1 = std::min((x + w - 1 - leftBorder) / static_cast<int>(squareWidth) + 1, static_cast<int>(wSquares));
+    int y1 = std::min((y + h - 1 - topBorder) / static_cast<int>(squareHeight) + 1, static_cast<int>(hSquares));
+
+    NextQuery();
+    for (int gy = y0; gy < y1; gy++)
+    {
+        for (int gx = x0; gx < x1; gx++)
+        {
+            size_t cell = CellIndex(gx, gy);
+            if (cellStamps[cell] != generation)
+            {
+                continue;
+            }
+
+            const uint32_t* run = cellEntries.data() + cellStart[cell];
+            for (uint32_t i = 0; i < cellCount[cell]; i++)
+            {
+                uint32_t index = run[i];
+                if (queryStamps[index] == queryGeneration)
+                {
+                    continue;
+                }
+                queryStamps[index] = queryGeneration;
+
+                Collideable* obj = objects[index];
+                if (obj->GetX() < x + w && obj->GetX() + obj->GetWidth() > x &&
+                    obj->GetY() < y + h && obj->GetY() + obj->GetHeight() > y)
+                {
+                    result->push_back(obj);
+                }
+            }
+        }
+    }
+}
+
+Collideable* CollisionGrid::GetNearestObject(double x, double y, double max_distance)
+{
+    if (cellsValid == false)
+    {
+        BuildCells();
+    }
+
+    int cx = static_cast<int>(std::floor((x - leftBorder) / squareWidth));
+    int cy = static_cast<int>(std::floor((y - topBorder) / squareHeight));
+    int maxRing = std::max(std::max(std::abs(cx), std::abs(cx - static_cast<int>(wSquares))),
+                           std::max(std::abs(cy), std::abs(cy - static_cast<int>(hSquares))));
+    double side = static_cast<double>(std::min(squareWidth, squareHeight));
+
+    Collideable* nearest = nullptr;
+    double best = max_distance;
+
+    NextQuery();
+    for (int ring = 0; ring <= maxRing; ring++)
+    {
+        for (int gy = cy - ring; gy <= cy + ring; gy++)
+        {
+            if (gy < 0 || gy >= static_cast<int>(hSquares))
+            {
+                continue;
+            }
+
+            // inner rows of the ring only have their two edge cells
+            bool edgeRow = (gy == cy - ring || gy == cy + ring);
+            int step = edgeRow ? 1 : std::max(ring * 2, 1);
+            for (int gx = cx - ring; gx <= cx + ring; gx += step)
+            {
+                if (gx < 0 || gx >= static_cast<int>(wSquares))
+                {
+                    continue;
+                }
+
+                size_t cell = CellIndex(gx, gy);
+                if (cellStamps[cell] != generation)
+                {
+                    continue;
+                }
+
+                const uint32_t* run = cellEntries.data() + cellStart[cell];
+                for (uint32_t i = 0; i < cellCount[cell]; i++)
+                {
+                    uint32_t index = run[i];
+                    if (queryStamps[index] == queryGeneration)
+                    {
+                        continue;
+                    }
+                    queryStamps[index] = queryGeneration;
+
+                    Collideable* obj = objects[index];
+                    double dx = std::max(std::max(obj->GetX() - x, x - (obj->GetX() + obj->GetWidth())), 0.0);
+                    double dy = std::max(std::max(obj->GetY() - y, y - (obj->GetY() + obj->GetHeight())), 0.0);
+                    double distance = std::sqrt(dx * dx + dy * dy);
+                    if (distance <= best)
+                    {
+                        best = distance;
+                        nearest = obj;
+                    }
+                }
+            }
+        }
+
+        // cells in the next ring are at least ring * side away, objects may stick out of their
+        // registered squares by less than one square since masks start at the object origin
+        if ((ring - 1) * side > best)
+        {
+            break;
+        }
+    }
+
+    return nearest;
+}
+
 void CollisionGrid::GetGridCoordinates(int mousex, int mousey, int* x, int *y)
 {
     if (x == nullptr || y == nullptr)
@@ -330,6 +1411,13 @@ void CollisionGrid::GetGridCoordinates(int mousex, int mousey, int* x, int *y)
         return;
     }
 
+    if (unbounded)
+    {
+        *x = static_cast<int>(std::floor(static_cast<double>(mousex) / squareWidth));
+        *y = static_cast<int>(std::floor(static_cast<double>(mousey) / squareHeight));
+        return;
+    }
+
     *x = (mousex - leftBorder) / squareWidth;
     *y = (mousey - topBorder) / squareHeight;
 }
\ No newline at end of file
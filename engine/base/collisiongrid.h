@@ -26,8 +26,59 @@ OTHER DEALINGS IN THE SOFTWARE.
 #define __COLLISIONGRID_H__
 
 #include <vector>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include "pixelmask.h"
+
+namespace EngineRoutines
+{
+    class ThreadPool;
+}
 
 class CollisionGrid;
+class Collideable;
+
+static const int COLLISION_LAYER_AMOUNT = 32;
+
+// pairs of overlapping objects that reached the filter, per layer of either object
+struct CollisionLayerStats
+{
+	uint64_t tested;
+	uint64_t accepted;
+};
+
+// first contact found by CollisionGrid::Sweep, time is the fraction of the displacement (0..1)
+struct SweepHit
+{
+	Collideable* target;
+	double time;
+};
+
+// stays valid while the object lives, a removed object's handle never resolves to a new object
+struct CollideableHandle
+{
+	uint32_t slot;
+	uint32_t generation;
+};
+
+enum class CollisionEventType
+{
+	ENTER, // started to overlap during this check
+	STAY,  // overlapped during the previous check as well
+	EXIT,  // stopped overlapping, or one of the objects was removed
+	SWEEP  // contact found by Move between checks, reported once
+};
+
+// objects are resolved when the event is emitted, a removed object is nullptr
+struct CollisionEvent
+{
+	CollisionEventType type;
+	CollideableHandle first;
+	CollideableHandle second;
+	Collideable* firstObj;
+	Collideable* secondObj;
+};
 
 class Collideable
 {
@@ -40,18 +91,36 @@ protected:
 
 	int type;
 
-	bool** CollisionGrid; // for non-square objects, to know which squares should be checked and which should not
+	// for non-square objects, to know which squares should be checked and which should not
+	// one bit per square, stored row by row
+	std::vector<uint32_t> collisionMask;
+	bool fullMask;
 
 	size_t GridW;
 	size_t GridH;
 
 	bool needsToBeDeleted;
 
+	// optional per pixel shape, its origin is at the object position; not owned
+	const PixelMask* pixelMask;
+
+	// layer bits the object is on, and the layers it collides with; both sides have to agree
+	uint32_t layers;
+	uint32_t collidesWith;
+
+	// grid the object was added to, its slot and position there, and its broadphase specific slot
+	CollisionGrid* owner;
+	uint32_t slot;
+	uint32_t objectIndex;
+	uint32_t proxyId;
+	friend class CollisionGrid;
+
 public:
+	// CollisionGrid is indexed as [x][y] and is copied, the caller keeps ownership; nullptr means every square is solid
 	Collideable(double x, double y, int width, int height, int type, bool** CollisionGrid, size_t grid_tile_size);
 	virtual bool Collide(Collideable* target); // return true if object needs to be destroyed
 	virtual bool CollideWithBoundary(); // return true if object needs to be destroyed
-	~Collideable();
+	virtual ~Collideable();
 
 	int GetType() const;
 	
@@ -64,12 +133,23 @@ public:
 	void SetCoords(double x, double y);
 	void Move(double dx, double dy);
 
-	bool** GetGrid() const;
+	bool IsMaskSet(size_t x, size_t y) const;
+	void SetMask(size_t x, size_t y, bool value);
+	bool IsMaskFull() const;
 	size_t GetGridW() const;
 	size_t GetGridH() const;
 
 	bool ShouldBeDeleted();
     void DeleteOnNextCheck();
+
+	// checked after the square masks, pass nullptr to collide by the box only
+	void SetPixelMask(const PixelMask* mask);
+	const PixelMask* GetPixelMask() const;
+
+	void SetLayers(uint32_t layers);
+	uint32_t GetLayers() const;
+	void SetCollidesWith(uint32_t layers);
+	uint32_t GetCollidesWith() const;
 };
 
 class CollisionGrid
@@ -82,16 +162,144 @@ protected:
 	int topBorder;
 	int leftBorder;
 
+	bool unbounded; // no borders and no cells, only for broadphases that don't need them
+
 	size_t wSquares;
 	size_t hSquares;
 
 	size_t squareWidth;
 	size_t squareHeight;
 
-	Collideable*** objMap;
+	// cells are stored row by row; every occupied cell owns the run [cellStart, cellStart + cellCount)
+	// of object indices in cellEntries, filled by a counting sort over the objects.
+	// a cell is occupied only if its stamp matches the current generation, so clearing is a counter increment
+	std::vector<uint32_t> cellStart;
+	std::vector<uint32_t> cellCount;
+	std::vector<uint32_t> cellStamps;
+	std::vector<uint32_t> occupiedCells;
+	std::vector<uint32_t> cellEntries;
+	uint32_t generation;
+	bool cellsValid; // cell lists were built from the current objects
+
+	// squares covered by every object, [x0, x1) x [y0, y1), filled by BuildCells
+	struct CellRange
+	{
+		int x0;
+		int y0;
+		int x1;
+		int y1;
+	};
+	std::vector<CellRange> objectCells;
+
+	// per object stamps to report every object once per query
+	std::vector<uint32_t> queryStamps;
+	uint32_t queryGeneration;
+
+	// candidate pairs of object indices packed as (first << 32 | second), first < second.
+	// every pair is reported once, by the first cell (row by row) both objects occupy
+	std::vector<uint64_t> pairs;
 
 	std::vector<Collideable*> objects;
 
+	// handle slots, generations are bumped on removal so old handles stop resolving
+	std::vector<Collideable*> slotObjects;
+	std::vector<uint32_t> slotGenerations;
+	std::vector<uint32_t> freeSlots;
+	bool checking; // inside CheckCollissions, removals are deferred to the cleanup
+
+	// optional, pair generation and mask tests run on it; Collide calls always stay on the calling thread
+	EngineRoutines::ThreadPool* threadPool;
+	struct PairChunk
+	{
+		std::vector<uint64_t> pairs;
+		CollisionLayerStats stats[COLLISION_LAYER_AMOUNT];
+	};
+	std::vector<PairChunk> chunks;
+
+	// which object types collide, square matrix of typeFilterSize; types outside of it always collide
+	std::vector<uint8_t> typeFilter;
+	size_t typeFilterSize;
+	CollisionLayerStats layerStats[COLLISION_LAYER_AMOUNT];
+
+	// event mode: instead of calling Collide, overlapping pairs are tracked between checks and reported as events
+	struct Contact
+	{
+		uint32_t firstGeneration;
+		uint32_t secondGeneration;
+		uint32_t frame; // last check the pair overlapped in
+	};
+	bool eventMode;
+	uint32_t contactFrame;
+	std::unordered_map<uint64_t, Contact> contacts; // keyed by both handle slots, lower one first
+	std::vector<uint64_t> endedContacts;
+	std::vector<CollisionEvent> events;
+	std::vector<CollisionEvent> sweepEvents; // collected by Move until the next check
+
+	// which events name an object, by handle slot, so a single removal doesn't rescan every event.
+	// built on the first removal after the events changed, then kept up to date by AddEvent
+	struct EventRef
+	{
+		uint32_t ref; // position << 2 | sweep event << 1 | second object
+		uint32_t next;
+	};
+	std::vector<uint32_t> eventRefHeads;
+	std::vector<EventRef> eventRefs;
+	bool eventRefsValid;
+
+	size_t CellIndex(size_t x, size_t y) const;
+	void ClearCells();
+	void BuildCells();
+	void NextQuery();
+	bool GetCellRange(const Collideable* obj, int* x0, int* y0, int* x1, int* y1) const;
+	bool IsFirstSharedCell(uint32_t first, uint32_t second, int x, int y) const;
+
+	// lets derived broadphases keep their own per-object data
+	static uint32_t GetProxyId(const Collideable* obj);
+	static void SetProxyId(Collideable* obj, uint32_t id);
+	static uint32_t GetObjectIndex(const Collideable* obj);
+	virtual void OnObjectRemoved(Collideable* obj);
+	virtual void OnObjectMoved(Collideable* obj);
+	friend class Collideable;
+
+	// true if both objects occupy at least one common square with their masks
+	bool SharesCell(uint32_t first, const CellRange& a, uint32_t second, const CellRange& b) const;
+	// pixel masks of both objects, or the mask of one against the box of the other; true if neither has one
+	static bool PixelsOverlap(const Collideable* first, const Collideable* second);
+
+	// layers and types, checked before any mask test or callback; FilterPair also counts the pair into stats.
+	// every broadphase calls FilterPair only for objects sharing a square, so the stats mean the same for all of them
+	bool PairAllowed(const Collideable* first, const Collideable* second) const;
+	bool FilterPair(const Collideable* first, const Collideable* second, CollisionLayerStats* stats) const;
+	void ResetLayerStats();
+
+	typedef std::function<void(size_t, size_t, std::vector<uint64_t>*, CollisionLayerStats*)> PairJob;
+	// splits [0, item_amount) into chunks for the thread pool, job(begin, end, out, stats) appends the pairs of its chunk;
+	// chunks are concatenated in order, so the result is the same for any amount of threads
+	void GeneratePairsInChunks(size_t item_amount, const PairJob& job, std::vector<uint64_t>* result);
+
+	// time at which obj moving by (dx, dy) starts to overlap target, objects overlapping from the start don't count
+	static bool GetTimeOfImpact(const Collideable* obj, double dx, double dy, const Collideable* target, double* time);
+	void ConsiderSweepCandidate(Collideable* obj, double dx, double dy, uint32_t index, SweepHit* best, uint32_t* best_index) const;
+
+	void ReleaseObject(Collideable* obj);
+	// removes every object the predicate returns true for in one pass, keeping the order of the rest
+	void RemoveObjectsIf(const std::function<bool(Collideable*)>& predicate);
+
+	void CheckBoundaries();
+	virtual void GeneratePairs(std::vector<uint64_t>* result);
+	void ProcessPairs(const std::vector<uint64_t>& candidates);
+	void UpdateContacts(const std::vector<uint64_t>& candidates);
+	void AddEvent(CollisionEventType type, Collideable* first, Collideable* second);
+	// clears the pointers of objects removed after their events were emitted
+	void RefreshEventObjects();
+	void BuildEventRefs();
+	void AddEventRefs(uint32_t position, bool sweep);
+	// clears the pointers to the object in the given slot, for removals one at a time
+	void ClearEventObjects(uint32_t slot);
+
+	// unbounded world, squares are only used for the masks
+	CollisionGrid(size_t square_w, size_t square_h);
+
 public:
 	CollisionGrid(int top_border, int left_border, int w_in_pixels, int h_in_pixels, size_t square_w, size_t square_h);
 
@@ -100,19 +308,45 @@ public:
 
 	std::vector<Collideable*>* GetObjects();
 
-	virtual void AddObject(Collideable* new_obj);
+	virtual CollideableHandle AddObject(Collideable* new_obj);
+	// deletes the object; inside CheckCollissions it is only marked and goes away with the cleanup
+	void RemoveObject(CollideableHandle handle);
+	Collideable* GetObjectByHandle(CollideableHandle handle) const;
+	CollideableHandle GetHandle(const Collideable* obj) const;
+
+	// nullptr to generate pairs on the calling thread only
+	void SetThreadPool(EngineRoutines::ThreadPool* pool);
+
+	void SetTypesCollide(int first_type, int second_type, bool collide);
+	bool TypesCollide(int first_type, int second_type) const;
+	// counted during the last CheckCollissions
+	const CollisionLayerStats& GetLayerStats(int layer) const;
+
+	// in event mode Collide is not called, the game reads the events of the last CheckCollissions instead
+	void SetEventMode(bool enabled);
+	bool IsInEventMode() const;
+	const std::vector<CollisionEvent>& GetEvents() const;
 
+	// moves longer than a square are swept, the object stops at the first contact and both sides get Collide
 	bool Move(Collideable* obj, double x, double y);
+	// first object hit by obj moving by (dx, dy), against object positions from the last check
+	virtual bool Sweep(Collideable* obj, double dx, double dy, SweepHit* hit);
 	bool Check(Collideable* obj, double nx, double ny);
 
 	bool CollidesWithBoundary(Collideable* obj, double nx, double ny);
     int GetTopBorder() const;
 
+    // queries use the object positions from the last CheckCollissions/UpdateGrid call
+    virtual void UpdateGrid();
     virtual Collideable* GetObjectFromCoordinates(int x, int y);
     virtual Collideable* GetObjectFromGridCoordinates(int x, int y);
+    virtual void GetObjectsFromCoordinates(int x, int y, std::vector<Collideable*>* result);
+    virtual void QueryRect(int x, int y, int w, int h, std::vector<Collideable*>* result);
+    // nearest object by distance to its bounding box, nullptr if nothing is closer than max_distance
+    virtual Collideable* GetNearestObject(double x, double y, double max_distance);
     virtual void GetGridCoordinates(int mousex, int mousey, int* x, int *y);
 
-	~CollisionGrid();
+	virtual ~CollisionGrid();
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,353 @@
+/*
+Author: Vladimir Slav
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "collisiontree.h"
+#include <algorithm>
+#include <cmath>
+
+CollisionTree::CollisionTree(size_t square_w, size_t square_h, double margin)
+	: CollisionGrid(square_w, square_h)
+	, tree(margin)
+{
+}
+
+CollisionTree::CollisionTree(int top_border, int left_border, int w_in_pixels, int h_in_pixels, size_t square_w, size_t square_h, double margin)
+	: CollisionGrid(top_border, left_border, w_in_pixels, h_in_pixels, square_w, square_h)
+	, tree(margin)
+{
+}
+
+AABB CollisionTree::GetBounds(const Collideable* obj) const
+{
+	AABB bounds = { obj->GetX(), obj->GetY(), obj->GetX() + obj->GetWidth(), obj->GetY() + obj->GetHeight() };
+	return bounds;
+}
+
+AABB CollisionTree::GetProxyBounds(const Collideable* obj) const
+{
+	AABB bounds = GetBounds(obj);
+	int x0, y0, x1, y1;
+	if (GetCellRange(obj, &x0, &y0, &x1, &y1) == false)
+	{
+		return bounds;
+	}
+
+	double left = unbounded ? 0.0 : leftBorder;
+	double top = unbounded ? 0.0 : topBorder;
+	AABB squares = { left + static_cast<double>(x0) * squareWidth, top + static_cast<double>(y0) * squareHeight,
+					 left + static_cast<double>(x1) * squareWidth, top + static_cast<double>(y1) * squareHeight };
+	return AABB::Union(bounds, squares);
+}
+
+CollideableHandle CollisionTree::AddObject(Collideable* new_obj)
+{
+	int id = tree.CreateProxy(GetProxyBounds(new_obj), new_obj);
+	SetProxyId(new_obj, static_cast<uint32_t>(id));
+	if (proxyObjectIndex.size() <= static_cast<size_t>(id))
+	{
+		proxyObjectIndex.resize(id + 1);
+		proxyFlags.resize(id + 1, 0);
+	}
+	proxyObjectIndex[id] = static_cast<uint32_t>(objects.size());
+	// the node may have belonged to a destroyed proxy earlier in the frame
+	proxyFlags[id] &= ~PROXY_DESTROYED;
+	BufferMove(id);
+
+	return CollisionGrid::AddObject(new_obj);
+}
+
+void CollisionTree::BufferMove(int proxy)
+{
+	if ((proxyFlags[proxy] & PROXY_BUFFERED) == 0)
+	{
+		proxyFlags[proxy] |= PROXY_BUFFERED;
+		moveBuffer.push_back(proxy);
+	}
+}
+
+void CollisionTree::OnObjectRemoved(Collideable* obj)
+{
+	int id = static_cast<int>(GetProxyId(obj));
+	tree.DestroyProxy(id);
+	// buffered as well, so its pairs are dropped on the next check
+	proxyFlags[id] |= PROXY_DESTROYED;
+	BufferMove(id);
+}
+
+void CollisionTree::OnObjectMoved(Collideable* obj)
+{
+	int id = static_cast<int>(GetProxyId(obj));
+	if (tree.MoveProxy(id, GetProxyBounds(obj)))
+	{
+		BufferMove(id);
+	}
+}
+
+void CollisionTree::UpdateProxies()
+{
+	objectCells.resize(objects.size());
+	for (size_t i = 0; i < objects.size(); i++)
+	{
+		Collideable* obj = objects[i];
+		int id = static_cast<int>(GetProxyId(obj));
+		proxyObjectIndex[id] = static_cast<uint32_t>(i);
+		// derived objects may change their coordinates without SetCoords
+		if (tree.MoveProxy(id, GetProxyBounds(obj)))
+		{
+			BufferMove(id);
+		}
+
+		CellRange& range = objectCells[i];
+		GetCellRange(obj, &range.x0, &range.y0, &range.x1, &range.y1);
+	}
+}
+
+void CollisionTree::UpdateProxyPairs()
+{
+	// pairs of unbuffered leaves stay, their fat boxes are the same as when the pair was found
+	size_t kept = 0;
+	for (auto pair : proxyPairs)
+	{
+		if ((proxyFlags[pair >> 32] & PROXY_BUFFERED) == 0 && (proxyFlags[pair & 0xFFFFFFFF] & PROXY_BUFFERED) == 0)
+		{
+			proxyPairs[kept++] = pair;
+		}
+	}
+	proxyPairs.resize(kept);
+
+	// buffered leaves look for every partner; of two buffered leaves only the lower one reports the pair
+	newProxyPairs.clear();
+	for (auto proxy : moveBuffer)
+	{
+		if ((proxyFlags[proxy] & PROXY_DESTROYED) != 0)
+		{
+			continue;
+		}
+
+		tree.Query(tree.GetFatAABB(proxy), [this, proxy](int other)
+		{
+			if (other != proxy && ((proxyFlags[other] & PROXY_BUFFERED) == 0 || other > proxy))
+			{
+				uint64_t lower = static_cast<uint64_t>(std::min(proxy, other));
+				uint64_t higher = static_cast<uint64_t>(std::max(proxy, other));
+				newProxyPairs.push_back((lower << 32) | higher);
+			}
+			return true;
+		});
+	}
+	proxyPairs.insert(proxyPairs.end(), newProxyPairs.begin(), newProxyPairs.end());
+
+	for (auto proxy : moveBuffer)
+	{
+		proxyFlags[proxy] &= PROXY_DESTROYED;
+	}
+	moveBuffer.clear();
+}
+
+void CollisionTree::GeneratePairs(std::vector<uint64_t>* result)
+{
+	UpdateProxies();
+	UpdateProxyPairs();
+
+	GeneratePairsInChunks(proxyPairs.size(), [this](size_t begin, size_t end, std::vector<uint64_t>* out, CollisionLayerStats* stats)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			uint32_t first = proxyObjectIndex[proxyPairs[i] >> 32];
+			uint32_t second = proxyObjectIndex[proxyPairs[i] & 0xFFFFFFFF];
+			if (first > second)
+			{
+				std::swap(first, second);
+			}
+
+			// filtered only once the squares are shared, so the layer stats count the same pairs as the grid does
+			if (SharesCell(first, objectCells[first], second, objectCells[second]) &&
+				FilterPair(objects[first], objects[second], stats) && PixelsOverlap(objects[first], objects[second]))
+			{
+				out->push_back((static_cast<uint64_t>(first) << 32) | second);
+			}
+		}
+	}, result);
+
+	// pair order depends on the insertion history, keep the pairs ordered by object index instead
+	std::sort(result->begin(), result->end());
+}
+
+Collideable* CollisionTree::GetObjectFromCoordinates(int x, int y)
+{
+	int gridX = 0;
+	int gridY = 0;
+	GetGridCoordinates(x, y, &gridX, &gridY);
+	return GetObjectFromGridCoordinates(gridX, gridY);
+}
+
+Collideable* CollisionTree::GetObjectFromGridCoordinates(int x, int y)
+{
+	if (unbounded == false &&
+		(x < 0 || x >= static_cast<int>(wSquares) || y < 0 || y >= static_cast<int>(hSquares)))
+	{
+		return nullptr;
+	}
+
+	double left = unbounded ? 0.0 : leftBorder;
+	double top = unbounded ? 0.0 : topBorder;
+	AABB square = { left + (x - 1.0) * squareWidth, top + (y - 1.0) * squareHeight,
+					left + (x + 2.0) * squareWidth, top + (y + 2.0) * squareHeight };
+
+	Collideable* found = nullptr;
+	uint32_t foundIndex = 0;
+	tree.Query(square, [&](int proxy)
+	{
+		Collideable* obj = static_cast<Collideable*>(tree.GetUserData(proxy));
+		int x0, y0, x1, y1;
+		if (GetCellRange(obj, &x0, &y0, &x1, &y1) && x >= x0 && x < x1 && y >= y0 && y < y1 &&
+			(obj->IsMaskFull() || obj->IsMaskSet(x - x0, y - y0)))
+		{
+			uint32_t index = proxyObjectIndex[proxy];
+			if (found == nullptr || index < foundIndex)
+			{
+				found = obj;
+				foundIndex = index;
+			}
+		}
+		return true;
+	});
+
+	return found;
+}
+
+void CollisionTree::GetObjectsFromCoordinates(int x, int y, std::vector<Collideable*>* result)
+{
+	result->clear();
+	tree.QueryPoint(x, y, [&](int proxy)
+	{
+		Collideable* obj = static_cast<Collideable*>(tree.GetUserData(proxy));
+		if (GetBounds(obj).Contains(x, y))
+		{
+			result->push_back(obj);
+		}
+		return true;
+	});
+}
+
+void CollisionTree::QueryRect(int x, int y, int w, int h, std::vector<Collideable*>* result)
+{
+	result->clear();
+	AABB rect = { static_cast<double>(x), static_cast<double>(y), static_cast<double>(x + w), static_cast<double>(y + h) };
+	tree.Query(rect, [&](int proxy)
+	{
+		Collideable* obj = static_cast<Collideable*>(tree.GetUserData(proxy));
+		if (GetBounds(obj).Overlaps(rect))
+		{
+			result->push_back(obj);
+		}
+		return true;
+	});
+}
+
+Collideable* CollisionTree::GetNearestObject(double x, double y, double max_distance)
+{
+	Collideable* nearest = nullptr;
+	double best = max_distance;
+
+	// grow the search box until something is found inside the radius it covers
+	double radius = static_cast<double>(std::max(squareWidth, squareHeight));
+	while (true)
+	{
+		double searchRadius = std::min(radius, max_distance);
+		AABB area = { x - searchRadius, y - searchRadius, x + searchRadius, y + searchRadius };
+		tree.Query(area, [&](int proxy)
+		{
+			Collideable* obj = static_cast<Collideable*>(tree.GetUserData(proxy));
+			AABB bounds = GetBounds(obj);
+			double dx = std::max(std::max(bounds.minX - x, x - bounds.maxX), 0.0);
+			double dy = std::max(std::max(bounds.minY - y, y - bounds.maxY), 0.0);
+			double distance = std::sqrt(dx * dx + dy * dy);
+			if (distance <= best)
+			{
+				best = distance;
+				nearest = obj;
+			}
+			return true;
+		});
+
+		if ((nearest != nullptr && best <= searchRadius) || searchRadius >= max_distance || objects.empty())
+		{
+			break;
+		}
+		radius *= 2.0;
+	}
+
+	return nearest;
+}
+
+Collideable* CollisionTree::RayCast(double x0, double y0, double x1, double y1, double* fraction)
+{
+	Collideable* hit = nullptr;
+	double hitFraction = 1.0;
+
+	tree.RayCast(x0, y0, x1, y1, [&](int proxy, double max_fraction)
+	{
+		Collideable* obj = static_cast<Collideable*>(tree.GetUserData(proxy));
+		double t = GetBounds(obj).RayFraction(x0, y0, x1 - x0, y1 - y0, max_fraction);
+		if (t < 0.0)
+		{
+			return -1.0;
+		}
+
+		if (hit == nullptr || t < hitFraction)
+		{
+			hit = obj;
+			hitFraction = t;
+		}
+		// the segment starting inside an object can't hit anything closer
+		return t;
+	});
+
+	if (fraction != nullptr)
+	{
+		*fraction = hitFraction;
+	}
+	return hit;
+}
+
+bool CollisionTree::Sweep(Collideable* obj, double dx, double dy, SweepHit* hit)
+{
+	// leaves contain their objects, so a leaf is entered no later than its object is hit: once something is
+	// hit, subtrees entered after it can be skipped. ties are still visited, the lower index wins them
+	SweepHit best = { nullptr, 1.0 };
+	uint32_t bestIndex = 0;
+	tree.BoxCast(GetBounds(obj), dx, dy, [&](int proxy, double max_fraction)
+	{
+		Collideable* target = static_cast<Collideable*>(tree.GetUserData(proxy));
+		ConsiderSweepCandidate(obj, dx, dy, GetObjectIndex(target), &best, &bestIndex);
+		return (best.target != nullptr) ? best.time : max_fraction;
+	});
+
+	if (best.target == nullptr)
+	{
+		return false;
+	}
+
+	if (hit != nullptr)
+	{
+		*hit = best;
+	}
+	return true;
+}
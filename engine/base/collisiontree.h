@@ -0,0 +1,84 @@
+/*
+Author: Vladimir Slav
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+ Collision tree: CollisionGrid interface on top of a dynamic AABB tree. It doesn't need the world size up front,
+ so it also works for map-sized or unbounded levels, and answers point, rect, nearest and ray queries in pixels.
+ Objects moved with Collideable::Move/SetCoords refit their leaf right away, so queries between checks are current.
+ Pairs are the same ones CollisionGrid reports: objects are compared by the squares they occupy and their masks.
+ Leaves cover the squares of the object as well, and candidate pairs are the leaves whose fat boxes overlap. They
+ are kept between checks, only the leaves that had to be reinserted look for new partners.
+*/
+
+#ifndef __COLLISIONTREE_H__
+#define __COLLISIONTREE_H__
+
+#include "collisiongrid.h"
+#include "aabbtree.h"
+
+class CollisionTree : public CollisionGrid
+{
+protected:
+	AABBTree tree;
+	std::vector<uint32_t> proxyObjectIndex; // index in objects, by tree proxy
+
+	// leaves created, reinserted or destroyed since the last check, with their flags by tree proxy
+	enum ProxyFlags : uint8_t
+	{
+		PROXY_BUFFERED = 1,  // in moveBuffer
+		PROXY_DESTROYED = 2
+	};
+	std::vector<int> moveBuffer;
+	std::vector<uint8_t> proxyFlags;
+	// tree proxy pairs (lower << 32 | higher) whose fat boxes overlap, valid while neither proxy is in moveBuffer
+	std::vector<uint64_t> proxyPairs;
+	std::vector<uint64_t> newProxyPairs;
+
+	AABB GetBounds(const Collideable* obj) const;
+	// object box together with the squares it occupies, what the leaf has to contain
+	AABB GetProxyBounds(const Collideable* obj) const;
+	void BufferMove(int proxy);
+	void UpdateProxies();
+	void UpdateProxyPairs();
+
+	virtual void GeneratePairs(std::vector<uint64_t>* result) override;
+	virtual void OnObjectRemoved(Collideable* obj) override;
+	virtual void OnObjectMoved(Collideable* obj) override;
+
+public:
+	// unbounded world: objects never collide with a boundary
+	CollisionTree(size_t square_w, size_t square_h, double margin);
+	// bounded world, boundary checks work like in CollisionGrid
+	CollisionTree(int top_border, int left_border, int w_in_pixels, int h_in_pixels, size_t square_w, size_t square_h, double margin);
+
+	virtual CollideableHandle AddObject(Collideable* new_obj) override;
+
+	virtual Collideable* GetObjectFromCoordinates(int x, int y) override;
+	virtual Collideable* GetObjectFromGridCoordinates(int x, int y) override;
+	virtual void GetObjectsFromCoordinates(int x, int y, std::vector<Collideable*>* result) override;
+	virtual void QueryRect(int x, int y, int w, int h, std::vector<Collideable*>* result) override;
+	virtual Collideable* GetNearestObject(double x, double y, double max_distance) override;
+
+	virtual bool Sweep(Collideable* obj, double dx, double dy, SweepHit* hit) override;
+
+	// first object hit by the segment, fraction receives the position of the hit along it (0..1)
+	Collideable* RayCast(double x0, double y0, double x1, double y1, double* fraction);
+};
+
+#endif
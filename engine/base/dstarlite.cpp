@@ -0,0 +1,418 @@
+/*
+Author: Vladimir Slav
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "dstarlite.h"
+#include "..\SDL2\include\SDL.h"
+
+namespace
+{
+    const int neighbourX[] = { -1, 1, 0, 0 };
+    const int neighbourY[] = { 0, 0, -1, 1 };
+}
+
+const int DStarLite::INFINITE_COST;
+const uint32_t DStarLite::NOT_QUEUED;
+
+DStarLite::DStarLite(const WalkabilityGrid* _grid, int unit_w)
+    : grid(_grid)
+    , w(_grid->GetWidth())
+    , h(_grid->GetHeight())
+    , unitW(unit_w)
+    , start(-1)
+    , goal(-1)
+    , km(0)
+    , planned(false)
+    , expanded(0)
+{
+}
+
+int DStarLite::Heuristic(int from, int to) const
+{
+    return HFunc(from % w, from / w, to % w, to / w);
+}
+
+DStarLite::Key DStarLite::CalculateKey(int tile) const
+{
+    int best = std::min(g[tile], rhs[tile]);
+    if (best >= INFINITE_COST)
+    {
+        return Key(INFINITE_COST, INFINITE_COST);
+    }
+    return Key(best + Heuristic(start, tile) + km, best);
+}
+
+int DStarLite::BestSuccessor(int tile) const
+{
+    int x = tile % w;
+    int y = tile / w;
+    int best = INFINITE_COST;
+    for (int i = 0; i < 4; i++)
+    {
+        int adjX = x + neighbourX[i];
+        int adjY = y + neighbourY[i];
+        if (areValidCoordinates(adjX, adjY, w, h) == false)
+        {
+            continue;
+        }
+
+        int adjacent = adjY * w + adjX;
+        if (passable[adjacent] && g[adjacent] < INFINITE_COST)
+        {
+            best = std::min(best, g[adjacent] + 1);
+        }
+    }
+    return best;
+}
+
+void DStarLite::HeapSiftUp(uint32_t position)
+{
+    int tile = heap[position];
+    while (position > 0)
+    {
+        uint32_t parent = (position - 1) / 2;
+        if ((keys[tile] < keys[heap[parent]]) == false)
+        {
+            break;
+        }
+        heap[position] = heap[parent];
+        heapIndex[heap[position]] = position;
+        position = parent;
+    }
+    heap[position] = tile;
+    heapIndex[tile] = position;
+}
+
+void DStarLite::HeapSiftDown(uint32_t position)
+{
+    int tile = heap[position];
+    uint32_t size = static_cast<uint32_t>(heap.size());
+    while (true)
+    {
+        uint32_t child = position * 2 + 1;
+        if (child >= size)
+        {
+            break;
+        }
+        if (child + 1 < size && keys[heap[child + 1]] < keys[heap[child]])
+        {
+            child++;
+        }
+        if ((keys[heap[child]] < keys[tile]) == false)
+        {
+            break;
+        }
+        heap[position] = heap[child];
+        heapIndex[heap[position]] = position;
+        position = child;
+    }
+    heap[position] = tile;
+    heapIndex[tile] = position;
+}
+
+void DStarLite::HeapInsert(int tile, const Key& key)
+{
+    keys[tile] = key;
+    heap.push_back(tile);
+    HeapSiftUp(static_cast<uint32_t>(heap.size() - 1));
+}
+
+void DStarLite::HeapUpdate(int tile, const Key& key)
+{
+    bool decreased = key < keys[tile];
+    keys[tile] = key;
+    if (decreased)
+    {
+        HeapSiftUp(heapIndex[tile]);
+    }
+    else
+    {
+        HeapSiftDown(heapIndex[tile]);
+    }
+}
+
+void DStarLite::HeapRemove(int tile)
+{
+    uint32_t position = heapIndex[tile];
+    heapIndex[tile] = NOT_QUEUED;
+
+    int last = heap.back();
+    heap.pop_back();
+    if (last == tile)
+    {
+        return;
+    }
+
+    heap[position] = last;
+    heapIndex[last] = position;
+    HeapSiftUp(position);
+    HeapSiftDown(heapIndex[last]);
+}
+
+void DStarLite::UpdateVertex(int tile)
+{
+    bool queued = heapIndex[tile] != NOT_QUEUED;
+    if (g[tile] != rhs[tile])
+    {
+        if (queued)
+        {
+            HeapUpdate(tile, CalculateKey(tile));
+        }
+        else
+        {
+            HeapInsert(tile, CalculateKey(tile));
+        }
+    }
+    else if (queued)
+    {
+        HeapRemove(tile);
+    }
+}
+
+void DStarLite::Plan(int xStart, int yStart, int xDest, int yDest)
+{
+    SDL_assert_release(areValidCoordinates(xStart, yStart, w, h) && areValidCoordinates(xDest, yDest, w, h));
+
+    start = yStart * w + xStart;
+    goal = yDest * w + xDest;
+    km = 0;
+    expanded = 0;
+
+    g.assign(w * h, INFINITE_COST);
+    rhs.assign(w * h, INFINITE_COST);
+    keys.resize(w * h);
+    heapIndex.assign(w * h, NOT_QUEUED);
+    heap.clear();
+
+    passable.resize(w * h);
+    for (int y = 0; y < h; y++)
+    {
+        for (int x = 0; x < w; x++)
+        {
+            passable[y * w + x] = grid->UnitFits(x, y, unitW) ? 1 : 0;
+        }
+    }
+    // the goal is entered even if the unit doesn't fit
+    passable[goal] = 1;
+
+    rhs[goal] = 0;
+    HeapInsert(goal, CalculateKey(goal));
+    planned = true;
+}
+
+void DStarLite::MoveStart(int x, int y)
+{
+    SDL_assert_release(planned && areValidCoordinates(x, y, w, h));
+    // keys already in the open list were measured from the old start
+    km += Heuristic(start, y * w + x);
+    start = y * w + x;
+}
+
+void DStarLite::OnTileChanged(int x, int y)
+{
+    if (planned == false)
+    {
+        return;
+    }
+
+    // the clearance changed up to unitW - 1 tiles to the left as well
+    for (int tileX = std::max(0, x - unitW + 1); tileX <= x; tileX++)
+    {
+        int tile = y * w + tileX;
+        uint8_t nowPassable = (tile == goal || grid->UnitFits(tileX, y, unitW)) ? 1 : 0;
+        if (nowPassable == passable[tile])
+        {
+            continue;
+        }
+
+        // only the edges into the tile changed, so only its neighbours need their rhs again
+        int oldCost = Cost(tile);
+        passable[tile] = nowPassable;
+        int newCost = Cost(tile);
+        for (int i = 0; i < 4; i++)
+        {
+            int adjX = tileX + neighbourX[i];
+            int adjY = y + neighbourY[i];
+            if (areValidCoordinates(adjX, adjY, w, h) == false)
+            {
+                continue;
+            }
+
+            int adjacent = adjY * w + adjX;
+            if (adjacent == goal)
+            {
+                continue;
+            }
+
+            if (oldCost > newCost)
+            {
+                if (g[tile] < INFINITE_COST)
+                {
+                    rhs[adjacent] = std::min(rhs[adjacent], newCost + g[tile]);
+                }
+            }
+            else if (g[tile] < INFINITE_COST && rhs[adjacent] == oldCost + g[tile])
+            {
+                rhs[adjacent] = BestSuccessor(adjacent);
+            }
+            UpdateVertex(adjacent);
+        }
+    }
+}
+
+void DStarLite::ComputeShortestPath()
+{
+    while (heap.empty() == false &&
+           (keys[heap[0]] < CalculateKey(start) || rhs[start] > g[start]))
+    {
+        int tile = heap[0];
+        Key oldKey = keys[tile];
+        Key newKey = CalculateKey(tile);
+        expanded++;
+
+        if (oldKey < newKey)
+        {
+            HeapUpdate(tile, newKey);
+            continue;
+        }
+
+        int x = tile % w;
+        int y = tile / w;
+        if (g[tile] > rhs[tile])
+        {
+            g[tile] = rhs[tile];
+            HeapRemove(tile);
+            if (passable[tile] == false)
+            {
+                continue;
+            }
+
+            for (int i = 0; i < 4; i++)
+            {
+                int adjX = x + neighbourX[i];
+                int adjY = y + neighbourY[i];
+                if (areValidCoordinates(adjX, adjY, w, h) == false)
+                {
+                    continue;
+                }
+
+                int adjacent = adjY * w + adjX;
+                if (adjacent != goal)
+                {
+                    rhs[adjacent] = std::min(rhs[adjacent], g[tile] + 1);
+                }
+                UpdateVertex(adjacent);
+            }
+        }
+        else
+        {
+            int oldG = g[tile];
+            g[tile] = INFINITE_COST;
+            if (tile != goal)
+            {
+                rhs[tile] = BestSuccessor(tile);
+            }
+            UpdateVertex(tile);
+
+            if (passable[tile] == false)
+            {
+                continue;
+            }
+
+            for (int i = 0; i < 4; i++)
+            {
+                int adjX = x + neighbourX[i];
+                int adjY = y + neighbourY[i];
+                if (areValidCoordinates(adjX, adjY, w, h) == false)
+                {
+                    continue;
+                }
+
+                int adjacent = adjY * w + adjX;
+                if (adjacent != goal && rhs[adjacent] == oldG + 1)
+                {
+                    rhs[adjacent] = BestSuccessor(adjacent);
+                }
+                UpdateVertex(adjacent);
+            }
+        }
+    }
+}
+
+bool DStarLite::GetPath(bool include_destination, tile_list* path)
+{
+    path->clear();
+    if (planned == false || start == goal)
+    {
+        return false;
+    }
+
+    int xDest = goal % w;
+    int yDest = goal / w;
+    if (include_destination && grid->UnitFits(xDest, yDest, unitW) == false)
+    {
+        return false;
+    }
+
+    ComputeShortestPath();
+    if (rhs[start] >= INFINITE_COST)
+    {
+        return false;
+    }
+
+    // walk down the distances from the start, then turn it around into the Astar order
+    int tile = start;
+    while (tile != goal)
+    {
+        int x = tile % w;
+        int y = tile / w;
+        int next = -1;
+        int best = INFINITE_COST;
+        for (int i = 0; i < 4; i++)
+        {
+            int adjX = x + neighbourX[i];
+            int adjY = y + neighbourY[i];
+            if (areValidCoordinates(adjX, adjY, w, h) == false)
+            {
+                continue;
+            }
+
+            int adjacent = adjY * w + adjX;
+            if (passable[adjacent] && g[adjacent] < best)
+            {
+                best = g[adjacent];
+                next = adjacent;
+            }
+        }
+
+        if (next < 0 || path->size() >= static_cast<size_t>(w * h))
+        {
+            path->clear();
+            return false;
+        }
+        path->push_back({ next % w, next / w });
+        tile = next;
+    }
+
+    if (include_destination == false)
+    {
+        path->pop_back();
+    }
+    std::reverse(path->begin(), path->end());
+    return true;
+}
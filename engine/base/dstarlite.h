@@ -0,0 +1,96 @@
+/*
+Author: Vladimir Slav
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+ D* Lite: incremental search for one agent. The search runs backwards from the goal and keeps its
+ state between queries, so when tiles change or the agent moves only the part of the search that
+ depends on them is repaired instead of searching from scratch again. Meant for units that keep
+ replanning while other units block and free tiles around them.
+
+ Moves follow the Astar rules: 4 directions, every step costs 1, the unit (unit_w tiles wide) has to
+ fit on every tile it steps on except the goal, and it can leave a tile it doesn't fit on.
+*/
+
+#ifndef __DSTARLITE_H__
+#define __DSTARLITE_H__
+
+#include "walkabilitygrid.h"
+
+#include <utility>
+
+class DStarLite
+{
+private:
+    static const int INFINITE_COST = 0x3FFFFFFF;
+    static const uint32_t NOT_QUEUED = 0xFFFFFFFF;
+
+    using Key = std::pair<int, int>;
+
+    const WalkabilityGrid* grid;
+    int w;
+    int h;
+    int unitW;
+
+    int start;
+    int goal;
+    int km; // heuristic drift since planning started
+    bool planned;
+    size_t expanded;
+
+    std::vector<int> g;
+    std::vector<int> rhs;
+    std::vector<uint8_t> passable; // walkability the search state was computed with
+
+    // open list: indexed binary heap of tiles
+    std::vector<int> heap;
+    std::vector<Key> keys;
+    std::vector<uint32_t> heapIndex;
+
+    int Heuristic(int from, int to) const;
+    Key CalculateKey(int tile) const;
+    int Cost(int to) const { return passable[to] ? 1 : INFINITE_COST; }
+    int BestSuccessor(int tile) const; // min over neighbours of cost + g
+
+    void HeapSiftUp(uint32_t position);
+    void HeapSiftDown(uint32_t position);
+    void HeapInsert(int tile, const Key& key);
+    void HeapUpdate(int tile, const Key& key);
+    void HeapRemove(int tile);
+
+    void UpdateVertex(int tile);
+    void ComputeShortestPath();
+
+public:
+    DStarLite(const WalkabilityGrid* _grid, int unit_w = 1);
+
+    // starts over for a new goal
+    void Plan(int xStart, int yStart, int xDest, int yDest);
+    // the agent moved, the search state stays
+    void MoveStart(int x, int y);
+    // the tile changed in the grid, call before the next GetPath
+    void OnTileChanged(int x, int y);
+
+    // repairs the search and writes the path in the Astar order, false if there is none
+    bool GetPath(bool include_destination, tile_list* path);
+
+    // tiles expanded since the last Plan, shows how little a repair costs
+    size_t GetExpandedAmount() const { return expanded; }
+};
+
+#endif
@@ -0,0 +1,411 @@
+/*
+Author: Vladimir Slav
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "flowfield.h"
+#include "threadpool.h"
+#include <functional>
+#include "..\SDL2\include\SDL.h"
+
+namespace
+{
+    const int neighbourX[] = { -1, 1, 0, 0 };
+    const int neighbourY[] = { 0, 0, -1, 1 };
+    const FlowDirection neighbourDirections[] = { FlowDirection::LEFT, FlowDirection::RIGHT, FlowDirection::UP, FlowDirection::DOWN };
+}
+
+FlowField::FlowField(const WalkabilityGrid& grid, int goal_x, int goal_y, int unit_w)
+    : w(grid.GetWidth())
+    , h(grid.GetHeight())
+    , goalX(goal_x)
+    , goalY(goal_y)
+    , unitW(unit_w)
+{
+    SDL_assert_release(areValidCoordinates(goalX, goalY, w, h));
+    Build(grid);
+}
+
+bool FlowField::IsPassable(const WalkabilityGrid& grid, int x, int y) const
+{
+    return (x == goalX && y == goalY) || grid.UnitFits(x, y, unitW);
+}
+
+void FlowField::Build(const WalkabilityGrid& grid)
+{
+    distances.assign(w * h, FLOW_UNREACHABLE);
+    directions.assign(w * h, FlowDirection::NONE);
+    passable.resize(w * h);
+    for (int y = 0; y < h; y++)
+    {
+        for (int x = 0; x < w; x++)
+        {
+            passable[y * w + x] = IsPassable(grid, x, y) ? 1 : 0;
+        }
+    }
+
+    // plain breadth first search from the goal, every step costs the same
+    std::vector<int>& queue = orphans;
+    queue.clear();
+    int goal = goalY * w + goalX;
+    distances[goal] = 0;
+    queue.push_back(goal);
+    for (size_t i = 0; i < queue.size(); i++)
+    {
+        int current = queue[i];
+        int x = current % w;
+        int y = current / w;
+        for (int j = 0; j < 4; j++)
+        {
+            int adjX = x + neighbourX[j];
+            int adjY = y + neighbourY[j];
+            if (areValidCoordinates(adjX, adjY, w, h) == false)
+            {
+                continue;
+            }
+
+            int adjacent = adjY * w + adjX;
+            if (passable[adjacent] && distances[adjacent] == FLOW_UNREACHABLE)
+            {
+                distances[adjacent] = distances[current] + 1;
+                queue.push_back(adjacent);
+            }
+        }
+    }
+
+    for (int i = 0; i < w * h; i++)
+    {
+        UpdateDirection(i);
+    }
+}
+
+void FlowField::UpdateDirection(int tile)
+{
+    // towards the closest neighbour, even from tiles the unit doesn't fit on - it can still leave them
+    directions[tile] = FlowDirection::NONE;
+    if (distances[tile] == 0)
+    {
+        return;
+    }
+
+    int x = tile % w;
+    int y = tile / w;
+    int best = FLOW_UNREACHABLE;
+    for (int i = 0; i < 4; i++)
+    {
+        int adjX = x + neighbourX[i];
+        int adjY = y + neighbourY[i];
+        if (areValidCoordinates(adjX, adjY, w, h) && distances[adjY * w + adjX] < best)
+        {
+            best = distances[adjY * w + adjX];
+            directions[tile] = neighbourDirections[i];
+        }
+    }
+}
+
+void FlowField::Push(int tile, int distance)
+{
+    distances[tile] = distance;
+    changed.push_back(tile);
+    open.push_back(std::make_pair(distance, tile));
+    std::push_heap(open.begin(), open.end(), std::greater<std::pair<int, int>>());
+}
+
+void FlowField::Propagate()
+{
+    while (open.empty() == false)
+    {
+        std::pop_heap(open.begin(), open.end(), std::greater<std::pair<int, int>>());
+        std::pair<int, int> current = open.back();
+        open.pop_back();
+        if (current.first > distances[current.second])
+        {
+            continue;
+        }
+
+        int x = current.second % w;
+        int y = current.second / w;
+        for (int i = 0; i < 4; i++)
+        {
+            int adjX = x + neighbourX[i];
+            int adjY = y + neighbourY[i];
+            if (areValidCoordinates(adjX, adjY, w, h) == false)
+            {
+                continue;
+            }
+
+            int adjacent = adjY * w + adjX;
+            if (passable[adjacent] && current.first + 1 < distances[adjacent])
+            {
+                Push(adjacent, current.first + 1);
+            }
+        }
+    }
+}
+
+void FlowField::OnTileChanged(const WalkabilityGrid& grid, int x, int y)
+{
+    // the clearance changed up to unitW - 1 tiles to the left as well
+    for (int tileX = std::max(0, x - unitW + 1); tileX <= x; tileX++)
+    {
+        int tile = y * w + tileX;
+        uint8_t nowPassable = IsPassable(grid, tileX, y) ? 1 : 0;
+        if (nowPassable != passable[tile])
+        {
+            passable[tile] = nowPassable;
+            Repair(tile);
+        }
+    }
+}
+
+void FlowField::Repair(int tile)
+{
+    changed.clear();
+    open.clear();
+    changed.push_back(tile);
+
+    int tileX = tile % w;
+    int tileY = tile / w;
+    if (passable[tile])
+    {
+        // opened: take the best neighbour, the rest follows from it
+        int best = GetBestNeighbourDistance(tile);
+        if (best != FLOW_UNREACHABLE)
+        {
+            Push(tile, best + 1);
+        }
+    }
+    else if (distances[tile] != FLOW_UNREACHABLE)
+    {
+        // closed: everything that flowed through it loses its distance, then gets it back from the
+        // tiles around that still have one
+        orphans.clear();
+        orphans.push_back(tile);
+        for (size_t i = 0; i < orphans.size(); i++)
+        {
+            int current = orphans[i];
+            int currentX = current % w;
+            int currentY = current / w;
+            for (int j = 0; j < 4; j++)
+            {
+                int adjX = currentX + neighbourX[j];
+                int adjY = currentY + neighbourY[j];
+                if (areValidCoordinates(adjX, adjY, w, h) == false)
+                {
+                    continue;
+                }
+
+                // the neighbour flows into current if its direction is the opposite of j
+                int adjacent = adjY * w + adjX;
+                if (distances[adjacent] != FLOW_UNREACHABLE && directions[adjacent] == neighbourDirections[j ^ 1])
+                {
+                    distances[adjacent] = FLOW_UNREACHABLE;
+                    orphans.push_back(adjacent);
+                }
+            }
+        }
+        distances[tile] = FLOW_UNREACHABLE;
+
+        for (int orphan : orphans)
+        {
+            changed.push_back(orphan);
+            int best = GetBestNeighbourDistance(orphan);
+            if (passable[orphan] && best != FLOW_UNREACHABLE)
+            {
+                Push(orphan, best + 1);
+            }
+        }
+    }
+
+    Propagate();
+
+    // directions only change where a distance did, or next to it
+    for (int changedTile : changed)
+    {
+        UpdateDirection(changedTile);
+        tileX = changedTile % w;
+        tileY = changedTile / w;
+        for (int i = 0; i < 4; i++)
+        {
+            int adjX = tileX + neighbourX[i];
+            int adjY = tileY + neighbourY[i];
+            if (areValidCoordinates(adjX, adjY, w, h))
+            {
+                UpdateDirection(adjY * w + adjX);
+            }
+        }
+    }
+}
+
+int FlowField::GetBestNeighbourDistance(int tile) const
+{
+    int x = tile % w;
+    int y = tile / w;
+    int best = FLOW_UNREACHABLE;
+    for (int i = 0; i < 4; i++)
+    {
+        int adjX = x + neighbourX[i];
+        int adjY = y + neighbourY[i];
+        if (areValidCoordinates(adjX, adjY, w, h))
+        {
+            best = std::min(best, distances[adjY * w + adjX]);
+        }
+    }
+    return best;
+}
+
+bool FlowField::GetNextTile(int x, int y, TileCoords* next) const
+{
+    switch (directions[y * w + x])
+    {
+    case FlowDirection::LEFT:
+        *next = { x - 1, y };
+        return true;
+    case FlowDirection::RIGHT:
+        *next = { x + 1, y };
+        return true;
+    case FlowDirection::UP:
+        *next = { x, y - 1 };
+        return true;
+    case FlowDirection::DOWN:
+        *next = { x, y + 1 };
+        return true;
+    default:
+        return false;
+    }
+}
+
+FlowFieldCache::FlowFieldCache(const WalkabilityGrid* _grid, size_t _capacity)
+    : grid(_grid)
+    , capacity(_capacity)
+    , useCounter(0)
+{
+    SDL_assert_release(grid != nullptr && capacity > 0);
+}
+
+FlowFieldCache::Entry* FlowFieldCache::Find(int goal_x, int goal_y, int unit_w)
+{
+    for (auto& entry : entries)
+    {
+        if (entry.goalX == goal_x && entry.goalY == goal_y && entry.unitW == unit_w)
+        {
+            entry.lastUse = ++useCounter;
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+FlowFieldCache::Entry* FlowFieldCache::Add(int goal_x, int goal_y, int unit_w)
+{
+    if (entries.size() >= capacity)
+    {
+        auto oldest = std::min_element(entries.begin(), entries.end(), [](const Entry& a, const Entry& b)
+        {
+            return a.lastUse < b.lastUse;
+        });
+        // a build still running keeps its own reference, dropping the entry is safe
+        entries.erase(oldest);
+    }
+
+    entries.emplace_back();
+    Entry& entry = entries.back();
+    entry.goalX = goal_x;
+    entry.goalY = goal_y;
+    entry.unitW = unit_w;
+    entry.lastUse = ++useCounter;
+    return &entry;
+}
+
+void FlowFieldCache::Collect(Entry* entry)
+{
+    if (entry->build == nullptr || entry->build->done.load(std::memory_order_acquire) == false)
+    {
+        return;
+    }
+
+    entry->field = std::move(entry->build->field);
+    entry->build.reset();
+
+    // the copy it was computed from doesn't have the changes made since
+    for (const auto& tile : entry->changesDuringBuild)
+    {
+        entry->field->OnTileChanged(*grid, tile.x, tile.y);
+    }
+    entry->changesDuringBuild.clear();
+}
+
+const FlowField* FlowFieldCache::Get(int goal_x, int goal_y, int unit_w)
+{
+    Entry* entry = Find(goal_x, goal_y, unit_w);
+    if (entry == nullptr)
+    {
+        entry = Add(goal_x, goal_y, unit_w);
+    }
+
+    Collect(entry);
+    if (entry->field == nullptr)
+    {
+        // don't wait for the worker, the field is needed now
+        entry->build.reset();
+        entry->changesDuringBuild.clear();
+        entry->field.reset(new FlowField(*grid, goal_x, goal_y, unit_w));
+    }
+    return entry->field.get();
+}
+
+const FlowField* FlowFieldCache::GetAsync(int goal_x, int goal_y, int unit_w, EngineRoutines::ThreadPool* pool)
+{
+    Entry* entry = Find(goal_x, goal_y, unit_w);
+    if (entry == nullptr)
+    {
+        entry = Add(goal_x, goal_y, unit_w);
+        entry->build = std::make_shared<AsyncBuild>();
+        entry->build->done = false;
+
+        std::shared_ptr<AsyncBuild> build = entry->build;
+        std::shared_ptr<WalkabilityGrid> snapshot = std::make_shared<WalkabilityGrid>(*grid);
+        pool->Enqueue([build, snapshot, goal_x, goal_y, unit_w]()
+        {
+            build->field.reset(new FlowField(*snapshot, goal_x, goal_y, unit_w));
+            build->done.store(true, std::memory_order_release);
+        });
+    }
+
+    Collect(entry);
+    return entry->field.get();
+}
+
+void FlowFieldCache::OnTileChanged(int x, int y)
+{
+    for (auto& entry : entries)
+    {
+        if (entry.build != nullptr)
+        {
+            entry.changesDuringBuild.push_back({ x, y });
+        }
+        else if (entry.field != nullptr)
+        {
+            entry.field->OnTileChanged(*grid, x, y);
+        }
+    }
+}
+
+void FlowFieldCache::Clear()
+{
+    entries.clear();
+}
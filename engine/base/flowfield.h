@@ -0,0 +1,142 @@
+/*
+Author: Vladimir Slav
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+ Flow field: distances from one goal to every tile, computed once with a breadth first search over
+ the walkability grid, and the direction to step in from every tile. Any number of units heading to
+ the goal just look up their next step instead of searching a path each.
+ Moves follow the Astar rules: 4 directions, the unit (unit_w tiles wide) has to fit on every tile
+ it steps on except the goal, and it can leave a tile it doesn't fit on.
+ When tiles change the field is repaired around them instead of being computed again.
+*/
+
+#ifndef __FLOWFIELD_H__
+#define __FLOWFIELD_H__
+
+#include "walkabilitygrid.h"
+
+#include <atomic>
+#include <memory>
+
+namespace EngineRoutines
+{
+    class ThreadPool;
+}
+
+enum class FlowDirection : uint8_t
+{
+    NONE,
+    LEFT,
+    RIGHT,
+    UP,
+    DOWN
+};
+
+static const int FLOW_UNREACHABLE = 0x7FFFFFFF;
+
+class FlowField
+{
+private:
+    int w;
+    int h;
+    int goalX;
+    int goalY;
+    int unitW;
+
+    std::vector<int> distances;
+    std::vector<FlowDirection> directions;
+    std::vector<uint8_t> passable; // walkability the field was computed with
+
+    // used while repairing
+    std::vector<std::pair<int, int>> open; // distance, tile
+    std::vector<int> orphans;
+    std::vector<int> changed;
+
+    bool IsPassable(const WalkabilityGrid& grid, int x, int y) const;
+    int GetBestNeighbourDistance(int tile) const;
+    void UpdateDirection(int tile);
+    // passable of the tile changed
+    void Repair(int tile);
+    void Propagate();
+    void Push(int tile, int distance);
+
+public:
+    FlowField(const WalkabilityGrid& grid, int goal_x, int goal_y, int unit_w = 1);
+
+    void Build(const WalkabilityGrid& grid);
+    // the tile changed in the grid, repair the distances that depend on it
+    void OnTileChanged(const WalkabilityGrid& grid, int x, int y);
+
+    int GetGoalX() const { return goalX; }
+    int GetGoalY() const { return goalY; }
+    int GetUnitWidth() const { return unitW; }
+
+    // steps to the goal, FLOW_UNREACHABLE if there is no way
+    int GetDistance(int x, int y) const { return distances[y * w + x]; }
+    FlowDirection GetDirection(int x, int y) const { return directions[y * w + x]; }
+    // false at the goal and where the goal can't be reached
+    bool GetNextTile(int x, int y, TileCoords* next) const;
+};
+
+// flow fields by goal, least recently used ones are dropped when there are too many.
+// fields are kept up to date as long as every tile change is reported with OnTileChanged
+class FlowFieldCache
+{
+private:
+    // field computed on a worker from a copy of the grid
+    struct AsyncBuild
+    {
+        std::unique_ptr<FlowField> field;
+        std::atomic<bool> done;
+    };
+
+    struct Entry
+    {
+        int goalX;
+        int goalY;
+        int unitW;
+        uint64_t lastUse;
+        std::unique_ptr<FlowField> field;
+        std::shared_ptr<AsyncBuild> build;
+        std::vector<TileCoords> changesDuringBuild;
+    };
+
+    const WalkabilityGrid* grid;
+    size_t capacity;
+    uint64_t useCounter;
+    std::vector<Entry> entries;
+
+    Entry* Find(int goal_x, int goal_y, int unit_w);
+    Entry* Add(int goal_x, int goal_y, int unit_w);
+    // take over the field if the worker is done with it
+    void Collect(Entry* entry);
+
+public:
+    FlowFieldCache(const WalkabilityGrid* _grid, size_t _capacity = 16);
+
+    // computed right away if not cached
+    const FlowField* Get(int goal_x, int goal_y, int unit_w = 1);
+    // computed on the pool if not cached, nullptr until it's ready
+    const FlowField* GetAsync(int goal_x, int goal_y, int unit_w, EngineRoutines::ThreadPool* pool);
+
+    void OnTileChanged(int x, int y);
+    void Clear();
+};
+
+#endif
@@ -21,6 +21,9 @@ OTHER DEALINGS IN THE SOFTWARE.
 #include "countdown.h"
 #include <vector>
 #include <string>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "thirdparty\stb_image.h"
@@ -64,6 +67,11 @@ Graph::Graph(int _w, int _h, int _screen_w, int _screen_h, const std::string& ca
     , postProcFlip(SDL_FLIP_VERTICAL)
     , prevX(0)
     , prevY(0)
+    , batchBufferCapacity(0)
+    , batchTexture(nullptr)
+    , buildPixelMasks(false)
+    , pixelMaskScale(1)
+    , pixelMaskAlphaThreshold(0)
 {
     SDL_SetAssertionHandler(EngineRoutines::handler, NULL);
 
@@ -114,6 +122,8 @@ Graph::Graph(int _w, int _h, int _screen_w, int _screen_h, const std::string& ca
     //glBindAttribLocation(scenePostProcessingShader, 1, "vertexUV");
 
     defaultSceneProcessingShader = scenePostProcessingShader;
+
+    batchProgramId = LoadShaders("effects/batchv.glsl", "effects/batchf.glsl");
     //scenePostProcessingShader = textureProgramId;
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -127,6 +137,8 @@ Graph::Graph(int _w, int _h, int _screen_w, int _screen_h, const std::string& ca
     glBindBuffer(GL_ARRAY_BUFFER, texVertBuffer);
     glBufferData(GL_ARRAY_BUFFER, sizeof(texVertBuffData), texVertBuffData, GL_DYNAMIC_DRAW);
 
+    glGenBuffers(1, &batchBuffer);
+
     RegenFrameBuffer();
     GLenum DrawBuffers[1] = {GL_COLOR_ATTACHMENT0};
 
@@ -224,6 +236,17 @@ GLfloat Graph::AdjustMouseY(int my) const
     return orthoTop + (( (GLfloat)my / screenH) * (orthoBottom - orthoTop));
 }
 
+SDL_Rect Graph::GetVisibleArea() const
+{
+    // ortho bounds can be swapped if the margin is negative
+    GLfloat left = std::min(orthoLeft, orthoRight);
+    GLfloat top = std::min(orthoTop, orthoBottom);
+    return SDL_Rect{ (int)std::floor(left),
+                     (int)std::floor(top),
+                     (int)std::ceil(std::abs(orthoRight - orthoLeft)),
+                     (int)std::ceil(std::abs(orthoBottom - orthoTop)) };
+}
+
 void Graph::FlushTextures(GLuint texId, SDL_RendererFlip flip)
 {
     FlushTextures(textureProgramId, texId, flip);
@@ -300,8 +323,10 @@ Graph::~Graph()
     }
     glDeleteBuffers(1, &vertexBuffer);
     glDeleteBuffers(1, &texVertBuffer);
+    glDeleteBuffers(1, &batchBuffer);
 
     glDeleteProgram(textureProgramId);
+    glDeleteProgram(batchProgramId);
     glDeleteProgram(outlineProgramId);
     glDeleteProgram(shapeProgramId);
     glDeleteProgram(scenePostProcessingShader);
@@ -510,17 +535,9 @@ void Graph::WriteText(TTF_Font* f, const std::string& str, int x, int y, const S
         return;
     }
 
-    GLuint texture;
-    glEnable(GL_TEXTURE_2D);
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
-
     SDL_Surface* message = TTF_RenderText_Blended(f, str.c_str(), color);
     SDL_assert_release(message != NULL);
-    
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, message->w, message->h, 0, GL_BGRA, GL_UNSIGNED_BYTE, message->pixels);
+    GLuint texture = CreateTextureFromSurface(message);
 
     texVertBuffData[0] = TexturedVertex((GLfloat)x, (GLfloat)y, 0.0f, 0.0f, 0.0f);
     texVertBuffData[1] = TexturedVertex((GLfloat)x, (GLfloat)y + message->h * scale, 0.0f, 0.0f, 1.0f);
@@ -532,9 +549,6 @@ void Graph::WriteText(TTF_Font* f, const std::string& str, int x, int y, const S
 
     textureVertexAmount = 6;
 
-    glDisable(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
     // Since SDL text ignores alpha color value
     PushAlpha(color.a / 255.0f);
     FlushTextures(texture, SDL_FLIP_NONE);
@@ -597,15 +611,7 @@ void Graph::WriteParagraph(const FontDescriptor& fontHandler, const std::string&
     SDL_Surface* message = TTF_RenderText_Blended_Wrapped(fonts[fontHandler.tableId], str.c_str(), color, maxW);
     SDL_assert_release(message != NULL);
     lastWrittenParagraphH = message->h;
-
-    GLuint texture;
-    glEnable(GL_TEXTURE_2D);
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, message->w, message->h, 0, GL_BGRA, GL_UNSIGNED_BYTE, message->pixels);
+    GLuint texture = CreateTextureFromSurface(message);
 
     texVertBuffData[0] = TexturedVertex((GLfloat)x, (GLfloat)y, 0.0f, 0.0f, 0.0f);
     texVertBuffData[1] = TexturedVertex((GLfloat)x, (GLfloat)y + message->h, 0.0f, 0.0f, 1.0f);
@@ -617,9 +623,6 @@ void Graph::WriteParagraph(const FontDescriptor& fontHandler, const std::string&
 
     textureVertexAmount = 6;
 
-    glDisable(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
     // Since SDL text ignores alpha color value
     PushAlpha(color.a / 255.0f);
 
@@ -635,6 +638,109 @@ int Graph::GetLastWrittenParagraphH() const
     return lastWrittenParagraphH;
 }
 
+GLuint Graph::CreateTextureFromSurface(SDL_Surface* surface)
+{
+    // surfaces from SDL_ttf are ARGB
+    GLuint texture;
+    glEnable(GL_TEXTURE_2D);
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, surface->w, surface->h, 0, GL_BGRA, GL_UNSIGNED_BYTE, surface->pixels);
+
+    glDisable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texture;
+}
+
+TextureRecord* Graph::CreateTextureRecord(SDL_Surface* surface)
+{
+    TextureRecord* rec = new TextureRecord;
+    rec->w = surface->w;
+    rec->h = surface->h;
+    rec->texId = CreateTextureFromSurface(surface);
+    SDL_FreeSurface(surface);
+    return rec;
+}
+
+TextureRecord* Graph::RenderText(const FontDescriptor& fontHandler, const std::string& str, const SDL_Color& color)
+{
+    // SDL_ttf cannot render empty string
+    SDL_Surface* message = TTF_RenderText_Blended(fonts[fontHandler.tableId], str.empty() ? " " : str.c_str(), color);
+    SDL_assert_release(message != NULL);
+    return CreateTextureRecord(message);
+}
+
+// Straight alpha "over" of an ARGB8888 surface onto another at (x, y). SDL_BLENDMODE_BLEND doesn't scale the
+// destination colour by its own alpha, which on a transparent surface leaves dark, jagged edges
+static void BlendSurfaceOver(const SDL_Surface* src, SDL_Surface* dst, int x, int y)
+{
+    int w = std::min(src->w, dst->w - x);
+    int h = std::min(src->h, dst->h - y);
+    for (int row = 0; row < h; row++)
+    {
+        const Uint32* srcPixel = reinterpret_cast<const Uint32*>(static_cast<const Uint8*>(src->pixels) + row * src->pitch);
+        Uint32* dstPixel = reinterpret_cast<Uint32*>(static_cast<Uint8*>(dst->pixels) + (row + y) * dst->pitch) + x;
+        for (int col = 0; col < w; col++)
+        {
+            Uint32 s = srcPixel[col];
+            Uint32 d = dstPixel[col];
+            Uint32 srcA = s >> 24;
+            if (srcA == 0)
+            {
+                continue;
+            }
+
+            // weights in 0..255 * 255: source sa, destination da * (1 - sa)
+            Uint32 srcWeight = srcA * 255;
+            Uint32 dstWeight = (d >> 24) * (255 - srcA);
+            Uint32 outWeight = srcWeight + dstWeight;
+            Uint32 result = ((outWeight + 127) / 255) << 24;
+            for (int shift = 0; shift < 24; shift += 8)
+            {
+                Uint32 channel = (((s >> shift) & 0xFF) * srcWeight + ((d >> shift) & 0xFF) * dstWeight + outWeight / 2) / outWeight;
+                result |= channel << shift;
+            }
+            dstPixel[col] = result;
+        }
+    }
+}
+
+TextureRecord* Graph::RenderBorderedText(const FontDescriptor& fontHandler, const std::string& str, const SDL_Color& color, const SDL_Color& borderColor)
+{
+    const char* text = str.empty() ? " " : str.c_str();
+    SDL_Surface* border = TTF_RenderText_Blended(fonts[fontHandler.tableId], text, borderColor);
+    SDL_Surface* message = TTF_RenderText_Blended(fonts[fontHandler.tableId], text, color);
+    SDL_assert_release(border != NULL && message != NULL);
+
+    // same layout as WriteBorderedText: border shifted by 1px in each direction, text on top
+    SDL_Surface* result = SDL_CreateRGBSurface(0, message->w + 2, message->h + 2, 32, 0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
+    SDL_assert_release(result != NULL);
+    // blended text and new surfaces are ARGB8888 and never RLE encoded, so the pixels can be written directly
+    SDL_assert_release(border->format->format == SDL_PIXELFORMAT_ARGB8888 && message->format->format == SDL_PIXELFORMAT_ARGB8888);
+
+    const int borderOffsets[][2] = { { 0, 1 }, { 2, 1 }, { 1, 0 }, { 1, 2 } };
+    for (size_t i = 0; i < sizeof(borderOffsets) / sizeof(*borderOffsets); i++)
+    {
+        BlendSurfaceOver(border, result, borderOffsets[i][0], borderOffsets[i][1]);
+    }
+    BlendSurfaceOver(message, result, 1, 1);
+
+    SDL_FreeSurface(border);
+    SDL_FreeSurface(message);
+    return CreateTextureRecord(result);
+}
+
+TextureRecord* Graph::RenderParagraph(const FontDescriptor& fontHandler, const std::string& str, int maxW, const SDL_Color& color)
+{
+    SDL_Surface* message = TTF_RenderText_Blended_Wrapped(fonts[fontHandler.tableId], str.empty() ? " " : str.c_str(), color, maxW);
+    SDL_assert_release(message != NULL);
+    lastWrittenParagraphH = message->h;
+    return CreateTextureRecord(message);
+}
+
 void Graph::GetTextSize(const FontDescriptor& fontHandler, const std::string& str, int* w, int* h)
 {
     SDL_assert_release(TTF_SizeText(fonts[fontHandler.tableId], str.c_str(), w, h) == 0);
@@ -839,6 +945,83 @@ void Graph::DrawScene(GLuint shaderProgramId)
     FlushTextures(shaderProgramId, frameBufferTexture.texId, SDL_FLIP_NONE, false);
 }
 
+void Graph::BeginBatch(sprite_id texture)
+{
+    if (batchBuffData.empty() == false)
+    {
+        FlushBatch();
+    }
+
+    batchTexture = GetTexture(texture);
+    SDL_assert_release(batchTexture);
+}
+
+void Graph::BatchQuad(GLfloat x, GLfloat y, GLfloat w, GLfloat h, GLfloat u0, GLfloat v0, GLfloat u1, GLfloat v1, const GraphColor& c)
+{
+    ColoredTexturedVertex topLeft{ x, y, 0.0f, u0, v0, c.r, c.g, c.b, c.a };
+    ColoredTexturedVertex bottomLeft{ x, y + h, 0.0f, u0, v1, c.r, c.g, c.b, c.a };
+    ColoredTexturedVertex topRight{ x + w, y, 0.0f, u1, v0, c.r, c.g, c.b, c.a };
+    ColoredTexturedVertex bottomRight{ x + w, y + h, 0.0f, u1, v1, c.r, c.g, c.b, c.a };
+
+    // same triangle layout as in DrawTexture
+    batchBuffData.push_back(topLeft);
+    batchBuffData.push_back(bottomLeft);
+    batchBuffData.push_back(topRight);
+    batchBuffData.push_back(bottomLeft);
+    batchBuffData.push_back(bottomRight);
+    batchBuffData.push_back(topRight);
+}
+
+void Graph::FlushBatch()
+{
+    if (batchBuffData.empty() || batchTexture == nullptr)
+    {
+        batchBuffData.clear();
+        return;
+    }
+
+    glEnable(GL_TEXTURE_2D);
+    glUseProgram(batchProgramId);
+    glUniformMatrix4fv(glGetUniformLocation(batchProgramId, "MVP"), 1, GL_FALSE, orthoProj);
+
+    glBindBuffer(GL_ARRAY_BUFFER, batchBuffer);
+    if (batchBuffData.size() > batchBufferCapacity)
+    {
+        batchBufferCapacity = batchBuffData.capacity();
+        glBufferData(GL_ARRAY_BUFFER, batchBufferCapacity * sizeof(ColoredTexturedVertex), nullptr, GL_DYNAMIC_DRAW);
+    }
+    glBufferSubData(GL_ARRAY_BUFFER, 0, batchBuffData.size() * sizeof(ColoredTexturedVertex), batchBuffData.data());
+
+    GLint positionAttrib = glGetAttribLocation(batchProgramId, "vertexPosition_modelspace");
+    GLint uvAttrib = glGetAttribLocation(batchProgramId, "vertexUV");
+    GLint colorAttrib = glGetAttribLocation(batchProgramId, "vertexColor");
+
+    glEnableVertexAttribArray(positionAttrib);
+    glVertexAttribPointer(positionAttrib, 3, GL_FLOAT, GL_FALSE, sizeof(ColoredTexturedVertex), (void*)offsetof(ColoredTexturedVertex, x));
+    glEnableVertexAttribArray(uvAttrib);
+    glVertexAttribPointer(uvAttrib, 2, GL_FLOAT, GL_FALSE, sizeof(ColoredTexturedVertex), (void*)offsetof(ColoredTexturedVertex, u));
+    glEnableVertexAttribArray(colorAttrib);
+    glVertexAttribPointer(colorAttrib, 4, GL_FLOAT, GL_FALSE, sizeof(ColoredTexturedVertex), (void*)offsetof(ColoredTexturedVertex, r));
+
+    glBindTexture(GL_TEXTURE_2D, batchTexture->texId);
+    glUniform1i(glGetUniformLocation(batchProgramId, "sampler"), 0);
+    glUniform4f(glGetUniformLocation(batchProgramId, "colorMod"),
+                textureColorValues.top().r,
+                textureColorValues.top().g,
+                textureColorValues.top().b,
+                alphaValues.top());
+
+    glDrawArrays(GL_TRIANGLES, 0, (GLsizei)batchBuffData.size());
+
+    glDisableVertexAttribArray(positionAttrib);
+    glDisableVertexAttribArray(uvAttrib);
+    glDisableVertexAttribArray(colorAttrib);
+
+    batchBuffData.clear();
+    glDisable(GL_TEXTURE_2D);
+    glUseProgram(0);
+}
+
 TextureRecord* Graph::GetTexture(sprite_id id) const
 {
     if (spriteList.size() > id)
@@ -916,6 +1099,12 @@ sprite_id Graph::LoadTexture(std::string filename)
         {
             glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, rec->w, rec->h, 0, GL_RGBA, GL_UNSIGNED_BYTE, img);
         }
+
+        if (buildPixelMasks)
+        {
+            pixelMasks.resize(spriteList.size() + 1);
+            pixelMasks.back().reset(new PixelMask(img, gw, gh, pixelMaskAlphaThreshold, pixelMaskScale));
+        }
         spriteList.push_back(std::move(rec));
 
         glBindTexture(GL_TEXTURE_2D, 0);
@@ -973,6 +1162,47 @@ void Graph::FreeTextures()
 {
     spriteList.clear();
     preloadedSprites.clear();
+    pixelMasks.clear();
+    framePixelMasks.clear();
+}
+
+void Graph::SetPixelMaskBuilding(bool enabled, size_t scale, unsigned char alpha_threshold)
+{
+    SDL_assert_release(scale > 0);
+    buildPixelMasks = enabled;
+    pixelMaskScale = scale;
+    pixelMaskAlphaThreshold = alpha_threshold;
+}
+
+const PixelMask* Graph::GetPixelMask(sprite_id id) const
+{
+    if (id < pixelMasks.size())
+    {
+        return pixelMasks[id].get();
+    }
+
+    return nullptr;
+}
+
+const PixelMask* Graph::GetPixelMask(sprite_id id, const SDL_Rect& frame)
+{
+    const PixelMask* sheet = GetPixelMask(id);
+    if (sheet == nullptr)
+    {
+        return nullptr;
+    }
+
+    // frames are cut out of the sheet mask once and reused
+    auto key = std::make_tuple(id, frame.x, frame.y, frame.w, frame.h);
+    auto found = framePixelMasks.find(key);
+    if (found != framePixelMasks.end())
+    {
+        return found->second.get();
+    }
+
+    PixelMask* mask = new PixelMask(*sheet, frame.x, frame.y, frame.w, frame.h);
+    framePixelMasks[key].reset(mask);
+    return mask;
 }
 
 void Graph::ApplyFilter(int x, int y, size_t w, size_t h, SDL_Color& color)
@@ -21,6 +21,7 @@ OTHER DEALINGS IN THE SOFTWARE.
 #define __GRAPH_H__
 
 #include "routines.h"
+#include "pixelmask.h"
 
 #include "..\SDL2\include\SDL.h"
 #include "..\SDL2\include\SDL_ttf.h"
@@ -33,6 +34,9 @@ OTHER DEALINGS IN THE SOFTWARE.
 #include <vector>
 #include <unordered_map>
 #include <stack>
+#include <map>
+#include <memory>
+#include <tuple>
 
 typedef unsigned int sprite_id;
 
@@ -113,6 +117,20 @@ struct GraphColor
     GLfloat a;
 };
 
+// vertex of the sprite batch, color is multiplied with the texture
+struct ColoredTexturedVertex
+{
+    GLfloat x;
+    GLfloat y;
+    GLfloat z;
+    GLfloat u;
+    GLfloat v;
+    GLfloat r;
+    GLfloat g;
+    GLfloat b;
+    GLfloat a;
+};
+
 class Graph
 {
 private:
@@ -140,6 +158,12 @@ private:
     TexturedVertex texVertBuffData[MAX_BUFF_LEN];
     GLuint texVertBuffer;
 
+    // quads with the same texture, drawn with a single call, see BeginBatch()
+    std::vector<ColoredTexturedVertex> batchBuffData;
+    size_t batchBufferCapacity; // in vertices, allocated on GPU
+    GLuint batchBuffer;
+    TextureRecord* batchTexture;
+
 
     SDL_Window* screen;
     SDL_DisplayMode displayMode;
@@ -149,6 +173,13 @@ private:
 
     std::vector<std::auto_ptr<TextureRecord>> spriteList;
     TextureIdMap preloadedSprites;
+
+    // collision masks built from the alpha channel at load time, by sprite_id and by animation frame
+    bool buildPixelMasks;
+    size_t pixelMaskScale;
+    unsigned char pixelMaskAlphaThreshold;
+    std::vector<std::unique_ptr<PixelMask>> pixelMasks;
+    std::map<std::tuple<sprite_id, int, int, int, int>, std::unique_ptr<PixelMask>> framePixelMasks;
     FontList fonts;
 
     std::stack<GLfloat> alphaValues;
@@ -171,6 +202,7 @@ private:
     GLuint textureProgramId;
     GLuint defaultSceneProcessingShader;
     GLuint scenePostProcessingShader;
+    GLuint batchProgramId;
 
     GLuint frameBuffer;
     TextureRecord frameBufferTexture;
@@ -191,6 +223,9 @@ public:
     GLfloat AdjustMouseX(int mx) const;
     GLfloat AdjustMouseY(int my) const;
 
+    // logical coordinates of the area that is currently visible on the screen
+    SDL_Rect GetVisibleArea() const;
+
     void FlushTextures(GLuint texId, SDL_RendererFlip flip);
     void FlushTextures(GLuint program, GLuint texId, SDL_RendererFlip flip, bool useCustomOrtho = true);
     void FlushBasicShape(const GraphColor& color, GLenum mode);
@@ -228,6 +263,12 @@ public:
 
     int GetLastWrittenParagraphH() const;
 
+    // rasterize the text once into a texture that can be drawn many times, caller owns the result
+    // bordered text texture has 1px margin for the border on each side
+    TextureRecord* RenderText(const FontDescriptor& fontHandler, const std::string& str, const SDL_Color& color);
+    TextureRecord* RenderBorderedText(const FontDescriptor& fontHandler, const std::string& str, const SDL_Color& color, const SDL_Color& borderColor);
+    TextureRecord* RenderParagraph(const FontDescriptor& fontHandler, const std::string& str, int maxW, const SDL_Color& color);
+
     void DrawRect(int x, int y, size_t w, size_t h, const GraphColor& color);
     void DrawBorders(int x, int y, size_t w, size_t h, size_t thickness, const GraphColor& color);
 
@@ -251,6 +292,12 @@ public:
 
     void DrawScene(GLuint shaderProgramId);
 
+    // sprite batch: all quads until FlushBatch() are drawn with one draw call
+    // uv are in texture coordinates [0..1], color is multiplied with the current alpha and texture color values
+    void BeginBatch(sprite_id texture);
+    void BatchQuad(GLfloat x, GLfloat y, GLfloat w, GLfloat h, GLfloat u0, GLfloat v0, GLfloat u1, GLfloat v1, const GraphColor& color);
+    void FlushBatch();
+
     void DrawTextureStretched(TextureRecord* texture); //fullscreen
     void DrawTextureStretched(GLfloat tx, GLfloat ty, GLfloat tw, GLfloat th, TextureRecord* texture); //fixed width
     void DrawTextureStretched(GLuint shaderProgramId, GLfloat tx, GLfloat ty, GLfloat tw, GLfloat th, TextureRecord* texture); //fixed width
@@ -261,6 +308,12 @@ public:
     void GetTextureSize(sprite_id id, size_t* w, size_t* h) const;
     void FreeTextures();
 
+    // textures loaded after enabling get a pixel mask, one bit per scale x scale pixels with alpha above the threshold
+    void SetPixelMaskBuilding(bool enabled, size_t scale = 1, unsigned char alpha_threshold = 0);
+    // nullptr if the texture was loaded without a mask
+    const PixelMask* GetPixelMask(sprite_id id) const;
+    const PixelMask* GetPixelMask(sprite_id id, const SDL_Rect& frame);
+
     void LoadFontToDesc(FontDescriptor* desc);
 
     void FreeFonts();
@@ -291,6 +344,8 @@ public:
 
 private:
     void WriteText(TTF_Font* f, const std::string& str, int x, int y, const SDL_Color& color, GLfloat scale = 1.0f);
+    GLuint CreateTextureFromSurface(SDL_Surface* surface);
+    TextureRecord* CreateTextureRecord(SDL_Surface* surface);
     void RegenFrameBuffer();
 };
 
@@ -0,0 +1,621 @@
+/*
+Author: Vladimir Slav
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "hierarchicalpathfinder.h"
+#include "..\SDL2\include\SDL.h"
+
+namespace
+{
+    // edge from the start or to the destination, through one of their seed tiles
+    struct SeedEdge
+    {
+        int node;
+        int cost;
+        int seed;
+    };
+
+    // query memory of the calling thread
+    struct HierarchicalScratch
+    {
+        AstarNodes abstractNodes;
+        std::vector<int> distances;
+        std::vector<int> queue;
+        std::vector<std::pair<int, int>> startSeeds; // tile, cost
+        std::vector<std::pair<int, int>> destSeeds;
+        std::vector<SeedEdge> startEdges;
+        std::vector<SeedEdge> destEdges; // by node, cost -1 outside of queries
+        tile_list waypoints;
+        tile_list segment;
+    };
+
+    HierarchicalScratch& GetScratch()
+    {
+        static thread_local HierarchicalScratch scratch;
+        return scratch;
+    }
+
+    // breadth first search over the tiles of the cluster the unit fits on, starting from x, y.
+    // goal is entered even if the unit doesn't fit there, like the destination of a path
+    template <typename Fits> void ClusterDistances(const HierarchicalCluster& cluster,
+                                                   Fits fits,
+                                                   int x,
+                                                   int y,
+                                                   int goal_x,
+                                                   int goal_y,
+                                                   std::vector<int>* distances,
+                                                   std::vector<int>* queue)
+    {
+        distances->assign(cluster.w * cluster.h, -1);
+        queue->clear();
+
+        int start = (y - cluster.y) * cluster.w + (x - cluster.x);
+        (*distances)[start] = 0;
+        queue->push_back(start);
+
+        static const int neighbourX[] = { -1, 1, 0, 0 };
+        static const int neighbourY[] = { 0, 0, -1, 1 };
+        for (size_t i = 0; i < queue->size(); i++)
+        {
+            int current = (*queue)[i];
+            int currentX = current % cluster.w;
+            int currentY = current / cluster.w;
+            for (int j = 0; j < 4; j++)
+            {
+                int adjX = currentX + neighbourX[j];
+                int adjY = currentY + neighbourY[j];
+                if (areValidCoordinates(adjX, adjY, cluster.w, cluster.h) == false)
+                {
+                    continue;
+                }
+
+                int adjacent = adjY * cluster.w + adjX;
+                if ((*distances)[adjacent] >= 0)
+                {
+                    continue;
+                }
+
+                int mapX = cluster.x + adjX;
+                int mapY = cluster.y + adjY;
+                if ((mapX != goal_x || mapY != goal_y) && fits(mapX, mapY) == false)
+                {
+                    continue;
+                }
+
+                (*distances)[adjacent] = (*distances)[current] + 1;
+                queue->push_back(adjacent);
+            }
+        }
+    }
+}
+
+HierarchicalPathfinder::HierarchicalPathfinder(const WalkabilityGrid* _grid, int cluster_size, int unit_w)
+    : grid(_grid)
+    , clusterSize(cluster_size)
+    , unitW(unit_w)
+    , rebuiltClusters(0)
+    , built(false)
+{
+    SDL_assert_release(grid != nullptr && clusterSize > 0);
+
+    clustersW = (grid->GetWidth() + clusterSize - 1) / clusterSize;
+    clustersH = (grid->GetHeight() + clusterSize - 1) / clusterSize;
+    clusters.resize(clustersW * clustersH);
+    for (int cy = 0; cy < clustersH; cy++)
+    {
+        for (int cx = 0; cx < clustersW; cx++)
+        {
+            HierarchicalCluster& cluster = clusters[cy * clustersW + cx];
+            cluster.x = cx * clusterSize;
+            cluster.y = cy * clusterSize;
+            cluster.w = std::min(clusterSize, grid->GetWidth() - cluster.x);
+            cluster.h = std::min(clusterSize, grid->GetHeight() - cluster.y);
+            cluster.firstNode = 0;
+            cluster.nodeAmount = 0;
+            cluster.dirty = true;
+        }
+    }
+
+    Update();
+}
+
+bool HierarchicalPathfinder::IsInCluster(int cluster, int x, int y) const
+{
+    const HierarchicalCluster& c = clusters[cluster];
+    return x >= c.x && y >= c.y && x < c.x + c.w && y < c.y + c.h;
+}
+
+void HierarchicalPathfinder::OnTileChanged(int x, int y)
+{
+    // the clearance changed for the units standing up to unitW - 1 tiles to the left as well
+    for (int tileX = std::max(0, x - unitW + 1); tileX <= x; tileX++)
+    {
+        clusters[GetClusterAt(tileX, y)].dirty = true;
+    }
+}
+
+void HierarchicalPathfinder::AddEntrances(int x, int y, int dx, int dy, int length, int first_cluster, int second_cluster)
+{
+    int offsets[2] = { length / 2, 0 };
+    int amount = 1;
+    if (length >= ENTRANCE_SPLIT)
+    {
+        offsets[0] = 0;
+        offsets[1] = length - 1;
+        amount = 2;
+    }
+
+    int w = grid->GetWidth();
+    for (int i = 0; i < amount; i++)
+    {
+        int tileX = x + dx * offsets[i];
+        int tileY = y + dy * offsets[i];
+        // the border runs along dx, dy, the other side is across it
+        int first = tileY * w + tileX;
+        int second = (tileY + dx) * w + tileX + dy;
+        entranceTiles[first_cluster].push_back(first);
+        entranceTiles[second_cluster].push_back(second);
+        entrancePairs.push_back(std::make_pair(first, second));
+    }
+}
+
+void HierarchicalPathfinder::FindEntrances()
+{
+    entranceTiles.resize(clusters.size());
+    for (auto& tiles : entranceTiles)
+    {
+        tiles.clear();
+    }
+    entrancePairs.clear();
+
+    for (int cy = 0; cy < clustersH; cy++)
+    {
+        for (int cx = 0; cx < clustersW; cx++)
+        {
+            int index = cy * clustersW + cx;
+            const HierarchicalCluster& cluster = clusters[index];
+
+            // border with the cluster to the right
+            if (cx + 1 < clustersW)
+            {
+                int x = cluster.x + cluster.w - 1;
+                int runStart = -1;
+                for (int y = cluster.y; y <= cluster.y + cluster.h; y++)
+                {
+                    bool open = y < cluster.y + cluster.h && Fits(x, y) && Fits(x + 1, y);
+                    if (open && runStart < 0)
+                    {
+                        runStart = y;
+                    }
+                    else if (open == false && runStart >= 0)
+                    {
+                        AddEntrances(x, runStart, 0, 1, y - runStart, index, index + 1);
+                        runStart = -1;
+                    }
+                }
+            }
+
+            // border with the cluster below
+            if (cy + 1 < clustersH)
+            {
+                int y = cluster.y + cluster.h - 1;
+                int runStart = -1;
+                for (int x = cluster.x; x <= cluster.x + cluster.w; x++)
+                {
+                    bool open = x < cluster.x + cluster.w && Fits(x, y) && Fits(x, y + 1);
+                    if (open && runStart < 0)
+                    {
+                        runStart = x;
+                    }
+                    else if (open == false && runStart >= 0)
+                    {
+                        AddEntrances(runStart, y, 1, 0, x - runStart, index, index + clustersW);
+                        runStart = -1;
+                    }
+                }
+            }
+        }
+    }
+}
+
+void HierarchicalPathfinder::ComputeDistances(HierarchicalCluster* cluster)
+{
+    int w = grid->GetWidth();
+    int amount = static_cast<int>(cluster->nodeTiles.size());
+    cluster->distances.assign(amount * amount, -1);
+
+    auto fits = [this](int x, int y) { return Fits(x, y); };
+    for (int i = 0; i < amount; i++)
+    {
+        int tile = cluster->nodeTiles[i];
+        ClusterDistances(*cluster, fits, tile % w, tile / w, -1, -1, &bfsDistances, &bfsQueue);
+        for (int j = 0; j < amount; j++)
+        {
+            int other = cluster->nodeTiles[j];
+            int local = (other / w - cluster->y) * cluster->w + (other % w - cluster->x);
+            cluster->distances[i * amount + j] = bfsDistances[local];
+        }
+    }
+}
+
+int HierarchicalPathfinder::FindNode(int cluster, int tile) const
+{
+    const HierarchicalCluster& c = clusters[cluster];
+    auto it = std::lower_bound(c.nodeTiles.begin(), c.nodeTiles.end(), tile);
+    SDL_assert_release(it != c.nodeTiles.end() && *it == tile);
+    return c.firstNode + static_cast<int>(it - c.nodeTiles.begin());
+}
+
+void HierarchicalPathfinder::Update()
+{
+    bool dirty = built == false;
+    for (const auto& cluster : clusters)
+    {
+        dirty = dirty || cluster.dirty;
+    }
+    if (dirty == false)
+    {
+        return;
+    }
+
+    // borders are cheap to scan again, distances are only recomputed where nodes or tiles changed
+    FindEntrances();
+
+    int w = grid->GetWidth();
+    nodes.clear();
+    for (size_t i = 0; i < clusters.size(); i++)
+    {
+        HierarchicalCluster& cluster = clusters[i];
+        std::vector<int>& tiles = entranceTiles[i];
+        std::sort(tiles.begin(), tiles.end());
+        tiles.erase(std::unique(tiles.begin(), tiles.end()), tiles.end());
+
+        if (cluster.dirty || tiles != cluster.nodeTiles)
+        {
+            cluster.nodeTiles.swap(tiles);
+            ComputeDistances(&cluster);
+            rebuiltClusters++;
+        }
+        cluster.dirty = false;
+
+        cluster.firstNode = static_cast<int>(nodes.size());
+        cluster.nodeAmount = static_cast<int>(cluster.nodeTiles.size());
+        for (int tile : cluster.nodeTiles)
+        {
+            HierarchicalNode node = { tile % w, tile / w, static_cast<int>(i), 0, 0 };
+            nodes.push_back(node);
+        }
+    }
+
+    // entrances as peer lists, counted first so they can be stored in one array
+    for (const auto& pair : entrancePairs)
+    {
+        nodes[FindNode(GetClusterAt(pair.first % w, pair.first / w), pair.first)].peerAmount++;
+        nodes[FindNode(GetClusterAt(pair.second % w, pair.second / w), pair.second)].peerAmount++;
+    }
+
+    int total = 0;
+    for (auto& node : nodes)
+    {
+        node.firstPeer = total;
+        total += node.peerAmount;
+        node.peerAmount = 0;
+    }
+
+    peers.resize(total);
+    for (const auto& pair : entrancePairs)
+    {
+        int first = FindNode(GetClusterAt(pair.first % w, pair.first / w), pair.first);
+        int second = FindNode(GetClusterAt(pair.second % w, pair.second / w), pair.second);
+        peers[nodes[first].firstPeer + nodes[first].peerAmount++] = second;
+        peers[nodes[second].firstPeer + nodes[second].peerAmount++] = first;
+    }
+
+    built = true;
+}
+
+bool HierarchicalPathfinder::FindWaypoints(int xStart, int yStart, int xDest, int yDest, tile_list* waypoints) const
+{
+    waypoints->clear();
+
+    int w = grid->GetWidth();
+    if (areValidCoordinates(xStart, yStart, w, grid->GetHeight()) == false ||
+        areValidCoordinates(xDest, yDest, w, grid->GetHeight()) == false)
+    {
+        return false;
+    }
+
+    HierarchicalScratch& scratch = GetScratch();
+    auto fits = [this](int x, int y) { return Fits(x, y); };
+
+    // start and destination aren't nodes, and the unit doesn't have to fit on them, so they may be
+    // left or entered straight across a cluster border. the tiles across count as extra seeds
+    SeedEdge direct = { -1, -1, -1 };
+    int directDestSeed = -1;
+    auto findSeeds = [&](int x, int y, std::vector<std::pair<int, int>>* seeds)
+    {
+        seeds->clear();
+        seeds->push_back(std::make_pair(y * w + x, 0));
+
+        static const int neighbourX[] = { -1, 1, 0, 0 };
+        static const int neighbourY[] = { 0, 0, -1, 1 };
+        for (int i = 0; i < 4; i++)
+        {
+            int adjX = x + neighbourX[i];
+            int adjY = y + neighbourY[i];
+            if (areValidCoordinates(adjX, adjY, w, grid->GetHeight()) == false ||
+                GetClusterAt(adjX, adjY) == GetClusterAt(x, y))
+            {
+                continue;
+            }
+
+            if (adjX == xDest && adjY == yDest)
+            {
+                direct.cost = 1;
+                direct.seed = y * w + x;
+                directDestSeed = adjY * w + adjX;
+            }
+            else if (Fits(adjX, adjY))
+            {
+                seeds->push_back(std::make_pair(adjY * w + adjX, 1));
+            }
+        }
+    };
+    findSeeds(xStart, yStart, &scratch.startSeeds);
+    findSeeds(xDest, yDest, &scratch.destSeeds);
+
+    // connect the start to the nodes of its clusters, and to the destination if it's close
+    scratch.startEdges.clear();
+    for (const auto& seed : scratch.startSeeds)
+    {
+        int cluster = GetClusterAt(seed.first % w, seed.first / w);
+        const HierarchicalCluster& c = clusters[cluster];
+        ClusterDistances(c, fits, seed.first % w, seed.first / w, xDest, yDest, &scratch.distances, &scratch.queue);
+        for (int i = 0; i < c.nodeAmount; i++)
+        {
+            const HierarchicalNode& node = nodes[c.firstNode + i];
+            int distance = scratch.distances[(node.y - c.y) * c.w + (node.x - c.x)];
+            if (distance >= 0)
+            {
+                SeedEdge edge = { c.firstNode + i, seed.second + distance, seed.first };
+                scratch.startEdges.push_back(edge);
+            }
+        }
+
+        for (const auto& destSeed : scratch.destSeeds)
+        {
+            int x = destSeed.first % w;
+            int y = destSeed.first / w;
+            int distance = IsInCluster(cluster, x, y) ? scratch.distances[(y - c.y) * c.w + (x - c.x)] : -1;
+            if (distance >= 0 && (direct.cost < 0 || seed.second + distance + destSeed.second < direct.cost))
+            {
+                direct.cost = seed.second + distance + destSeed.second;
+                direct.seed = seed.first;
+                directDestSeed = destSeed.first;
+            }
+        }
+    }
+
+    // and the nodes of the destination clusters to the destination
+    SeedEdge noEdge = { -1, -1, -1 };
+    scratch.destEdges.resize(nodes.size(), noEdge);
+    for (const auto& seed : scratch.destSeeds)
+    {
+        const HierarchicalCluster& c = clusters[GetClusterAt(seed.first % w, seed.first / w)];
+        ClusterDistances(c, fits, seed.first % w, seed.first / w, -1, -1, &scratch.distances, &scratch.queue);
+        for (int i = 0; i < c.nodeAmount; i++)
+        {
+            const HierarchicalNode& node = nodes[c.firstNode + i];
+            int distance = scratch.distances[(node.y - c.y) * c.w + (node.x - c.x)];
+            SeedEdge& edge = scratch.destEdges[c.firstNode + i];
+            if (distance >= 0 && (edge.cost < 0 || seed.second + distance < edge.cost))
+            {
+                edge.node = c.firstNode + i;
+                edge.cost = seed.second + distance;
+                edge.seed = seed.first;
+            }
+        }
+    }
+
+    // A* over the abstract graph, start and destination are the two extra nodes at the end
+    int startId = static_cast<int>(nodes.size());
+    int destId = startId + 1;
+    AstarNodes& abstractNodes = scratch.abstractNodes;
+    abstractNodes.Prepare(nodes.size() + 2, 1);
+    abstractNodes.Open(startId, 0, HFunc(xStart, yStart, xDest, yDest), -1);
+
+    auto relax = [&](int current, int next, int cost)
+    {
+        if (cost < 0 || abstractNodes.IsClosed(next))
+        {
+            return;
+        }
+
+        int G = abstractNodes.Get(current).G + cost;
+        if (abstractNodes.IsTouched(next) == false)
+        {
+            int H = next == destId ? 0 : HFunc(nodes[next].x, nodes[next].y, xDest, yDest);
+            abstractNodes.Open(next, G, H, current);
+        }
+        else if (G < abstractNodes.Get(next).G)
+        {
+            abstractNodes.Improve(next, G, current);
+        }
+    };
+
+    bool found = false;
+    while (abstractNodes.HasOpen())
+    {
+        int current = abstractNodes.PopBest();
+        if (current == destId)
+        {
+            // seeds other than start and destination themselves are waypoints too
+            auto addSeed = [&](int seed, int x, int y)
+            {
+                if (seed != y * w + x)
+                {
+                    waypoints->push_back({ seed % w, seed / w });
+                }
+            };
+
+            waypoints->push_back({ xDest, yDest });
+            int node = abstractNodes.Get(destId).parent;
+            if (node == startId)
+            {
+                addSeed(directDestSeed, xDest, yDest);
+                addSeed(direct.seed, xStart, yStart);
+            }
+            else
+            {
+                addSeed(scratch.destEdges[node].seed, xDest, yDest);
+                int last = node;
+                while (node != startId)
+                {
+                    waypoints->push_back({ nodes[node].x, nodes[node].y });
+                    last = node;
+                    node = abstractNodes.Get(node).parent;
+                }
+                for (const auto& edge : scratch.startEdges)
+                {
+                    if (edge.node == last && edge.cost == abstractNodes.Get(last).G)
+                    {
+                        addSeed(edge.seed, xStart, yStart);
+                        break;
+                    }
+                }
+            }
+            waypoints->push_back({ xStart, yStart });
+            std::reverse(waypoints->begin(), waypoints->end());
+            // a seed can be a node itself
+            waypoints->erase(std::unique(waypoints->begin(), waypoints->end()), waypoints->end());
+            found = true;
+            break;
+        }
+
+        if (current == startId)
+        {
+            for (const auto& edge : scratch.startEdges)
+            {
+                relax(current, edge.node, edge.cost);
+            }
+            relax(current, destId, direct.cost);
+            continue;
+        }
+
+        const HierarchicalNode& node = nodes[current];
+        const HierarchicalCluster& cluster = clusters[node.cluster];
+        int index = current - cluster.firstNode;
+        for (int i = 0; i < cluster.nodeAmount; i++)
+        {
+            if (i != index)
+            {
+                relax(current, cluster.firstNode + i, cluster.distances[index * cluster.nodeAmount + i]);
+            }
+        }
+        for (int i = 0; i < node.peerAmount; i++)
+        {
+            relax(current, peers[node.firstPeer + i], 1);
+        }
+        relax(current, destId, scratch.destEdges[current].cost);
+    }
+
+    // leave the destination costs clean for the next query
+    for (const auto& seed : scratch.destSeeds)
+    {
+        const HierarchicalCluster& c = clusters[GetClusterAt(seed.first % w, seed.first / w)];
+        std::fill(scratch.destEdges.begin() + c.firstNode, scratch.destEdges.begin() + c.firstNode + c.nodeAmount, noEdge);
+    }
+    return found;
+}
+
+bool HierarchicalPathfinder::RefineSegment(PathfinderContext* context, const TileCoords& from, const TileCoords& to, tile_list* segment) const
+{
+    segment->clear();
+    if (HFunc(from.x, from.y, to.x, to.y) == 1)
+    {
+        return true;
+    }
+
+    // consecutive waypoints are always in one cluster, the search doesn't have to leave it
+    int cluster = GetClusterAt(from.x, from.y);
+    auto fits = [this, cluster](int x, int y)
+    {
+        return IsInCluster(cluster, x, y) && Fits(x, y);
+    };
+    return context->FindPath(fits, from.x, from.y, to.x, to.y, false, segment);
+}
+
+bool HierarchicalPathfinder::FindPath(PathfinderContext* context,
+                                      int xStart,
+                                      int yStart,
+                                      int xDest,
+                                      int yDest,
+                                      bool include_destination,
+                                      tile_list* path) const
+{
+    path->clear();
+
+    if (areValidCoordinates(xStart, yStart, grid->GetWidth(), grid->GetHeight()) == false ||
+        areValidCoordinates(xDest, yDest, grid->GetWidth(), grid->GetHeight()) == false)
+    {
+        return false;
+    }
+
+    if ((include_destination && Fits(xDest, yDest) == false) || (xStart == xDest && yStart == yDest))
+    {
+        return false;
+    }
+
+    // short trips inside one cluster don't need the abstract graph
+    int startCluster = GetClusterAt(xStart, yStart);
+    if (startCluster == GetClusterAt(xDest, yDest))
+    {
+        auto fits = [this, startCluster](int x, int y)
+        {
+            return IsInCluster(startCluster, x, y) && Fits(x, y);
+        };
+        if (context->FindPath(fits, xStart, yStart, xDest, yDest, include_destination, path))
+        {
+            return true;
+        }
+    }
+
+    HierarchicalScratch& scratch = GetScratch();
+    if (FindWaypoints(xStart, yStart, xDest, yDest, &scratch.waypoints) == false)
+    {
+        return false;
+    }
+
+    // the path goes from the destination backwards, so the segments are refined last to first
+    const tile_list& waypoints = scratch.waypoints;
+    for (size_t i = waypoints.size() - 1; i > 0; i--)
+    {
+        if (i != waypoints.size() - 1 || include_destination)
+        {
+            path->push_back(waypoints[i]);
+        }
+
+        if (RefineSegment(context, waypoints[i - 1], waypoints[i], &scratch.segment) == false)
+        {
+            path->clear();
+            return false;
+        }
+        path->insert(path->end(), scratch.segment.begin(), scratch.segment.end());
+    }
+    return true;
+}
@@ -0,0 +1,121 @@
+/*
+Author: Vladimir Slav
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+ Hierarchical pathfinding (HPA*): the map is cut into square clusters. Wherever a cluster border
+ can be crossed there is an entrance, a pair of abstract nodes facing each other, and the distances
+ between the nodes of a cluster are precomputed. A query connects start and destination to the
+ nodes of their clusters, searches the small abstract graph and then refines every abstract edge
+ with an A* limited to one cluster. Paths are close to, but not always exactly, the shortest ones.
+
+ The abstract graph is built for one unit width over a WalkabilityGrid. After changing tiles, report
+ them with OnTileChanged and call Update before the next query; only the clusters whose tiles or
+ entrances changed get their distances recomputed.
+ Queries don't modify the pathfinder, many threads can search at once with their own contexts.
+*/
+
+#ifndef __HIERARCHICALPATHFINDER_H__
+#define __HIERARCHICALPATHFINDER_H__
+
+#include "walkabilitygrid.h"
+
+struct HierarchicalNode
+{
+    int x;
+    int y;
+    int cluster;
+    int firstPeer; // nodes in the neighbouring clusters one step away, in peers
+    int peerAmount;
+};
+
+struct HierarchicalCluster
+{
+    int x;
+    int y;
+    int w;
+    int h;
+    int firstNode;
+    int nodeAmount;
+    std::vector<int> nodeTiles; // sorted tile indices of the nodes
+    std::vector<int> distances; // nodeAmount x nodeAmount, -1 if not reachable inside the cluster
+    bool dirty;
+};
+
+class HierarchicalPathfinder
+{
+private:
+    // runs of open border shorter than this get one entrance in the middle, longer ones one at each end
+    static const int ENTRANCE_SPLIT = 6;
+
+    const WalkabilityGrid* grid;
+    int clusterSize;
+    int unitW;
+    int clustersW;
+    int clustersH;
+
+    std::vector<HierarchicalCluster> clusters;
+    std::vector<HierarchicalNode> nodes;
+    std::vector<int> peers;
+    size_t rebuiltClusters;
+    bool built;
+
+    // used while rebuilding
+    std::vector<std::vector<int>> entranceTiles;
+    std::vector<std::pair<int, int>> entrancePairs;
+    std::vector<int> bfsDistances;
+    std::vector<int> bfsQueue;
+
+    bool Fits(int x, int y) const { return grid->UnitFits(x, y, unitW); }
+    void AddEntrances(int x, int y, int dx, int dy, int length, int first_cluster, int second_cluster);
+    void FindEntrances();
+    void ComputeDistances(HierarchicalCluster* cluster);
+    int FindNode(int cluster, int tile) const;
+
+public:
+    HierarchicalPathfinder(const WalkabilityGrid* _grid, int cluster_size = 16, int unit_w = 1);
+
+    int GetClusterSize() const { return clusterSize; }
+    int GetUnitWidth() const { return unitW; }
+    int GetClusterAt(int x, int y) const { return (y / clusterSize) * clustersW + x / clusterSize; }
+    bool IsInCluster(int cluster, int x, int y) const;
+
+    size_t GetNodeAmount() const { return nodes.size(); }
+    // clusters that had their distances recomputed, over all updates
+    size_t GetRebuiltClusterAmount() const { return rebuiltClusters; }
+
+    // the tile changed in the grid, the clusters that depend on it get rebuilt on Update
+    void OnTileChanged(int x, int y);
+    void Update();
+
+    // tiles the path goes through on the abstract level, start and destination included, in walking order
+    bool FindWaypoints(int xStart, int yStart, int xDest, int yDest, tile_list* waypoints) const;
+    // tile path between two consecutive waypoints, in the Astar order without either end
+    bool RefineSegment(PathfinderContext* context, const TileCoords& from, const TileCoords& to, tile_list* segment) const;
+
+    // waypoints refined into a full path, same shape as the Astar one
+    bool FindPath(PathfinderContext* context,
+                  int xStart,
+                  int yStart,
+                  int xDest,
+                  int yDest,
+                  bool include_destination,
+                  tile_list* path) const;
+};
+
+#endif
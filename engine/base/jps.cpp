@@ -0,0 +1,194 @@
+/*
+Author: Vladimir Slav
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "jps.h"
+
+int OctileDistance(int xStart, int yStart, int xDest, int yDest)
+{
+    int dx = std::abs(xStart - xDest);
+    int dy = std::abs(yStart - yDest);
+    return JPS_STRAIGHT_COST * std::max(dx, dy) + (JPS_DIAGONAL_COST - JPS_STRAIGHT_COST) * std::min(dx, dy);
+}
+
+JumpPointBitmap::JumpPointBitmap()
+    : generation(0)
+    , h(0)
+    , wordsPerRow(0)
+    , wordsPerColumn(0)
+{
+}
+
+void JumpPointBitmap::Prepare(int map_w, int map_h)
+{
+    size_t rowWords = (map_w + 63) / 64;
+    size_t columnWords = (map_h + 63) / 64;
+    if (rowWords != wordsPerRow || map_h != h)
+    {
+        h = map_h;
+        wordsPerRow = rowWords;
+        wordsPerColumn = columnWords;
+        rows.resize(rowWords * map_h);
+        columns.resize(rowWords * 64 * columnWords);
+        rowStamps.assign(rowWords * map_h, 0);
+        blockStamps.assign(rowWords * columnWords, 0);
+        generation = 0;
+    }
+
+    generation++;
+    if (generation == 0)
+    {
+        // wrapped around, old stamps could match again
+        std::fill(rowStamps.begin(), rowStamps.end(), 0);
+        std::fill(blockStamps.begin(), blockStamps.end(), 0);
+        generation = 1;
+    }
+}
+
+void JumpPointBitmap::FillBlock(size_t i, size_t j)
+{
+    uint64_t block[64];
+    for (size_t k = 0; k < 64; k++)
+    {
+        size_t y = j * 64 + k;
+        block[k] = (y < static_cast<size_t>(h)) ? rows[y * wordsPerRow + i] : 0;
+    }
+
+    // transpose by swapping ever smaller quarters: the top right one with the bottom left one
+    uint64_t mask = 0x00000000FFFFFFFFull;
+    for (size_t half = 32; half != 0; half >>= 1, mask ^= mask << half)
+    {
+        for (size_t k = 0; k < 64; k = ((k | half) + 1) & ~half)
+        {
+            uint64_t swapped = ((block[k] >> half) ^ block[k | half]) & mask;
+            block[k] ^= swapped << half;
+            block[k | half] ^= swapped;
+        }
+    }
+
+    for (size_t k = 0; k < 64; k++)
+    {
+        columns[(i * 64 + k) * wordsPerColumn + j] = block[k];
+    }
+    blockStamps[j * wordsPerRow + i] = generation;
+}
+
+JumpPointBitmap& GetThreadJumpPointBitmap()
+{
+    static thread_local JumpPointBitmap bitmap;
+    return bitmap;
+}
+
+void FillFitsBits(const ClearanceCheck& fits, JumpPointBitmap* bitmap, int, int y, size_t)
+{
+    const WalkabilityGrid* grid = fits.GetGrid();
+    size_t words = bitmap->GetWordsPerRow();
+    const uint64_t* walkable = grid->GetRow(y);
+    uint64_t* row = bitmap->FillRowWord(y, 0);
+    for (size_t word = 0; word < words; word++)
+    {
+        row[word] = walkable[word];
+        bitmap->FillRowWord(y, word);
+    }
+
+    // the unit fits where unit_w walkable tiles start: and the row with itself moved left by
+    // 1, 2, 4... tiles until the covered span is as wide as the unit
+    int unitW = fits.GetUnitWidth();
+    int span = 1;
+    while (span < unitW)
+    {
+        int shift = std::min(span, unitW - span);
+        size_t wordShift = shift >> 6;
+        int bitShift = shift & 63;
+        for (size_t word = 0; word < words; word++)
+        {
+            uint64_t low = (word + wordShift < words) ? row[word + wordShift] : 0;
+            uint64_t high = (word + wordShift + 1 < words) ? row[word + wordShift + 1] : 0;
+            row[word] &= (bitShift == 0) ? low : (low >> bitShift) | (high << (64 - bitShift));
+        }
+        span += shift;
+    }
+}
+
+void ExpandJumpPoints(AstarNodes* scratch, int w, int startIndex, int destIndex, bool include_destination, tile_list* path)
+{
+    if (include_destination)
+    {
+        path->push_back({ destIndex % w, destIndex / w });
+    }
+
+    // jump points are joined by straight or diagonal runs, walk each one tile by tile
+    int tile = destIndex;
+    while (tile != startIndex)
+    {
+        int parent = scratch->Get(tile).parent;
+        int x = tile % w;
+        int y = tile / w;
+        int parentX = parent % w;
+        int parentY = parent / w;
+        int dx = (parentX > x) - (parentX < x);
+        int dy = (parentY > y) - (parentY < y);
+        while (x != parentX || y != parentY)
+        {
+            x += dx;
+            y += dy;
+            if (x != parentX || y != parentY || parent != startIndex)
+            {
+                path->push_back({ x, y });
+            }
+        }
+        tile = parent;
+    }
+}
+
+tile_list JumpPointPath(size_t w,
+                        size_t h,
+                        bool(*checkFunc)(int x, int y),
+                        int xStart,
+                        int yStart,
+                        int xDest,
+                        int yDest,
+                        bool include_destination,
+                        int unit_w,
+                        bool diagonal)
+{
+    PathfinderContext& context = GetThreadPathfinderContext();
+    context.Resize(w, h);
+
+    UnitWidthCheck<bool(*)(int x, int y)> fits(checkFunc, static_cast<int>(w), static_cast<int>(h), unit_w);
+    tile_list path;
+    FindJumpPointPath(&context, fits, diagonal, xStart, yStart, xDest, yDest, include_destination, &path);
+    return path;
+}
+
+tile_list JumpPointPath(const WalkabilityGrid& grid,
+                        int xStart,
+                        int yStart,
+                        int xDest,
+                        int yDest,
+                        bool include_destination,
+                        int unit_w,
+                        bool diagonal)
+{
+    PathfinderContext& context = GetThreadPathfinderContext();
+    context.Resize(grid.GetWidth(), grid.GetHeight());
+
+    tile_list path;
+    FindJumpPointPath(&context, ClearanceCheck(&grid, unit_w), diagonal, xStart, yStart, xDest, yDest, include_destination, &path);
+    return path;
+}
@@ -0,0 +1,616 @@
+/*
+Author: Vladimir Slav
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+ Jump Point Search: A* for uniform cost grids that skips over tiles that every other path could
+ reach just as cheaply. Straight (and diagonal) runs are scanned without touching the open list,
+ only tiles where the path may have to turn become nodes. The result is expanded back into
+ single tile steps, so it can be used wherever an Astar path is.
+ Runs read the walkability as bits, 64 tiles at a time, rows straight from fits and columns
+ transposed from them, both filled lazily for the part of the map a search touches.
+
+ Walkability is the same as for Astar: fits(x, y) tells if the unit can stand with its leftmost
+ tile on x, y, and the destination can always be entered.
+ 4-connected paths cost 1 per step like Astar. 8-connected paths cost JPS_STRAIGHT_COST per
+ straight and JPS_DIAGONAL_COST per diagonal step, and never cut corners: a diagonal step needs
+ both tiles next to it to be walkable.
+*/
+
+#ifndef __JPS_H__
+#define __JPS_H__
+
+#include "pathfinding.h"
+#include "walkabilitygrid.h"
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static const int JPS_STRAIGHT_COST = 10;
+static const int JPS_DIAGONAL_COST = 14;
+
+int OctileDistance(int xStart, int yStart, int xDest, int yDest);
+
+// writes the path stored in the node parents into path, in the Astar order
+void ExpandJumpPoints(AstarNodes* scratch, int w, int startIndex, int destIndex, bool include_destination, tile_list* path);
+
+// index of the lowest / highest set bit, value can't be 0
+inline int LowestSetBit(uint64_t value)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+#ifdef _WIN64
+    _BitScanForward64(&index, value);
+#else
+    if (_BitScanForward(&index, static_cast<unsigned long>(value)) == 0)
+    {
+        _BitScanForward(&index, static_cast<unsigned long>(value >> 32));
+        index += 32;
+    }
+#endif
+    return static_cast<int>(index);
+#else
+    return __builtin_ctzll(value);
+#endif
+}
+
+inline int HighestSetBit(uint64_t value)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+#ifdef _WIN64
+    _BitScanReverse64(&index, value);
+#else
+    if (_BitScanReverse(&index, static_cast<unsigned long>(value >> 32)))
+    {
+        index += 32;
+    }
+    else
+    {
+        _BitScanReverse(&index, static_cast<unsigned long>(value));
+    }
+#endif
+    return static_cast<int>(index);
+#else
+    return 63 - __builtin_clzll(value);
+#endif
+}
+
+// walkability as bits, so straight runs are scanned 64 tiles at a time. rows are filled a word of
+// 64 tiles at a time the first time a search looks at them, columns are transposed from the rows
+// in blocks of 64x64 tiles, a search only pays for the part of the map it touches
+class JumpPointBitmap
+{
+private:
+    std::vector<uint64_t> rows;
+    std::vector<uint64_t> columns;
+    std::vector<uint32_t> rowStamps;
+    std::vector<uint32_t> blockStamps;
+    uint32_t generation;
+    int h;
+    size_t wordsPerRow;
+    size_t wordsPerColumn;
+
+public:
+    JumpPointBitmap();
+
+    // forgets the bits of the previous search
+    void Prepare(int map_w, int map_h);
+    size_t GetWordsPerRow() const { return wordsPerRow; }
+    size_t GetWordsPerColumn() const { return wordsPerColumn; }
+
+    bool IsRowWordFilled(int y, size_t i) const { return rowStamps[y * wordsPerRow + i] == generation; }
+    uint64_t* FillRowWord(int y, size_t i)
+    {
+        rowStamps[y * wordsPerRow + i] = generation;
+        return &rows[y * wordsPerRow + i];
+    }
+    uint64_t GetRowWord(int y, size_t i) const { return rows[y * wordsPerRow + i]; }
+
+    bool IsBlockFilled(size_t i, size_t j) const { return blockStamps[j * wordsPerRow + i] == generation; }
+    // columns 64 * i to 64 * i + 63, word j, from the rows that have to be filled already
+    void FillBlock(size_t i, size_t j);
+    uint64_t GetColumnWord(int x, size_t j) const { return columns[x * wordsPerColumn + j]; }
+};
+
+// bits of the calling thread, used by JumpPointSearch
+JumpPointBitmap& GetThreadJumpPointBitmap();
+
+// bits of the tiles 64 * i to 64 * i + 63 of row y where fits holds, the bits past the map width stay 0
+template <typename Fits> void FillFitsBits(const Fits& fits, JumpPointBitmap* bitmap, int w, int y, size_t i)
+{
+    uint64_t* word = bitmap->FillRowWord(y, i);
+    *word = 0;
+    int end = std::min<int>(w, static_cast<int>(i + 1) * 64);
+    for (int x = static_cast<int>(i) * 64; x < end; x++)
+    {
+        if (fits(x, y))
+        {
+            *word |= uint64_t(1) << (x & 63);
+        }
+    }
+}
+
+// same from the grid bitmap, fills the whole row at once
+void FillFitsBits(const ClearanceCheck& fits, JumpPointBitmap* bitmap, int w, int y, size_t i);
+
+// run along a line of tiles from pos in dir: the first tile with a forced neighbour on the lines to
+// either side, or dest, -1 if a blocked tile or the end of the line comes first.
+// word(side, i) gives the bits of the line (side 0) and its neighbours (-1, 1), 0 outside the map
+template <typename Word> int JumpAlongLine(Word word, int word_amount, int length, int pos, int dir, int dest)
+{
+    if (pos < 0 || pos >= length)
+    {
+        return -1;
+    }
+
+    // a neighbour is forced where a walkable tile to the side has a wall behind it
+    auto stops = [&](int i) -> uint64_t
+    {
+        uint64_t result = ~word(0, i);
+        for (int side = -1; side <= 1; side += 2)
+        {
+            uint64_t open = word(side, i);
+            uint64_t behind = (dir > 0) ? (open << 1) | (word(side, i - 1) >> 63) : (open >> 1) | (word(side, i + 1) << 63);
+            result |= open & ~behind;
+        }
+        if (dest >= 0 && i == (dest >> 6))
+        {
+            result |= uint64_t(1) << (dest & 63);
+        }
+        return result;
+    };
+
+    // blocked tiles stop the run too, it is over on the first stop that isn't walkable
+    auto found = [&](int tile)
+    {
+        return (tile < length && ((word(0, tile >> 6) >> (tile & 63)) & 1) != 0) ? tile : -1;
+    };
+
+    int i = pos >> 6;
+    if (dir > 0)
+    {
+        uint64_t mask = ~uint64_t(0) << (pos & 63);
+        for (; i < word_amount; i++, mask = ~uint64_t(0))
+        {
+            uint64_t bits = stops(i) & mask;
+            if (bits != 0)
+            {
+                return found(i * 64 + LowestSetBit(bits));
+            }
+        }
+        return -1;
+    }
+
+    uint64_t mask = ~uint64_t(0) >> (63 - (pos & 63));
+    for (; i >= 0; i--, mask = ~uint64_t(0))
+    {
+        uint64_t bits = stops(i) & mask;
+        if (bits != 0)
+        {
+            return found(i * 64 + HighestSetBit(bits));
+        }
+    }
+    return -1;
+}
+
+template <typename Fits> class JumpPointGrid
+{
+private:
+    Fits fits;
+    JumpPointBitmap* bitmap;
+    int w;
+    int h;
+    int xDest;
+    int yDest;
+
+    // the destination is walkable even if the unit doesn't fit there
+    uint64_t GetRowWord(int y, size_t i) const
+    {
+        if (bitmap->IsRowWordFilled(y, i) == false)
+        {
+            FillFitsBits(fits, bitmap, w, y, i);
+            size_t destWord = xDest >> 6;
+            if (y == yDest && bitmap->IsRowWordFilled(y, destWord))
+            {
+                *bitmap->FillRowWord(y, destWord) |= uint64_t(1) << (xDest & 63);
+            }
+        }
+        return bitmap->GetRowWord(y, i);
+    }
+
+    uint64_t GetColumnWord(int x, size_t j) const
+    {
+        size_t i = x >> 6;
+        if (bitmap->IsBlockFilled(i, j) == false)
+        {
+            int end = std::min<int>(h, static_cast<int>(j + 1) * 64);
+            for (int y = static_cast<int>(j) * 64; y < end; y++)
+            {
+                GetRowWord(y, i);
+            }
+            bitmap->FillBlock(i, j);
+        }
+        return bitmap->GetColumnWord(x, j);
+    }
+
+public:
+    // the bitmap has to be prepared for the map size
+    JumpPointGrid(Fits _fits, JumpPointBitmap* _bitmap, int map_w, int map_h, int x_dest, int y_dest)
+        : fits(_fits)
+        , bitmap(_bitmap)
+        , w(map_w)
+        , h(map_h)
+        , xDest(x_dest)
+        , yDest(y_dest)
+    {
+    }
+
+    bool IsWalkable(int x, int y) const
+    {
+        if (areValidCoordinates(x, y, w, h) == false)
+        {
+            return false;
+        }
+        return ((GetRowWord(y, x >> 6) >> (x & 63)) & 1) != 0;
+    }
+
+    bool IsDestination(int x, int y) const
+    {
+        return x == xDest && y == yDest;
+    }
+
+    // straight runs have a forced neighbour where the wall behind them opens up
+    bool HasForcedNeighbour(int x, int y, int dx, int dy) const
+    {
+        if (dx != 0)
+        {
+            return (IsWalkable(x, y - 1) && IsWalkable(x - dx, y - 1) == false) ||
+                   (IsWalkable(x, y + 1) && IsWalkable(x - dx, y + 1) == false);
+        }
+        return (IsWalkable(x - 1, y) && IsWalkable(x - 1, y - dy) == false) ||
+               (IsWalkable(x + 1, y) && IsWalkable(x + 1, y - dy) == false);
+    }
+
+    // straight runs from x, y: the destination or the first tile with a forced neighbour, -1 if a
+    // wall or the map edge comes first
+    int JumpHorizontal(int x, int y, int dx) const
+    {
+        int words = static_cast<int>(bitmap->GetWordsPerRow());
+        auto word = [&](int side, int i) -> uint64_t
+        {
+            int row = y + side;
+            return (row >= 0 && row < h && i >= 0 && i < words) ? GetRowWord(row, i) : 0;
+        };
+        int end = JumpAlongLine(word, words, w, x, dx, (y == yDest) ? xDest : -1);
+        return (end < 0) ? -1 : y * w + end;
+    }
+
+    int JumpVertical(int x, int y, int dy) const
+    {
+        int words = static_cast<int>(bitmap->GetWordsPerColumn());
+        auto word = [&](int side, int j) -> uint64_t
+        {
+            int column = x + side;
+            return (column >= 0 && column < w && j >= 0 && j < words) ? GetColumnWord(column, j) : 0;
+        };
+        int end = JumpAlongLine(word, words, h, y, dy, (x == xDest) ? yDest : -1);
+        return (end < 0) ? -1 : end * w + x;
+    }
+
+    // next jump point from x, y going in dx, dy without diagonal moves, -1 if the run hits a wall.
+    // vertical runs stop wherever a horizontal one would find something
+    int Jump4(int x, int y, int dx, int dy) const
+    {
+        if (dy == 0)
+        {
+            return JumpHorizontal(x, y, dx);
+        }
+
+        while (true)
+        {
+            if (IsWalkable(x, y) == false)
+            {
+                return -1;
+            }
+            if (IsDestination(x, y) || HasForcedNeighbour(x, y, dx, dy))
+            {
+                return y * w + x;
+            }
+            if (JumpHorizontal(x + 1, y, 1) >= 0 || JumpHorizontal(x - 1, y, -1) >= 0)
+            {
+                return y * w + x;
+            }
+            y += dy;
+        }
+    }
+
+    // same with diagonal moves, diagonal runs stop wherever a straight one would find something
+    int Jump8(int x, int y, int dx, int dy) const
+    {
+        if (dy == 0)
+        {
+            return JumpHorizontal(x, y, dx);
+        }
+        if (dx == 0)
+        {
+            return JumpVertical(x, y, dy);
+        }
+
+        while (true)
+        {
+            if (IsWalkable(x, y) == false)
+            {
+                return -1;
+            }
+            if (IsDestination(x, y))
+            {
+                return y * w + x;
+            }
+            if (JumpHorizontal(x + dx, y, dx) >= 0 || JumpVertical(x, y + dy, dy) >= 0)
+            {
+                return y * w + x;
+            }
+
+            // no corner cutting
+            if (IsWalkable(x + dx, y) == false || IsWalkable(x, y + dy) == false)
+            {
+                return -1;
+            }
+            x += dx;
+            y += dy;
+        }
+    }
+
+    // directions worth jumping to from x, y when it was reached going in dx, dy (both 0 for the start)
+    int GetDirections(int x, int y, int dx, int dy, bool diagonal, int* dirX, int* dirY) const
+    {
+        int amount = 0;
+        auto add = [&](int ddx, int ddy)
+        {
+            dirX[amount] = ddx;
+            dirY[amount] = ddy;
+            amount++;
+        };
+
+        if (dx == 0 && dy == 0)
+        {
+            for (int ddy = -1; ddy <= 1; ddy++)
+            {
+                for (int ddx = -1; ddx <= 1; ddx++)
+                {
+                    bool isDiagonal = ddx != 0 && ddy != 0;
+                    if ((ddx == 0 && ddy == 0) || (isDiagonal && diagonal == false))
+                    {
+                        continue;
+                    }
+                    if (isDiagonal == false || (IsWalkable(x + ddx, y) && IsWalkable(x, y + ddy)))
+                    {
+                        add(ddx, ddy);
+                    }
+                }
+            }
+            return amount;
+        }
+
+        if (diagonal == false)
+        {
+            if (dx != 0)
+            {
+                add(dx, 0);
+                add(0, -1);
+                add(0, 1);
+            }
+            else
+            {
+                add(0, dy);
+                add(-1, 0);
+                add(1, 0);
+            }
+            return amount;
+        }
+
+        if (dx != 0 && dy != 0)
+        {
+            bool verticalWalkable = IsWalkable(x, y + dy);
+            bool horizontalWalkable = IsWalkable(x + dx, y);
+            add(0, dy);
+            add(dx, 0);
+            if (verticalWalkable && horizontalWalkable)
+            {
+                add(dx, dy);
+            }
+        }
+        else if (dx != 0)
+        {
+            bool nextWalkable = IsWalkable(x + dx, y);
+            bool topWalkable = IsWalkable(x, y - 1);
+            bool bottomWalkable = IsWalkable(x, y + 1);
+            add(dx, 0);
+            add(0, -1);
+            add(0, 1);
+            if (nextWalkable && topWalkable)
+            {
+                add(dx, -1);
+            }
+            if (nextWalkable && bottomWalkable)
+            {
+                add(dx, 1);
+            }
+        }
+        else
+        {
+            bool nextWalkable = IsWalkable(x, y + dy);
+            bool leftWalkable = IsWalkable(x - 1, y);
+            bool rightWalkable = IsWalkable(x + 1, y);
+            add(0, dy);
+            add(-1, 0);
+            add(1, 0);
+            if (nextWalkable && leftWalkable)
+            {
+                add(-1, dy);
+            }
+            if (nextWalkable && rightWalkable)
+            {
+                add(1, dy);
+            }
+        }
+        return amount;
+    }
+};
+
+// search on the scratch nodes, the path is the same shape as from AstarSearch
+template <typename Fits> bool JumpPointSearch(AstarNodes* scratch,
+                                              size_t w,
+                                              size_t h,
+                                              Fits fits,
+                                              bool diagonal,
+                                              int xStart,
+                                              int yStart,
+                                              int xDest,
+                                              int yDest,
+                                              bool include_destination,
+                                              tile_list* path)
+{
+    path->clear();
+
+    int width = static_cast<int>(w);
+    int height = static_cast<int>(h);
+    if (areValidCoordinates(xStart, yStart, width, height) == false ||
+        areValidCoordinates(xDest, yDest, width, height) == false)
+    {
+        return false;
+    }
+
+    if (include_destination && fits(xDest, yDest) == false)
+    {
+        return false;
+    }
+
+    if (xStart == xDest && yStart == yDest)
+    {
+        return false;
+    }
+
+    JumpPointBitmap& bitmap = GetThreadJumpPointBitmap();
+    bitmap.Prepare(width, height);
+    JumpPointGrid<Fits> grid(fits, &bitmap, width, height, xDest, yDest);
+    auto distance = [diagonal](int x1, int y1, int x2, int y2)
+    {
+        return diagonal ? OctileDistance(x1, y1, x2, y2) : HFunc(x1, y1, x2, y2);
+    };
+
+    scratch->Prepare(w, h);
+    int startIndex = yStart * width + xStart;
+    int destIndex = yDest * width + xDest;
+    scratch->Open(startIndex, 0, distance(xStart, yStart, xDest, yDest), -1);
+
+    int dirX[8];
+    int dirY[8];
+    while (scratch->HasOpen())
+    {
+        int current = scratch->PopBest();
+        if (current == destIndex)
+        {
+            ExpandJumpPoints(scratch, width, startIndex, destIndex, include_destination, path);
+            return true;
+        }
+
+        int currentX = current % width;
+        int currentY = current / width;
+        int dx = 0;
+        int dy = 0;
+        int parent = scratch->Get(current).parent;
+        if (parent >= 0)
+        {
+            int parentX = parent % width;
+            int parentY = parent / width;
+            dx = (currentX > parentX) - (currentX < parentX);
+            dy = (currentY > parentY) - (currentY < parentY);
+        }
+
+        int directions = grid.GetDirections(currentX, currentY, dx, dy, diagonal, dirX, dirY);
+        for (int i = 0; i < directions; i++)
+        {
+            int jumpX = currentX + dirX[i];
+            int jumpY = currentY + dirY[i];
+            int jumpPoint = diagonal ? grid.Jump8(jumpX, jumpY, dirX[i], dirY[i]) :
+                                       grid.Jump4(jumpX, jumpY, dirX[i], dirY[i]);
+            if (jumpPoint < 0 || scratch->IsClosed(jumpPoint))
+            {
+                continue;
+            }
+
+            jumpX = jumpPoint % width;
+            jumpY = jumpPoint / width;
+            int G = scratch->Get(current).G + distance(currentX, currentY, jumpX, jumpY);
+            if (scratch->IsTouched(jumpPoint) == false)
+            {
+                scratch->Open(jumpPoint, G, distance(jumpX, jumpY, xDest, yDest), current);
+            }
+            else if (G < scratch->Get(jumpPoint).G)
+            {
+                scratch->Improve(jumpPoint, G, current);
+            }
+        }
+    }
+
+    return false;
+}
+
+template <typename Fits> bool FindJumpPointPath(PathfinderContext* context,
+                                                Fits fits,
+                                                bool diagonal,
+                                                int xStart,
+                                                int yStart,
+                                                int xDest,
+                                                int yDest,
+                                                bool include_destination,
+                                                tile_list* path)
+{
+    return context->Run([&](AstarNodes* scratch, size_t w, size_t h, tile_list* result)
+    {
+        return JumpPointSearch(scratch, w, h, fits, diagonal, xStart, yStart, xDest, yDest, include_destination, result);
+    }, path);
+}
+
+// drop-in for Astar, on the context of the calling thread
+tile_list JumpPointPath(size_t w,
+                        size_t h,
+                        bool(*checkFunc)(int x, int y),
+                        int xStart,
+                        int yStart,
+                        int xDest,
+                        int yDest,
+                        bool include_destination,
+                        int unit_w,
+                        bool diagonal = false);
+
+tile_list JumpPointPath(const WalkabilityGrid& grid,
+                        int xStart,
+                        int yStart,
+                        int xDest,
+                        int yDest,
+                        bool include_destination,
+                        int unit_w,
+                        bool diagonal = false);
+
+#endif
@@ -1,12 +1,14 @@
 #include "particlehelpers.h"
+#include "particlesystem.h"
 #include <math.h>
 using namespace EngineParticles;
 
 void EngineParticles::CreateSplash(int particleAmnt, GLfloat _x, GLfloat _y, int lifetime, GLfloat dxMin, GLfloat dxMax, GLfloat dyMin, GLfloat dyMax, const GraphColor& _color, bool applyPhysics, int currentTime, GLfloat ddy)
 {
+    particleAmnt = (int)GetDefaultSystem().ScaleSpawnAmount(particleAmnt);
     for (int i = 0; i < particleAmnt; i++)
     {
-        Add(new SparkParticle(_x,
+        Particle* p = new SparkParticle(_x,
             _y,
             lifetime,
             dxMin + EngineRoutines::GetRandF() * (dxMax - dxMin),
@@ -14,7 +16,9 @@ void EngineParticles::CreateSplash(int particleAmnt, GLfloat _x, GLfloat _y, int
             currentTime,
             _color,
             applyPhysics,
-            ddy));
+            ddy);
+        p->SetLowImportance(true);
+        Add(p);
     }
 }
 
@@ -34,9 +38,10 @@ void EngineParticles::CreateTexturedSplash(size_t texture,
     int currentTime,
     GLfloat ddy)
 {
+    particleAmnt = (int)GetDefaultSystem().ScaleSpawnAmount(particleAmnt);
     for (int i = 0; i < particleAmnt; i++)
     {
-        Add(new SparkParticle(texture,
+        Particle* p = new SparkParticle(texture,
             _xMin + EngineRoutines::GetRandF() * (_xMax - _xMin),
             _yMin + EngineRoutines::GetRandF() * (_yMax - _yMin),
             lifetime,
@@ -45,7 +50,9 @@ void EngineParticles::CreateTexturedSplash(size_t texture,
             currentTime,
             _color,
             applyPhysics,
-            ddy));
+            ddy);
+        p->SetLowImportance(true);
+        Add(p);
     }
 }
 
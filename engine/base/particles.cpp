@@ -18,10 +18,46 @@ OTHER DEALINGS IN THE SOFTWARE.
 */
 
 #include "particles.h"
-#include <list>
+#include <cmath>
 
 using namespace EngineParticles;
-static std::list<Particle*> particles;
+
+static TextureRecord* PrerenderText(Graph* gui, const FontDescriptor* font, const std::string& text, SDL_Color color, SDL_Color borderColor, bool hasBorder, size_t width)
+{
+    // particles fade by changing the alpha every frame, so the texture is opaque and the alpha is applied when drawing
+    color.a = 255;
+    borderColor.a = 255;
+
+    if (width != 0)
+    {
+        return gui->RenderParagraph(*font, text, width, color);
+    }
+
+    if (hasBorder)
+    {
+        return gui->RenderBorderedText(*font, text, color, borderColor);
+    }
+
+    return gui->RenderText(*font, text, color);
+}
+
+static void DrawPrerenderedText(Graph* gui, TextureRecord* tex, GLfloat x, GLfloat y, GLfloat alpha, GLfloat scale, bool hasBorder)
+{
+    // bordered text has 1px margin around it
+    GLfloat margin = hasBorder ? scale : 0;
+    gui->PushAlpha(alpha);
+    gui->DrawTextureStretched(x - margin, y - margin, tex->w * scale, tex->h * scale, tex);
+    gui->PopAlpha();
+}
+
+static void GetPrerenderedTextBounds(TextureRecord* tex, GLfloat x, GLfloat y, GLfloat scale, bool hasBorder, SDL_Rect* bounds)
+{
+    GLfloat margin = hasBorder ? scale : 0;
+    bounds->x = (int)(x - margin);
+    bounds->y = (int)(y - margin);
+    bounds->w = (int)(tex->w * scale) + 1;
+    bounds->h = (int)(tex->h * scale) + 1;
+}
 
 void Particle::Update(int new_time)
 {
@@ -41,7 +77,8 @@ void Particle::Update(int new_time)
 }
 
 Particle::Particle(sprite_id _texture, GLfloat _x, GLfloat _y, int _life, int _time, particleCallback callBack)
-    : x(_x), y(_y), lives(_life), time(_time), lifetime(_life), texture(_texture), callback(callBack)
+    : x(_x), y(_y), prevX(_x), prevY(_y), lives(_life), time(_time), lifetime(_life), texture(_texture), callback(callBack)
+    , lowImportance(false), lodIndex(0)
 {
     dead = false;
 };
@@ -89,6 +126,49 @@ sprite_id Particle::GetTexture()
     return texture;
 }
 
+bool Particle::GetBounds(Graph* g, SDL_Rect* bounds)
+{
+    TextureRecord* tex = g->GetTexture(texture);
+    if (tex == nullptr)
+    {
+        return false;
+    }
+
+    SDL_Rect* frame = GetFrame();
+    bounds->x = (int)x;
+    bounds->y = (int)y;
+    bounds->w = frame != nullptr ? frame->w : tex->w;
+    bounds->h = frame != nullptr ? frame->h : tex->h;
+    return true;
+}
+
+void Particle::SetLowImportance(bool isLowImportance)
+{
+    lowImportance = isLowImportance;
+}
+
+bool Particle::IsLowImportance() const
+{
+    return lowImportance;
+}
+
+void Particle::StorePreviousState()
+{
+    prevX = x;
+    prevY = y;
+}
+
+void Particle::DrawInterpolated(Graph* g, GLfloat alpha)
+{
+    GLfloat currentX = x;
+    GLfloat currentY = y;
+    x = prevX + (currentX - prevX) * alpha;
+    y = prevY + (currentY - prevY) * alpha;
+    Draw(g);
+    x = currentX;
+    y = currentY;
+}
+
 MovingParticle::MovingParticle(sprite_id _texture, GLfloat _x, GLfloat _y, int _life, GLfloat _dx, GLfloat _dy, int _time)
     : Particle(_texture, _x, _y, _life, _time), dx(_dx), dy(_dy)
 {
@@ -142,6 +222,17 @@ void SparkParticle::Draw(Graph* g)
     }
 }
 
+bool SparkParticle::GetBounds(Graph* g, SDL_Rect* bounds)
+{
+    if (texture != 0)
+    {
+        return Particle::GetBounds(g, bounds);
+    }
+
+    *bounds = SDL_Rect{ (int)x, (int)y, 2, 2 };
+    return true;
+}
+
 void SparkParticle::Update(int new_time)
 {
     color.a = lives / (GLfloat)lifetime;
@@ -189,19 +280,31 @@ MovingTextParticle::MovingTextParticle(GLfloat _x,
 {
 }
 
-void MovingTextParticle::Draw(Graph* gui)
+void MovingTextParticle::DrawText(Graph* gui, GLfloat drawX, GLfloat drawY, GLfloat scale)
 {
-    color.a = (Uint8)(255 * (1.0f - (GLfloat)lives / lifetime));
-    //gui->PushAlpha((1.0f - (GLfloat)lives / lifetime));
-    if (hasBorder)
+    if (rendered == nullptr)
     {
-        gui->WriteBorderedText(*font, text, x, y, color, borderColor);
+        rendered.reset(PrerenderText(gui, font, text, color, borderColor, hasBorder, 0));
     }
-    else
+
+    DrawPrerenderedText(gui, rendered.get(), drawX, drawY, color.a / 255.0f, scale, hasBorder);
+}
+
+void MovingTextParticle::Draw(Graph* gui)
+{
+    color.a = (Uint8)(255 * (1.0f - (GLfloat)lives / lifetime));
+    DrawText(gui, x, y, 1.0f);
+}
+
+bool MovingTextParticle::GetBounds(Graph* g, SDL_Rect* bounds)
+{
+    if (rendered == nullptr)
     {
-        gui->WriteNormal(*font, text, (int)x, (int)y, color);
+        return false;
     }
-    //gui->PopAlpha();
+
+    GetPrerenderedTextBounds(rendered.get(), x, y, 1.0f, hasBorder, bounds);
+    return true;
 }
 
 AnimatedParticle::AnimatedParticle(sprite_id _texture,
@@ -245,6 +348,12 @@ void AnimatedParticle::Update(int new_time)
     MovingParticle::Update(new_time);
 }
 
+bool AnimatedParticle::GetBounds(Graph* g, SDL_Rect* bounds)
+{
+    *bounds = SDL_Rect{ (int)x, (int)y, static_cast<int>(drawnW), static_cast<int>(drawnH) };
+    return true;
+}
+
 void AnimatedParticle::Draw(Graph* g)
 {
     g->PushAlpha(palette.a);
@@ -256,51 +365,6 @@ void AnimatedParticle::Draw(Graph* g)
     g->PopAlpha();
 }
 
-void EngineParticles::Update(int time)
-{
-    for (std::list<Particle*>::iterator it=particles.begin(); it!=particles.end(); ++it)
-    {
-        (*it)->Update(time);
-    }
-}
-
-void EngineParticles::Add(Particle* p, particleCallback cb)
-{
-    particles.push_back(p);
-    if (cb != nullptr)
-    {
-        p->setCallback(cb);
-    }
-}
-
-void EngineParticles::Draw(Graph* gui)
-{
-    std::list<Particle*>::iterator it= particles.begin();
-    while (it != particles.end())
-    {
-        (*it)->Draw(gui);
-        if ((*it)->IsDead())
-        {
-            delete(*it);
-            it = particles.erase(it);
-        }
-        else
-        {
-            ++it;
-        }
-    }
-}
-
-void EngineParticles::Clear()
-{
-    for (auto it : particles)
-    {
-        delete it;
-    }
-
-    particles.clear();
-}
-
 FadingTextParticle::FadingTextParticle(GLfloat _x, GLfloat _y, int _life, int _time, const FontDescriptor* fontId, const std::string& text, SDL_Color color, size_t _width)
     : Particle(0, _x, _y, _life, _time)
     , font(fontId)
@@ -326,24 +390,25 @@ FadingTextParticle::FadingTextParticle(GLfloat _x, GLfloat _y, int _life, int _t
 
 }
 
-void FadingTextParticle::Draw(Graph* gui)
+bool FadingTextParticle::GetBounds(Graph* g, SDL_Rect* bounds)
 {
-    color.a = static_cast<Uint8>(255 * t.RemainingPart());
-    if (width == 0)
+    if (rendered == nullptr)
     {
-        if (hasBorder)
-        {
-            gui->WriteBorderedText(*font, text, x, y, color, borderColor);
-        }
-        else
-        {
-            gui->WriteNormal(*font, text, (int)x, (int)y, color);
-        }
+        return false;
     }
-    else
+
+    GetPrerenderedTextBounds(rendered.get(), x, y, 1.0f, hasBorder && width == 0, bounds);
+    return true;
+}
+
+void FadingTextParticle::Draw(Graph* gui)
+{
+    if (rendered == nullptr)
     {
-        gui->WriteParagraph(*font, text, (int)x, (int)y, width, 10, color);
+        rendered.reset(PrerenderText(gui, font, text, color, borderColor, hasBorder, width));
     }
+
+    DrawPrerenderedText(gui, rendered.get(), x, y, (GLfloat)t.RemainingPart(), 1.0f, hasBorder && width == 0);
 }
 
 FadingOutPointerParticle::FadingOutPointerParticle(sprite_id _texture, GLfloat _x, GLfloat _y, int _life, int _time, GLfloat maxDx, GLfloat maxDy)
@@ -374,6 +439,18 @@ void FadingOutPointerParticle::Draw(Graph* gui)
     gui->PopAlpha();
 }
 
+bool FadingOutPointerParticle::GetBounds(Graph* g, SDL_Rect* bounds)
+{
+    if (Particle::GetBounds(g, bounds) == false)
+    {
+        return false;
+    }
+
+    bounds->x += (int)moveX;
+    bounds->y += (int)moveY;
+    return true;
+}
+
 void FadingOutPointerParticle::Update(int new_time)
 {
     if (maxDx > 0)
@@ -448,6 +525,22 @@ void TraceSilhouetteParticle::Draw(Graph* g)
     g->PopAlpha();
 }
 
+bool TraceSilhouetteParticle::GetBounds(Graph* g, SDL_Rect* bounds)
+{
+    *bounds = coordinateRect;
+    if (bounds->w == 0 || bounds->h == 0)
+    {
+        // drawn with the size of the whole texture then
+        TextureRecord* tex = g->GetTexture(texture);
+        if (tex == nullptr)
+        {
+            return false;
+        }
+        bounds->w = bounds->w == 0 ? tex->w : bounds->w;
+        bounds->h = bounds->h == 0 ? tex->h : bounds->h;
+    }
+    return true;
+}
 
 TargetedMovingParticle::TargetedMovingParticle(sprite_id _texture, GLfloat _x, GLfloat _y, int _time, MovementNodeCollection& _nodes, GraphColor _color)
     : Particle(_texture, _x, _y, 100, _time)
@@ -531,6 +624,17 @@ void TargetedMovingParticle::Draw(Graph* g)
     }
 }
 
+bool TargetedMovingParticle::GetBounds(Graph* g, SDL_Rect* bounds)
+{
+    if (useTexture)
+    {
+        return Particle::GetBounds(g, bounds);
+    }
+
+    *bounds = SDL_Rect{ (int)x, (int)y, (int)w, (int)h };
+    return true;
+}
+
 ConfigurableTextParticle::ConfigurableTextParticle(TextParticleConfig& c, std::string text)
     : MovingTextParticle(c.x, c.y, c.life, c.dx, c.dy, c.time, c.fontId, text, c.color, c.borderColor)
     , fadeOut(c.fadeOut)
@@ -573,15 +677,21 @@ void ConfigurableTextParticle::Draw(Graph* gui)
         currentX += shakeDeltaX * (GLfloat)sin(t * 6.28 * intensity);
     }
 
-    if (hasBorder)
-    {
-        gui->WriteBorderedText(*font, text, currentX, y, color, borderColor, currentScale);
-    }
-    else
+    DrawText(gui, currentX, y, currentScale);
+}
+
+bool ConfigurableTextParticle::GetBounds(Graph* g, SDL_Rect* bounds)
+{
+    if (rendered == nullptr)
     {
-        gui->WriteNormal(*font, text, (int)currentX, (int)y, color, currentScale);
+        return false;
     }
-    //gui->PopAlpha();
+
+    // shake moves the text horizontally around x
+    GLfloat shakeRange = std::abs(shakeDeltaX);
+    GetPrerenderedTextBounds(rendered.get(), x - shakeRange, y, currentScale, hasBorder, bounds);
+    bounds->w += (int)(2 * shakeRange);
+    return true;
 }
 
 ConfigurableMovingParticle::ConfigurableMovingParticle(GLfloat x, GLfloat y, size_t time, sprite_id texture, MovingParticleConfig& c)
@@ -19,6 +19,7 @@ OTHER DEALINGS IN THE SOFTWARE.
 
 #include "graph.h"
 #include "countdown.h"
+#include <memory>
 
 #ifndef __PARTICLES_H__
 #define __PARTICLES_H__
@@ -33,6 +34,8 @@ namespace EngineParticles
     protected:
         GLfloat x;
         GLfloat y;
+        GLfloat prevX; // position at the previous fixed simulation step
+        GLfloat prevY;
         int lives;
         int lifetime;
         int time;
@@ -41,6 +44,10 @@ namespace EngineParticles
         sprite_id texture;
         particleCallback callback; // called on death
 
+        bool lowImportance; // can be skipped when the frame takes too long
+        unsigned int lodIndex; // set by the owning system, decides which low-importance particles get skipped
+        friend class ParticleSystem;
+
     public:
 
         virtual bool IsDead();
@@ -54,9 +61,20 @@ namespace EngineParticles
         virtual SDL_Rect* GetFrame();
         virtual void Update(int new_time);
 
+        // area covered on the screen, used for culling. false if it is not known (particle is always drawn)
+        virtual bool GetBounds(Graph* g, SDL_Rect* bounds);
+
+        void SetLowImportance(bool isLowImportance);
+        bool IsLowImportance() const;
+
         virtual ~Particle();
 
         virtual void Draw(Graph* g);
+
+        // remember current position, so that the drawing can be interpolated between simulation steps
+        void StorePreviousState();
+        // draw at the position between the previous and the current simulation step, alpha in [0..1]
+        void DrawInterpolated(Graph* g, GLfloat alpha);
     };
 
     class TraceSilhouetteParticle : public Particle
@@ -68,6 +86,7 @@ namespace EngineParticles
     public:
         TraceSilhouetteParticle(sprite_id _texture, SDL_Rect& _coordinateRect, SDL_Rect& _texRect, int _life, int _time, SDL_RendererFlip flip);
         virtual void Draw(Graph* g);
+        virtual bool GetBounds(Graph* g, SDL_Rect* bounds);
     };
 
     class MovingParticle : public Particle
@@ -164,6 +183,7 @@ namespace EngineParticles
         SparkParticle(sprite_id _texture, GLfloat _x, GLfloat _y, int _life, GLfloat _dx, GLfloat _dy, int _time, const GraphColor& _color, bool applyPhysics, GLfloat ddy);
         virtual void Update(int new_time);
         virtual void Draw(Graph* g);
+        virtual bool GetBounds(Graph* g, SDL_Rect* bounds);
     };
     
     struct MovementNode
@@ -195,8 +215,10 @@ namespace EngineParticles
         TargetedMovingParticle(GLfloat _x, GLfloat _y, int _time, MovementNodeCollection& nodes, GraphColor color, size_t w, size_t h);
         virtual void Update(int new_time);
         virtual void Draw(Graph* g);
+        virtual bool GetBounds(Graph* g, SDL_Rect* bounds);
     };
 
+    // drawn separately; for many particles with the same sheet see ParticleSystem::AddFlipbook
     class AnimatedParticle : public MovingParticle
     {
     protected:
@@ -232,6 +254,7 @@ namespace EngineParticles
 
         virtual void Update(int new_time);
         virtual void Draw(Graph* g);
+        virtual bool GetBounds(Graph* g, SDL_Rect* bounds);
     };
 
     class MovingTextParticle : public EngineParticles::MovingParticle
@@ -242,10 +265,14 @@ namespace EngineParticles
         SDL_Color color;
         SDL_Color borderColor;
         bool hasBorder;
+
+        std::unique_ptr<TextureRecord> rendered; // text is rasterized once, on the first draw
+        void DrawText(Graph* gui, GLfloat drawX, GLfloat drawY, GLfloat scale);
     public:
         MovingTextParticle(GLfloat _x, GLfloat _y, int _life, GLfloat _dx, GLfloat _dy, int _time, const FontDescriptor* fontId, std::string text, SDL_Color color);
         MovingTextParticle(GLfloat _x, GLfloat _y, int _life, GLfloat _dx, GLfloat _dy, int _time, const FontDescriptor* fontId, std::string text, SDL_Color color, SDL_Color borderColor);
         virtual void Draw(Graph* gui);
+        virtual bool GetBounds(Graph* g, SDL_Rect* bounds);
     };
 
     class TextParticleConfig
@@ -311,6 +338,7 @@ namespace EngineParticles
     public:
         ConfigurableTextParticle(TextParticleConfig& c, std::string text);
         virtual void Draw(Graph* gui);
+        virtual bool GetBounds(Graph* g, SDL_Rect* bounds);
     };
 
     class FadingTextParticle : public EngineParticles::Particle
@@ -324,10 +352,13 @@ namespace EngineParticles
         bool hasBorder;
 
         size_t width;
+
+        std::unique_ptr<TextureRecord> rendered; // text is rasterized once, on the first draw
     public:
         FadingTextParticle(GLfloat _x, GLfloat _y, int _life, int _time, const FontDescriptor* fontId, const std::string& text, SDL_Color color, size_t _width = 0);
         FadingTextParticle(GLfloat _x, GLfloat _y, int _life, int _time, const FontDescriptor* fontId, const std::string& text, SDL_Color color, SDL_Color borderColor, size_t _width = 0);
         virtual void Draw(Graph* gui);
+        virtual bool GetBounds(Graph* g, SDL_Rect* bounds);
     };
 
     class FadingOutPointerParticle : public EngineParticles::Particle
@@ -347,6 +378,7 @@ namespace EngineParticles
         FadingOutPointerParticle(sprite_id _texture, GLfloat _x, GLfloat _y, int _life, int _time, GLfloat maxDx, GLfloat maxDy);
         virtual void Draw(Graph* gui);
         virtual void Update(int new_time);
+        virtual bool GetBounds(Graph* g, SDL_Rect* bounds);
     };
 
     class LeafParticle : public EngineParticles::Particle
@@ -361,10 +393,21 @@ namespace EngineParticles
         virtual void Update(int new_time);
     };
 
+    class ParticleSystem;
+
+    // systems are created with layer 0 and without particle limit, see particlesystem.h
+    // the functions below operate on the default one
+    ParticleSystem& GetDefaultSystem();
+
     void Update(int time);
     void Add(Particle* p, particleCallback cb = nullptr);
-    void Draw(Graph* gui);
+    void Draw(Graph* gui); // also removes the dead particles
+    void Process(Graph* gui, int time); // Update + Draw in a single pass over the particles
     void Clear();
+
+    // 0 - particles are updated with the frame time (default)
+    // otherwise particles are simulated in fixed steps of step_ms and drawn interpolated between the steps
+    void SetFixedStep(int step_ms);
 }
 
 #endif
@@ -0,0 +1,634 @@
+/*
+Author: Vladimir Slav
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "particlesystem.h"
+#include <algorithm>
+
+using namespace EngineParticles;
+
+static const size_t INITIAL_PARTICLE_CAPACITY = 256;
+static const int MAX_STEPS_PER_UPDATE = 5; // do not try to catch up after long stalls
+
+static const int MAX_LOD_LEVEL = 4;
+static const int LOD_ADJUST_FRAMES = 30; // frames to wait before changing LOD level again
+static const GLfloat FRAME_TIME_SMOOTHING = 0.1f;
+static const GLfloat LOD_DECREASE_THRESHOLD = 0.75f; // part of the target frame time
+
+static std::vector<ParticleSystem*>& GetSystems()
+{
+    static std::vector<ParticleSystem*> systems;
+    return systems;
+}
+
+FlipbookSheet::FlipbookSheet(Graph* g, sprite_id texture, size_t frame_w, size_t frame_h, size_t frame_amount, int frame_time, bool loop)
+    : texture(texture)
+    , frameTime(std::max(frame_time, 1))
+    , loop(loop)
+    , drawnW((GLfloat)frame_w)
+    , drawnH((GLfloat)frame_h)
+{
+    size_t texW = 0;
+    size_t texH = 0;
+    g->GetTextureSize(texture, &texW, &texH);
+    SDL_assert_release(frame_w > 0 && frame_h > 0 && frame_w <= texW && frame_h <= texH);
+
+    size_t framesInRow = texW / frame_w;
+    frameUV.reserve(frame_amount * 4);
+    for (size_t i = 0; i < frame_amount; i++)
+    {
+        size_t frameX = (i % framesInRow) * frame_w;
+        size_t frameY = (i / framesInRow) * frame_h;
+        frameUV.push_back(frameX / (GLfloat)texW);
+        frameUV.push_back(frameY / (GLfloat)texH);
+        frameUV.push_back((frameX + frame_w) / (GLfloat)texW);
+        frameUV.push_back((frameY + frame_h) / (GLfloat)texH);
+    }
+}
+
+size_t FlipbookSheet::GetFrameAmount() const
+{
+    return frameUV.size() / 4;
+}
+
+void ParticleSystem::FlipbookGroup::MoveParticle(size_t from, size_t to)
+{
+    startX[to] = startX[from];
+    startY[to] = startY[from];
+    dx[to] = dx[from];
+    dy[to] = dy[from];
+    startTime[to] = startTime[from];
+    life[to] = life[from];
+    age[to] = age[from];
+    frame[to] = frame[from];
+    color[to] = color[from];
+    lodIndex[to] = lodIndex[from];
+}
+
+void ParticleSystem::FlipbookGroup::Resize(size_t amount)
+{
+    startX.resize(amount);
+    startY.resize(amount);
+    dx.resize(amount);
+    dy.resize(amount);
+    startTime.resize(amount);
+    life.resize(amount);
+    age.resize(amount);
+    frame.resize(amount);
+    color.resize(amount);
+    lodIndex.resize(amount);
+}
+
+ParticleSystem::ParticleSystem(int layer, size_t max_particles)
+    : head(0)
+    , layer(layer)
+    , maxParticles(max_particles)
+    , timer()
+    , paused(false)
+    , fixedStep(0)
+    , simulationTime(-1)
+    , interpolation(1.0f)
+    , iterating(false)
+    , culling(true)
+    , visibleArea{ 0, 0, 0, 0 }
+    , frameTimeTarget(0)
+    , frameTimer()
+    , averageFrameTime(0)
+    , lodLevel(0)
+    , framesSinceLodChange(0)
+    , nextLodIndex(0)
+    , stats{ 0, 0, 0, 0 }
+{
+    particles.reserve(INITIAL_PARTICLE_CAPACITY);
+    GetSystems().push_back(this);
+}
+
+ParticleSystem::~ParticleSystem()
+{
+    Clear();
+    std::vector<ParticleSystem*>& systems = GetSystems();
+    systems.erase(std::remove(systems.begin(), systems.end(), this), systems.end());
+}
+
+void ParticleSystem::Add(Particle* p, particleCallback cb)
+{
+    if (cb != nullptr)
+    {
+        p->setCallback(cb);
+    }
+
+    // while particles are being iterated, the budget is enforced after the compaction
+    if (maxParticles != 0 && iterating == false)
+    {
+        while (particles.size() - head >= maxParticles)
+        {
+            delete particles[head];
+            particles[head] = nullptr;
+            head++;
+        }
+    }
+
+    p->lodIndex = nextLodIndex++;
+    particles.push_back(p);
+}
+
+void ParticleSystem::AddFlipbook(const FlipbookSheet& sheet,
+                                 GLfloat x,
+                                 GLfloat y,
+                                 GLfloat dx,
+                                 GLfloat dy,
+                                 int time,
+                                 int life,
+                                 const GraphColor& color,
+                                 bool lowImportance)
+{
+    FlipbookGroup* group = nullptr;
+    for (size_t i = 0; i < flipbooks.size(); i++)
+    {
+        if (flipbooks[i].sheet == &sheet && flipbooks[i].lowImportance == lowImportance)
+        {
+            group = &flipbooks[i];
+            break;
+        }
+    }
+
+    if (group == nullptr)
+    {
+        flipbooks.push_back(FlipbookGroup());
+        group = &flipbooks.back();
+        group->sheet = &sheet;
+        group->lowImportance = lowImportance;
+    }
+
+    group->startX.push_back(x);
+    group->startY.push_back(y);
+    group->dx.push_back(dx);
+    group->dy.push_back(dy);
+    group->startTime.push_back(time);
+    group->life.push_back(life);
+    group->age.push_back(0);
+    group->frame.push_back(0);
+    group->color.push_back(color);
+    group->lodIndex.push_back(nextLodIndex++);
+}
+
+void ParticleSystem::UpdateFlipbooks(int time)
+{
+    for (size_t g = 0; g < flipbooks.size(); g++)
+    {
+        FlipbookGroup& group = flipbooks[g];
+        const unsigned int frameTime = group.sheet->frameTime;
+        const unsigned int frameAmount = (unsigned int)group.sheet->GetFrameAmount();
+        const size_t amount = group.startTime.size();
+
+        int* age = group.age.data();
+        unsigned int* frame = group.frame.data();
+        const int* startTime = group.startTime.data();
+
+        for (size_t i = 0; i < amount; i++)
+        {
+            age[i] = std::max(time - startTime[i], 0);
+        }
+
+        // finished non-looping particles get frame >= frameAmount and are removed on draw
+        if (group.sheet->loop)
+        {
+            for (size_t i = 0; i < amount; i++)
+            {
+                frame[i] = (age[i] / frameTime) % frameAmount;
+            }
+        }
+        else
+        {
+            for (size_t i = 0; i < amount; i++)
+            {
+                frame[i] = age[i] / frameTime;
+            }
+        }
+    }
+}
+
+void ParticleSystem::DrawFlipbooks(Graph* gui)
+{
+    for (size_t g = 0; g < flipbooks.size(); g++)
+    {
+        FlipbookGroup& group = flipbooks[g];
+        const FlipbookSheet* sheet = group.sheet;
+        const unsigned int frameAmount = (unsigned int)sheet->GetFrameAmount();
+        const size_t amount = group.startTime.size();
+        if (amount == 0)
+        {
+            continue;
+        }
+
+        const bool skipByLod = lodLevel > 0 && group.lowImportance;
+        gui->BeginBatch(sheet->texture);
+
+        size_t alive = 0;
+        for (size_t i = 0; i < amount; i++)
+        {
+            if (group.frame[i] >= frameAmount || (group.life[i] > 0 && group.age[i] >= group.life[i]))
+            {
+                continue;
+            }
+
+            if (alive != i)
+            {
+                group.MoveParticle(i, alive);
+            }
+            alive++;
+
+            if (skipByLod && group.lodIndex[i] % (lodLevel + 1) != 0)
+            {
+                stats.skipped++;
+                continue;
+            }
+
+            GLfloat x = group.startX[i] + group.dx[i] * group.age[i] / 1000.0f;
+            GLfloat y = group.startY[i] + group.dy[i] * group.age[i] / 1000.0f;
+
+            if (culling &&
+                (x + sheet->drawnW < visibleArea.x ||
+                 y + sheet->drawnH < visibleArea.y ||
+                 x > visibleArea.x + visibleArea.w ||
+                 y > visibleArea.y + visibleArea.h))
+            {
+                stats.culled++;
+                continue;
+            }
+
+            const GLfloat* uv = &sheet->frameUV[group.frame[i] * 4];
+            gui->BatchQuad(x, y, sheet->drawnW, sheet->drawnH, uv[0], uv[1], uv[2], uv[3], group.color[i]);
+            stats.drawn++;
+        }
+
+        gui->FlushBatch();
+        group.Resize(alive);
+    }
+}
+
+void ParticleSystem::Update(int time)
+{
+    if (paused)
+    {
+        return;
+    }
+
+    UpdateFlipbooks(time);
+
+    iterating = true;
+    if (fixedStep <= 0)
+    {
+        for (size_t i = head; i < particles.size(); i++)
+        {
+            particles[i]->Update(time);
+        }
+    }
+    else
+    {
+        if (simulationTime < 0 || time - simulationTime > fixedStep * MAX_STEPS_PER_UPDATE)
+        {
+            simulationTime = time - fixedStep;
+        }
+
+        while (time - simulationTime >= fixedStep)
+        {
+            simulationTime += fixedStep;
+            for (size_t i = head; i < particles.size(); i++)
+            {
+                particles[i]->StorePreviousState();
+                particles[i]->Update(simulationTime);
+            }
+        }
+
+        interpolation = (time - simulationTime) / (GLfloat)fixedStep;
+    }
+    iterating = false;
+}
+
+void ParticleSystem::Update()
+{
+    Update(GetTime());
+}
+
+void ParticleSystem::BeginFrame(Graph* gui)
+{
+    visibleArea = gui->GetVisibleArea();
+    stats.drawn = 0;
+    stats.culled = 0;
+    stats.skipped = 0;
+
+    if (frameTimeTarget > 0)
+    {
+        averageFrameTime += (frameTimer.GetTicks() - averageFrameTime) * FRAME_TIME_SMOOTHING;
+        frameTimer.Reset();
+
+        framesSinceLodChange++;
+        if (framesSinceLodChange >= LOD_ADJUST_FRAMES)
+        {
+            if (averageFrameTime > frameTimeTarget && lodLevel < MAX_LOD_LEVEL)
+            {
+                lodLevel++;
+                framesSinceLodChange = 0;
+            }
+            else if (averageFrameTime < frameTimeTarget * LOD_DECREASE_THRESHOLD && lodLevel > 0)
+            {
+                lodLevel--;
+                framesSinceLodChange = 0;
+            }
+        }
+    }
+    stats.lodLevel = lodLevel;
+}
+
+void ParticleSystem::DrawParticle(Particle* p, Graph* gui)
+{
+    if (lodLevel > 0 && p->lowImportance && p->lodIndex % (lodLevel + 1) != 0)
+    {
+        stats.skipped++;
+        return;
+    }
+
+    SDL_Rect bounds;
+    if (culling && p->GetBounds(gui, &bounds))
+    {
+        if (bounds.x + bounds.w < visibleArea.x ||
+            bounds.y + bounds.h < visibleArea.y ||
+            bounds.x > visibleArea.x + visibleArea.w ||
+            bounds.y > visibleArea.y + visibleArea.h)
+        {
+            stats.culled++;
+            return;
+        }
+    }
+
+    stats.drawn++;
+    if (fixedStep > 0)
+    {
+        p->DrawInterpolated(gui, interpolation);
+    }
+    else
+    {
+        p->Draw(gui);
+    }
+}
+
+bool ParticleSystem::RemoveIfDead(Particle* p, size_t* alive)
+{
+    if (p->IsDead())
+    {
+        delete p;
+        return true;
+    }
+
+    particles[(*alive)++] = p;
+    return false;
+}
+
+void ParticleSystem::Compact(size_t alive)
+{
+    particles.resize(alive);
+    head = 0;
+
+    if (maxParticles != 0 && particles.size() > maxParticles)
+    {
+        size_t excess = particles.size() - maxParticles;
+        for (size_t i = 0; i < excess; i++)
+        {
+            delete particles[i];
+        }
+        particles.erase(particles.begin(), particles.begin() + excess);
+    }
+}
+
+void ParticleSystem::Draw(Graph* gui)
+{
+    // dead particles are drawn for the last time, then the alive ones are compacted to the front
+    // index-based: callbacks of the deleted particles are allowed to Add() new ones
+    BeginFrame(gui);
+    iterating = true;
+    size_t alive = 0;
+    for (size_t i = head; i < particles.size(); i++)
+    {
+        Particle* p = particles[i];
+        DrawParticle(p, gui);
+        RemoveIfDead(p, &alive);
+    }
+    iterating = false;
+    Compact(alive);
+
+    DrawFlipbooks(gui);
+}
+
+void ParticleSystem::Process(Graph* gui, int time)
+{
+    if (fixedStep > 0 || paused)
+    {
+        // several (or no) simulation steps might be required, cannot fuse them with drawing
+        Update(time);
+        Draw(gui);
+        return;
+    }
+
+    BeginFrame(gui);
+    iterating = true;
+    size_t alive = 0;
+    for (size_t i = head; i < particles.size(); i++)
+    {
+        Particle* p = particles[i];
+        p->Update(time);
+        DrawParticle(p, gui);
+        RemoveIfDead(p, &alive);
+    }
+    iterating = false;
+    Compact(alive);
+
+    UpdateFlipbooks(time);
+    DrawFlipbooks(gui);
+}
+
+void ParticleSystem::Process(Graph* gui)
+{
+    Process(gui, GetTime());
+}
+
+void ParticleSystem::Clear()
+{
+    for (size_t i = head; i < particles.size(); i++)
+    {
+        delete particles[i];
+    }
+
+    particles.clear();
+    head = 0;
+
+    for (size_t i = 0; i < flipbooks.size(); i++)
+    {
+        flipbooks[i].Resize(0);
+    }
+}
+
+void ParticleSystem::SetFixedStep(int step_ms)
+{
+    fixedStep = step_ms;
+    simulationTime = -1;
+    interpolation = 1.0f;
+}
+
+int ParticleSystem::GetTime() const
+{
+    return static_cast<int>(timer.GetTicks());
+}
+
+void ParticleSystem::Pause()
+{
+    if (paused == false)
+    {
+        paused = true;
+        timer.Pause();
+    }
+}
+
+void ParticleSystem::Resume()
+{
+    if (paused)
+    {
+        paused = false;
+        timer.Unpause();
+    }
+}
+
+bool ParticleSystem::IsPaused() const
+{
+    return paused;
+}
+
+int ParticleSystem::GetLayer() const
+{
+    return layer;
+}
+
+void ParticleSystem::SetLayer(int layer)
+{
+    this->layer = layer;
+}
+
+size_t ParticleSystem::GetBudget() const
+{
+    return maxParticles;
+}
+
+void ParticleSystem::SetBudget(size_t max_particles)
+{
+    maxParticles = max_particles;
+}
+
+size_t ParticleSystem::GetParticleAmount() const
+{
+    size_t amount = particles.size() - head;
+    for (size_t i = 0; i < flipbooks.size(); i++)
+    {
+        amount += flipbooks[i].startTime.size();
+    }
+    return amount;
+}
+
+void ParticleSystem::SetCulling(bool enabled)
+{
+    culling = enabled;
+}
+
+void ParticleSystem::SetFrameTimeTarget(int ms)
+{
+    frameTimeTarget = ms;
+    averageFrameTime = 0;
+    framesSinceLodChange = 0;
+    frameTimer.Reset();
+    if (frameTimeTarget <= 0)
+    {
+        lodLevel = 0;
+    }
+}
+
+int ParticleSystem::GetLodLevel() const
+{
+    return lodLevel;
+}
+
+size_t ParticleSystem::ScaleSpawnAmount(size_t amount) const
+{
+    if (amount == 0 || lodLevel == 0)
+    {
+        return amount;
+    }
+
+    return std::max(amount / (lodLevel + 1), (size_t)1);
+}
+
+const ParticleStats& ParticleSystem::GetStats() const
+{
+    return stats;
+}
+
+void EngineParticles::DrawLayer(Graph* gui, int layer)
+{
+    std::vector<ParticleSystem*>& systems = GetSystems();
+    for (size_t i = 0; i < systems.size(); i++)
+    {
+        if (systems[i]->GetLayer() == layer)
+        {
+            systems[i]->Draw(gui);
+        }
+    }
+}
+
+ParticleSystem& EngineParticles::GetDefaultSystem()
+{
+    static ParticleSystem defaultSystem;
+    return defaultSystem;
+}
+
+void EngineParticles::Update(int time)
+{
+    GetDefaultSystem().Update(time);
+}
+
+void EngineParticles::Add(Particle* p, particleCallback cb)
+{
+    GetDefaultSystem().Add(p, cb);
+}
+
+void EngineParticles::Draw(Graph* gui)
+{
+    GetDefaultSystem().Draw(gui);
+}
+
+void EngineParticles::Process(Graph* gui, int time)
+{
+    GetDefaultSystem().Process(gui, time);
+}
+
+void EngineParticles::Clear()
+{
+    GetDefaultSystem().Clear();
+}
+
+void EngineParticles::SetFixedStep(int step_ms)
+{
+    GetDefaultSystem().SetFixedStep(step_ms);
+}
@@ -0,0 +1,192 @@
+/*
+Author: Vladimir Slav
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __PARTICLESYSTEM_H__
+#define __PARTICLESYSTEM_H__
+
+#include "particles.h"
+#include "Timer.h"
+#include <vector>
+
+namespace EngineParticles
+{
+
+    // counters of the last drawn frame
+    struct ParticleStats
+    {
+        size_t drawn;
+        size_t culled; // outside of the visible area
+        size_t skipped; // low-importance particles skipped because of the LOD
+        int lodLevel;
+    };
+
+    /*
+     * Sprite sheet for flip-book particles: frames of the same size, left to right, top to bottom.
+     * Texture coordinates of every frame are calculated once, the sheet must outlive the particles using it.
+     */
+    struct FlipbookSheet
+    {
+        sprite_id texture;
+        int frameTime; // ms per frame
+        bool loop; // looping particles live until their lifetime ends, others until the last frame ends
+
+        GLfloat drawnW;
+        GLfloat drawnH;
+
+        std::vector<GLfloat> frameUV; // u0, v0, u1, v1 for every frame
+
+        FlipbookSheet(Graph* g, sprite_id texture, size_t frame_w, size_t frame_h, size_t frame_amount, int frame_time, bool loop = false);
+        size_t GetFrameAmount() const;
+    };
+
+    /*
+     * Owns a group of particles: separate systems can be kept per screen,
+     * drawn at different depths (layers), paused or cleared independently.
+     */
+    class ParticleSystem
+    {
+    protected:
+        // particles are kept in the order they were added
+        // [0, head) - slots of the particles that were culled by the budget, removed on the next compaction
+        std::vector<Particle*> particles;
+        size_t head;
+
+        int layer;
+        size_t maxParticles; // 0 - no limit
+
+        Timer timer; // own time base, see GetTime()
+        bool paused;
+
+        int fixedStep;
+        int simulationTime;
+        GLfloat interpolation;
+
+        bool iterating; // particles added during the iteration are culled after it
+
+        bool culling;
+        SDL_Rect visibleArea;
+
+        // LOD: when frames take longer than the target, low-importance particles are drawn less
+        int frameTimeTarget; // ms, 0 - LOD is disabled
+        Timer frameTimer;
+        GLfloat averageFrameTime;
+        int lodLevel; // every (lodLevel + 1)-th low-importance particle is drawn
+        int framesSinceLodChange;
+        unsigned int nextLodIndex;
+
+        ParticleStats stats;
+
+        // flip-book particles are not separate objects: their data is stored per sheet in arrays
+        // frames are calculated from the particle age in one pass, the whole group is drawn as a single batch
+        struct FlipbookGroup
+        {
+            const FlipbookSheet* sheet;
+            std::vector<GLfloat> startX;
+            std::vector<GLfloat> startY;
+            std::vector<GLfloat> dx;
+            std::vector<GLfloat> dy;
+            std::vector<int> startTime;
+            std::vector<int> life; // 0 - until the animation ends
+            std::vector<int> age; // calculated on update
+            std::vector<unsigned int> frame; // calculated on update
+            std::vector<GraphColor> color;
+            std::vector<unsigned int> lodIndex;
+            bool lowImportance;
+
+            void MoveParticle(size_t from, size_t to);
+            void Resize(size_t amount);
+        };
+        std::vector<FlipbookGroup> flipbooks;
+
+        void UpdateFlipbooks(int time);
+        void DrawFlipbooks(Graph* gui);
+
+        void BeginFrame(Graph* gui);
+        void DrawParticle(Particle* p, Graph* gui);
+        bool RemoveIfDead(Particle* p, size_t* alive);
+        void Compact(size_t alive);
+
+    public:
+        ParticleSystem(int layer = 0, size_t max_particles = 0);
+        virtual ~ParticleSystem();
+
+        ParticleSystem(const ParticleSystem&) = delete;
+        ParticleSystem& operator=(const ParticleSystem&) = delete;
+
+        // if the budget is exceeded, the oldest particles are removed
+        void Add(Particle* p, particleCallback cb = nullptr);
+
+        // flip-book particle, moving with the speed of dx, dy pixels per second
+        void AddFlipbook(const FlipbookSheet& sheet,
+                         GLfloat x,
+                         GLfloat y,
+                         GLfloat dx,
+                         GLfloat dy,
+                         int time,
+                         int life = 0,
+                         const GraphColor& color = GraphColor{ 1.0f, 1.0f, 1.0f, 1.0f },
+                         bool lowImportance = true);
+
+        void Update(int time);
+        void Draw(Graph* gui); // also removes the dead particles
+        void Process(Graph* gui, int time); // Update + Draw in a single pass over the particles
+
+        // same as above, but with the system's own time
+        void Update();
+        void Process(Graph* gui);
+
+        void Clear();
+
+        // 0 - particles are updated with the frame time (default)
+        // otherwise particles are simulated in fixed steps of step_ms and drawn interpolated between the steps
+        void SetFixedStep(int step_ms);
+
+        // time to create particles with, if the system's own time base is used
+        int GetTime() const;
+
+        // paused system is still drawn, but it is not updated and its time does not run
+        void Pause();
+        void Resume();
+        bool IsPaused() const;
+
+        int GetLayer() const;
+        void SetLayer(int layer);
+
+        // budget limits Particle objects, flip-book particles are not counted
+        size_t GetBudget() const;
+        void SetBudget(size_t max_particles);
+
+        size_t GetParticleAmount() const;
+
+        // do not draw particles that are outside of the visible area (on by default)
+        void SetCulling(bool enabled);
+
+        void SetFrameTimeTarget(int ms);
+        int GetLodLevel() const;
+        // amount of particles an effect should spawn with the current LOD
+        size_t ScaleSpawnAmount(size_t amount) const;
+
+        const ParticleStats& GetStats() const;
+    };
+
+    // draw all existing systems that belong to the given layer
+    void DrawLayer(Graph* gui, int layer);
+}
+
+#endif
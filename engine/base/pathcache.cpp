@@ -0,0 +1,201 @@
+/*
+Author: Vladimir Slav
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "pathcache.h"
+#include "..\SDL2\include\SDL.h"
+
+size_t PathCache::KeyHash::operator()(const Key& key) const
+{
+    uint64_t hash = 14695981039346656037ULL;
+    int values[] = { key.xStart, key.yStart, key.xDest, key.yDest, key.unitW, key.includeDestination ? 1 : 0 };
+    for (int value : values)
+    {
+        hash = (hash ^ static_cast<uint32_t>(value)) * 1099511628211ULL;
+    }
+    return static_cast<size_t>(hash);
+}
+
+PathCache::PathCache(const WalkabilityGrid* _grid, size_t _capacity)
+    : grid(_grid)
+    , capacity(_capacity)
+    , knownVersion(_grid->GetVersion())
+{
+    SDL_assert_release(grid != nullptr && capacity > 0);
+    ResetStats();
+}
+
+void PathCache::ResetStats()
+{
+    stats.hits = 0;
+    stats.misses = 0;
+    stats.invalidations = 0;
+    stats.evictions = 0;
+}
+
+double PathCache::GetHitRate() const
+{
+    size_t queries = stats.hits + stats.misses;
+    return queries == 0 ? 0.0 : static_cast<double>(stats.hits) / queries;
+}
+
+bool PathCache::FindPath(PathfinderContext* context,
+                         int xStart,
+                         int yStart,
+                         int xDest,
+                         int yDest,
+                         bool include_destination,
+                         int unit_w,
+                         tile_list* path)
+{
+    Key key = { xStart, yStart, xDest, yDest, unit_w, include_destination };
+    auto it = lookup.find(key);
+    if (it != lookup.end())
+    {
+        EntryList::iterator entry = it->second;
+        if (entry->version == grid->GetVersion())
+        {
+            stats.hits++;
+            entries.splice(entries.begin(), entries, entry);
+            path->assign(entry->path.begin(), entry->path.end());
+            return entry->found;
+        }
+
+        // the grid changed behind our back
+        lookup.erase(it);
+        entries.erase(entry);
+        stats.invalidations++;
+    }
+
+    stats.misses++;
+    context->Resize(grid->GetWidth(), grid->GetHeight());
+    bool found = context->FindPath(ClearanceCheck(grid, unit_w), xStart, yStart, xDest, yDest, include_destination, path);
+    Store(key, found, *path);
+    return found;
+}
+
+void PathCache::Store(const Key& key, bool found, const tile_list& path)
+{
+    if (entries.size() >= capacity)
+    {
+        lookup.erase(entries.back().key);
+        entries.pop_back();
+        stats.evictions++;
+    }
+
+    entries.emplace_front();
+    Entry& entry = entries.front();
+    entry.key = key;
+    entry.version = grid->GetVersion();
+    entry.found = found;
+    entry.path = path;
+
+    // the start isn't in the path, the destination may not be
+    entry.minX = entry.maxX = key.xStart;
+    entry.minY = entry.maxY = key.yStart;
+    entry.length = 0;
+    if (found)
+    {
+        entry.minX = std::min(entry.minX, key.xDest);
+        entry.maxX = std::max(entry.maxX, key.xDest);
+        entry.minY = std::min(entry.minY, key.yDest);
+        entry.maxY = std::max(entry.maxY, key.yDest);
+        for (const auto& tile : path)
+        {
+            entry.minX = std::min(entry.minX, tile.x);
+            entry.maxX = std::max(entry.maxX, tile.x);
+            entry.minY = std::min(entry.minY, tile.y);
+            entry.maxY = std::max(entry.maxY, tile.y);
+        }
+        entry.length = static_cast<int>(path.size()) + (key.includeDestination ? 0 : 1);
+    }
+
+    lookup[key] = entries.begin();
+}
+
+bool PathCache::IsAffected(const Entry& entry, int x, int y, bool opened) const
+{
+    // the tile changes whether the unit fits up to unitW - 1 tiles to its left
+    int unitW = std::max(entry.key.unitW, 1);
+    if (opened == false)
+    {
+        // nothing found stays nothing, a path only breaks if it went over the tile
+        return entry.found && y >= entry.minY && y <= entry.maxY && x >= entry.minX && x <= entry.maxX + unitW - 1;
+    }
+
+    if (entry.found == false)
+    {
+        return true;
+    }
+
+    // a shorter path through any newly fitting tile would have to be at most as long as this one
+    for (int tileX = std::max(0, x - unitW + 1); tileX <= x; tileX++)
+    {
+        int through = HFunc(entry.key.xStart, entry.key.yStart, tileX, y) + HFunc(tileX, y, entry.key.xDest, entry.key.yDest);
+        if (through < entry.length)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void PathCache::OnTileChanged(int x, int y)
+{
+    uint64_t version = grid->GetVersion();
+    if (version == knownVersion)
+    {
+        return;
+    }
+
+    const TileCoords& lastChange = grid->GetLastChange();
+    if (version != knownVersion + 1 || lastChange.x != x || lastChange.y != y)
+    {
+        // more changed than was reported
+        stats.invalidations += entries.size();
+        Clear();
+        knownVersion = version;
+        return;
+    }
+
+    bool opened = grid->IsWalkable(x, y);
+    for (auto it = entries.begin(); it != entries.end();)
+    {
+        if (IsAffected(*it, x, y, opened))
+        {
+            lookup.erase(it->key);
+            it = entries.erase(it);
+            stats.invalidations++;
+            continue;
+        }
+
+        // entries already stale stay that way
+        if (it->version == knownVersion)
+        {
+            it->version = version;
+        }
+        ++it;
+    }
+    knownVersion = version;
+}
+
+void PathCache::Clear()
+{
+    entries.clear();
+    lookup.clear();
+}
@@ -0,0 +1,119 @@
+/*
+Author: Vladimir Slav
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+ Cache of finished paths for queries that repeat, e.g. patrolling units or AI planning again every
+ tick. Entries are kept by start, destination, unit width and destination inclusion, tagged with the
+ grid version they are valid for, and dropped least recently used first.
+
+ Reported tile changes only drop the entries they can affect: closing a tile matters to paths whose
+ bounding box has it, opening one matters to paths that could get shorter through it, i.e. when it's
+ closer to start plus destination than the path is long, and to queries that found nothing. The rest
+ is moved to the new version. Changes to the grid that were not reported make every entry stale.
+*/
+
+#ifndef __PATHCACHE_H__
+#define __PATHCACHE_H__
+
+#include "walkabilitygrid.h"
+
+#include <list>
+#include <unordered_map>
+
+struct PathCacheStats
+{
+    size_t hits;
+    size_t misses;
+    size_t invalidations;
+    size_t evictions;
+};
+
+class PathCache
+{
+private:
+    struct Key
+    {
+        int xStart;
+        int yStart;
+        int xDest;
+        int yDest;
+        int unitW;
+        bool includeDestination;
+
+        bool operator==(const Key& other) const
+        {
+            return xStart == other.xStart && yStart == other.yStart && xDest == other.xDest &&
+                   yDest == other.yDest && unitW == other.unitW && includeDestination == other.includeDestination;
+        }
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const;
+    };
+
+    struct Entry
+    {
+        Key key;
+        uint64_t version;
+        bool found;
+        int length; // steps from start to destination
+        int minX;
+        int minY;
+        int maxX;
+        int maxY;
+        tile_list path;
+    };
+
+    using EntryList = std::list<Entry>;
+
+    const WalkabilityGrid* grid;
+    size_t capacity;
+    uint64_t knownVersion; // grid version the reported changes brought us to
+    EntryList entries; // most recently used first
+    std::unordered_map<Key, EntryList::iterator, KeyHash> lookup;
+    PathCacheStats stats;
+
+    bool IsAffected(const Entry& entry, int x, int y, bool opened) const;
+    void Store(const Key& key, bool found, const tile_list& path);
+
+public:
+    PathCache(const WalkabilityGrid* _grid, size_t _capacity = 256);
+
+    // the same as searching with the context, answered from the cache when possible
+    bool FindPath(PathfinderContext* context,
+                  int xStart,
+                  int yStart,
+                  int xDest,
+                  int yDest,
+                  bool include_destination,
+                  int unit_w,
+                  tile_list* path);
+
+    // call after every change of the grid
+    void OnTileChanged(int x, int y);
+    void Clear();
+
+    size_t GetSize() const { return entries.size(); }
+    const PathCacheStats& GetStats() const { return stats; }
+    double GetHitRate() const;
+    void ResetStats();
+};
+
+#endif
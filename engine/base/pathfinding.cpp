@@ -8,4 +8,183 @@ bool areValidCoordinates(int x, int y, int w, int h)
 int HFunc(int xStart, int yStart, int xDest, int yDest)
 {
     return std::abs(xStart - xDest) + std::abs(yStart - yDest);
+}
+
+AstarNodes::AstarNodes()
+    : generation(0)
+    , expanded(0)
+{
+}
+
+void AstarNodes::Reserve(size_t w, size_t h)
+{
+    if (nodes.size() < w * h)
+    {
+        AstarNode empty = { 0, 0, 0, -1, ASTAR_CLOSED };
+        nodes.resize(w * h, empty);
+    }
+    heap.reserve(w * h);
+}
+
+void AstarNodes::Prepare(size_t w, size_t h)
+{
+    Reserve(w, h);
+
+    heap.clear();
+    expanded = 0;
+    generation++;
+    if (generation == 0)
+    {
+        // stamps wrapped around, old ones could look current again
+        for (auto& node : nodes)
+        {
+            node.stamp = 0;
+        }
+        generation = 1;
+    }
+}
+
+bool AstarNodes::IsBefore(int a, int b) const
+{
+    int fA = nodes[a].G + nodes[a].H;
+    int fB = nodes[b].G + nodes[b].H;
+    // on equal cost prefer the node closer to the destination
+    return fA < fB || (fA == fB && nodes[a].H < nodes[b].H);
+}
+
+void AstarNodes::SiftUp(uint32_t position)
+{
+    int index = heap[position];
+    while (position > 0)
+    {
+        uint32_t parent = (position - 1) / 2;
+        if (IsBefore(index, heap[parent]) == false)
+        {
+            break;
+        }
+        heap[position] = heap[parent];
+        nodes[heap[position]].heapIndex = position;
+        position = parent;
+    }
+    heap[position] = index;
+    nodes[index].heapIndex = position;
+}
+
+void AstarNodes::SiftDown(uint32_t position)
+{
+    int index = heap[position];
+    uint32_t size = static_cast<uint32_t>(heap.size());
+    while (true)
+    {
+        uint32_t child = position * 2 + 1;
+        if (child >= size)
+        {
+            break;
+        }
+        if (child + 1 < size && IsBefore(heap[child + 1], heap[child]))
+        {
+            child++;
+        }
+        if (IsBefore(heap[child], index) == false)
+        {
+            break;
+        }
+        heap[position] = heap[child];
+        nodes[heap[position]].heapIndex = position;
+        position = child;
+    }
+    heap[position] = index;
+    nodes[index].heapIndex = position;
+}
+
+void AstarNodes::Close(int index)
+{
+    nodes[index].stamp = generation;
+    nodes[index].heapIndex = ASTAR_CLOSED;
+}
+
+void AstarNodes::Open(int index, int G, int H, int parent)
+{
+    AstarNode& node = nodes[index];
+    node.stamp = generation;
+    node.G = G;
+    node.H = H;
+    node.parent = parent;
+    heap.push_back(index);
+    SiftUp(static_cast<uint32_t>(heap.size() - 1));
+}
+
+void AstarNodes::Improve(int index, int G, int parent)
+{
+    AstarNode& node = nodes[index];
+    node.G = G;
+    node.parent = parent;
+    SiftUp(node.heapIndex);
+}
+
+size_t AstarNodes::GetCapacity() const
+{
+    return nodes.capacity() * sizeof(AstarNode) + heap.capacity() * sizeof(int);
+}
+
+int AstarNodes::PopBest()
+{
+    expanded++;
+    int best = heap[0];
+    heap[0] = heap.back();
+    heap.pop_back();
+    if (heap.empty() == false)
+    {
+        SiftDown(0);
+    }
+    nodes[best].heapIndex = ASTAR_CLOSED;
+    return best;
+}
+
+PathfinderContext::PathfinderContext()
+    : w(0)
+    , h(0)
+{
+    ResetStats();
+}
+
+PathfinderContext::PathfinderContext(size_t map_w, size_t map_h)
+    : w(0)
+    , h(0)
+{
+    ResetStats();
+    Resize(map_w, map_h);
+}
+
+void PathfinderContext::Resize(size_t map_w, size_t map_h)
+{
+    w = map_w;
+    h = map_h;
+    nodes.Reserve(w, h);
+}
+
+void PathfinderContext::ResetStats()
+{
+    stats.queries = 0;
+    stats.allocations = 0;
+    stats.expanded = 0;
+}
+
+bool PathfinderContext::FindPath(bool(*checkFunc)(int x, int y),
+                                 int xStart,
+                                 int yStart,
+                                 int xDest,
+                                 int yDest,
+                                 bool include_destination,
+                                 int unit_w,
+                                 tile_list* path)
+{
+    UnitWidthCheck<bool(*)(int x, int y)> fits(checkFunc, static_cast<int>(w), static_cast<int>(h), unit_w);
+    return FindPath(fits, xStart, yStart, xDest, yDest, include_destination, path);
+}
+
+PathfinderContext& GetThreadPathfinderContext()
+{
+    static thread_local PathfinderContext context;
+    return context;
 }
\ No newline at end of file
@@ -2,6 +2,10 @@
 #define __PATHFINDING_H__
 
 #include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
 
 struct TileCoords
 {
@@ -31,191 +35,301 @@ using tile_list = std::vector<TileCoords>;
 bool areValidCoordinates(int x, int y, int w, int h);
 int HFunc(int xStart, int yStart, int xDest, int yDest);
 
-template <typename T> tile_list Astar(T*** field,
-                                      size_t w,
-                                      size_t h, 
-                                      bool(*checkFunc)(int x, int y),
-                                      int xStart,
-                                      int yStart,
-                                      int xDest,
-                                      int yDest,
-                                      bool include_destination,
-                                      int unit_w)
+struct AstarNode
+{
+    uint32_t stamp;     // search the node was last touched by, the rest is garbage if it's not the current one
+    int G;
+    int H;              // computed when the node is first reached
+    int parent;         // index in the flat array
+    uint32_t heapIndex; // position in the open heap, ASTAR_CLOSED once expanded or found blocked
+};
+
+static const uint32_t ASTAR_CLOSED = 0xFFFFFFFF;
+
+// search memory: one node per tile, row by row, and the open list as an indexed binary heap.
+// reused between searches, a new search only bumps the generation instead of clearing the nodes
+class AstarNodes
+{
+private:
+    std::vector<AstarNode> nodes;
+    std::vector<int> heap;
+    uint32_t generation;
+    size_t expanded;
+
+    bool IsBefore(int a, int b) const;
+    void SiftUp(uint32_t position);
+    void SiftDown(uint32_t position);
+
+public:
+    AstarNodes();
+
+    // makes room for a w x h map, the heap never outgrows it since every tile is pushed at most once
+    void Reserve(size_t w, size_t h);
+    void Prepare(size_t w, size_t h);
+    size_t GetCapacity() const; // in bytes
+    size_t GetExpandedAmount() const { return expanded; } // by the last search
+
+    AstarNode& Get(int index) { return nodes[index]; }
+    bool IsTouched(int index) const { return nodes[index].stamp == generation; }
+    bool IsClosed(int index) const { return nodes[index].stamp == generation && nodes[index].heapIndex == ASTAR_CLOSED; }
+    void Close(int index);
+
+    void Open(int index, int G, int H, int parent);
+    void Improve(int index, int G, int parent); // decrease-key
+    bool HasOpen() const { return heap.empty() == false; }
+    int PopBest();
+};
+
+template <typename Fits> bool AstarSearch(AstarNodes* scratch, size_t w, size_t h, Fits fits, int xStart, int yStart, int xDest, int yDest, bool include_destination, tile_list* path);
+
+struct PathfinderStats
 {
-    if (areValidCoordinates(xStart, yStart, w, h) == false)
+    size_t queries;
+    size_t allocations; // queries that had to grow the scratch memory or the path buffer
+    size_t expanded;    // tiles taken from the open list, over all queries
+};
+
+// scratch memory for searches on a map of a given size, reused by every query.
+// not thread safe, give each thread its own context and they can search the same map at once
+class PathfinderContext
+{
+private:
+    size_t w;
+    size_t h;
+    AstarNodes nodes;
+    PathfinderStats stats;
+
+public:
+    PathfinderContext();
+    PathfinderContext(size_t map_w, size_t map_h);
+
+    void Resize(size_t map_w, size_t map_h);
+    size_t GetWidth() const { return w; }
+    size_t GetHeight() const { return h; }
+
+    const PathfinderStats& GetStats() const { return stats; }
+    void ResetStats();
+
+    // runs search(AstarNodes* nodes, size_t w, size_t h, tile_list* path) on the context memory and
+    // keeps the stats, used by every search working on the context
+    template <typename Search> bool Run(Search search, tile_list* path)
     {
-        return {}; //empty list
+        size_t pathCapacity = path->capacity();
+        size_t scratchCapacity = nodes.GetCapacity();
+
+        bool found = search(&nodes, w, h, path);
+
+        stats.queries++;
+        stats.expanded += nodes.GetExpandedAmount();
+        if (path->capacity() != pathCapacity || nodes.GetCapacity() != scratchCapacity)
+        {
+            stats.allocations++;
+        }
+        return found;
     }
 
-    // check if unit can actually fit in destination
-    if (include_destination)
+    // same as Astar, but the path is written into the given buffer. once the buffer has grown to
+    // the longest path asked for, queries don't allocate anything
+    template <typename Fits> bool FindPath(Fits fits,
+                                           int xStart,
+                                           int yStart,
+                                           int xDest,
+                                           int yDest,
+                                           bool include_destination,
+                                           tile_list* path)
     {
-        for (int newX = xDest; newX < xDest + unit_w; newX++)
+        return Run([&](AstarNodes* scratch, size_t map_w, size_t map_h, tile_list* result)
         {
-            if (areValidCoordinates(newX, yDest, w, h) == false)
-            {
-                return{}; // empty list, one of the destination tiles is out of bounds
-            }
+            return AstarSearch(scratch, map_w, map_h, fits, xStart, yStart, xDest, yDest, include_destination, result);
+        }, path);
+    }
 
-            if (checkFunc(newX, yDest) == false)
+    bool FindPath(bool(*checkFunc)(int x, int y),
+                  int xStart,
+                  int yStart,
+                  int xDest,
+                  int yDest,
+                  bool include_destination,
+                  int unit_w,
+                  tile_list* path);
+};
+
+// checkFunc for every tile a unit_w wide unit would cover with its leftmost tile on x, y.
+// checkFunc is a function pointer or anything else callable as bool(int x, int y)
+template <typename Check> class UnitWidthCheck
+{
+private:
+    Check checkFunc;
+    int w;
+    int h;
+    int unitW;
+
+public:
+    UnitWidthCheck(Check check_func, int map_w, int map_h, int unit_w)
+        : checkFunc(check_func)
+        , w(map_w)
+        , h(map_h)
+        , unitW(unit_w)
+    {
+    }
+
+    bool operator()(int x, int y) const
+    {
+        for (int newX = x; newX < x + unitW; newX++)
+        {
+            if (areValidCoordinates(newX, y, w, h) == false || checkFunc(newX, y) == false)
             {
-                return{}; // empty list, one of the destination tiles is occupied
+                return false;
             }
         }
+        return true;
     }
+};
 
-    tile_list closed_set;
-    tile_list open_set;
+// context of the calling thread, used by Astar
+PathfinderContext& GetThreadPathfinderContext();
 
-    std::vector<std::vector<TileInfo>> evaluatedCoords(w); // array of array
+// core of the search: fits(x, y) tells if the unit can stand with its leftmost tile on x, y.
+// fills path from the destination backwards, without the starting tile, see Astar
+template <typename Fits> bool AstarSearch(AstarNodes* scratch,
+                                          size_t w,
+                                          size_t h,
+                                          Fits fits,
+                                          int xStart,
+                                          int yStart,
+                                          int xDest,
+                                          int yDest,
+                                          bool include_destination,
+                                          tile_list* path)
+{
+    path->clear();
 
-    // initialize values, calculate initial predictions:
-    for (size_t x = 0; x < w; x++)
+    int width = static_cast<int>(w);
+    int height = static_cast<int>(h);
+    if (areValidCoordinates(xStart, yStart, width, height) == false ||
+        areValidCoordinates(xDest, yDest, width, height) == false)
     {
-        evaluatedCoords[x] = std::vector<TileInfo>(h);
-        for (size_t y = 0; y < h; y++)
-        {
-            evaluatedCoords[x][y].isVisited = false;
-            evaluatedCoords[x][y].G = 0;
-            evaluatedCoords[x][y].H = HFunc(x, y, xDest, yDest);
-        }
+        return false;
     }
 
-    bool destinationReached = false;
-    // add starting tile to open list
-    evaluatedCoords[xStart][yStart].G = 0;
-    evaluatedCoords[xStart][yStart].isStartingTile = true;
-    evaluatedCoords[xStart][yStart].isVisited = true;
+    // check if unit can actually fit in destination
+    if (include_destination && fits(xDest, yDest) == false)
+    {
+        return false;
+    }
 
-    if (areValidCoordinates(xStart, yStart, w, h))
+    // the start is never reached as a neighbour, so there is no path to it
+    if (xStart == xDest && yStart == yDest)
     {
-        open_set.push_back({ xStart, yStart });
+        return false;
     }
 
-    // while we have not reached destination
-    // and there are tiles that can still be evaluated
-    while (open_set.empty() == false && destinationReached == false)
+    scratch->Prepare(w, h);
+    int startIndex = yStart * width + xStart;
+    int destIndex = yDest * width + xDest;
+    scratch->Open(startIndex, 0, HFunc(xStart, yStart, xDest, yDest), -1);
+
+    static const int neighbourX[] = { -1, 1, 0, 0 };
+    static const int neighbourY[] = { 0, 0, -1, 1 };
+
+    while (scratch->HasOpen())
     {
-        TileCoords currentTile;
-        int minF = w * h; // minimum cost that is required to reach destination
-        size_t tileNum;   // tile index number
-        // select assumed lowest-cost path
-        for (size_t i = 0; i < open_set.size(); i++)
+        int current = scratch->PopBest();
+        if (current == destIndex)
         {
-            int F = evaluatedCoords[xStart][yStart].G + evaluatedCoords[xStart][yStart].H;
-            if (F < minF)
+            // go backwards from destination until we reach the starting tile
+            if (include_destination)
             {
-                tileNum = i;
-                currentTile = open_set[tileNum];
-                minF = F;
+                path->push_back({ xDest, yDest });
             }
-        }
 
-        // make an array of adjacent coordinates
-        TileCoords adjacentCoordinates[] = { { currentTile.x - 1, currentTile.y }, 
-                                                { currentTile.x + 1, currentTile.y },
-                                                { currentTile.x, currentTile.y - 1 },
-                                                { currentTile.x, currentTile.y + 1 } };
+            int tile = scratch->Get(destIndex).parent;
+            while (tile != startIndex)
+            {
+                path->push_back({ tile % width, tile / width });
+                tile = scratch->Get(tile).parent;
+            }
+            return true;
+        }
 
-        // ... then go through it and check the new possible tiles
-        for (int i = 0; i < sizeof(adjacentCoordinates) / sizeof(*adjacentCoordinates); i++)
+        int currentX = current % width;
+        int currentY = current / width;
+        int G = scratch->Get(current).G + 1;
+        for (int i = 0; i < 4; i++)
         {
-            if (areValidCoordinates(adjacentCoordinates[i].x, adjacentCoordinates[i].y, w, h))
+            int adjX = currentX + neighbourX[i];
+            int adjY = currentY + neighbourY[i];
+            if (areValidCoordinates(adjX, adjY, width, height) == false)
+            {
+                continue;
+            }
+
+            int adjacent = adjY * width + adjX;
+            if (scratch->IsClosed(adjacent))
             {
-                if (std::find(closed_set.begin(), closed_set.end(), adjacentCoordinates[i]) == closed_set.end())
+                continue;
+            }
+
+            if (scratch->IsTouched(adjacent) == false)
+            {
+                // the destination is entered even if occupied, that's how units get next to their target
+                if (adjacent != destIndex && fits(adjX, adjY) == false)
                 {
-                    int adjX = adjacentCoordinates[i].x; // to make code look cleaner
-                    int adjY = adjacentCoordinates[i].y; 
-                    // if this tile has not been visited:
-                    if (std::find(open_set.begin(), open_set.end(), adjacentCoordinates[i]) == open_set.end())
-                    {
-                        // we found are destination
-                        if (adjX == xDest && adjY == yDest)
-                        {
-                            evaluatedCoords[xDest][yDest].comeFrom.x = currentTile.x;
-                            evaluatedCoords[adjX][adjY].comeFrom.y = currentTile.y;
-                            destinationReached = true;
-                            break;
-                        }
-
-                        // see if found tiles are valid through the whole unit width
-                        bool validTiles = true;
-                        for (int newX = adjX; newX < adjX + unit_w; newX++)
-                        {
-                            // coordinates are valid?
-                            if (areValidCoordinates(newX, adjY, w, h) == false)
-                            {
-                                validTiles = false;
-                                break;
-                            }
-
-                            // field can be visited?
-                            if (checkFunc(newX, adjY) == false)
-                            {
-                                validTiles = false;
-                                break;
-                            }
-                        }
-                        
-                        // if newfound tile is OK:
-                        // we have an unocupied field
-                        if (validTiles)
-                        {
-                            // say that we've came to evaluated coordinates from the current tile
-                            evaluatedCoords[adjX][adjY].comeFrom.x = currentTile.x;
-                            evaluatedCoords[adjX][adjY].comeFrom.y = currentTile.y;
-                            evaluatedCoords[adjX][adjY].G = evaluatedCoords[currentTile.x][currentTile.y].G + 1;
-                            open_set.push_back(adjacentCoordinates[i]);
-                        }
-                    }
-                    else
-                    {
-                        // if we visited this tile already
-                        if (evaluatedCoords[adjX][adjY].G > evaluatedCoords[currentTile.x][currentTile.y].G + 1)
-                        {
-                            // but the path would be shorter if we moved to this tile
-                            // from the other one
-                            evaluatedCoords[adjX][adjY].comeFrom.x = currentTile.x;
-                            evaluatedCoords[adjX][adjY].comeFrom.y = currentTile.y;
-                            evaluatedCoords[adjX][adjY].G = evaluatedCoords[currentTile.x][currentTile.y].G + 1;
-                        }
-                    }
+                    scratch->Close(adjacent);
+                    continue;
                 }
+                scratch->Open(adjacent, G, HFunc(adjX, adjY, xDest, yDest), current);
+            }
+            else if (G < scratch->Get(adjacent).G)
+            {
+                scratch->Improve(adjacent, G, current);
             }
         }
-
-        // move the current tile to visited
-        closed_set.push_back(currentTile);
-        // remove it from unvisited tiles
-        open_set.erase(open_set.begin() + tileNum);
     }
 
-    if (destinationReached)
-    {
-        // let's make a path
-        // go backwards from destination
-        tile_list path;
-        if (include_destination)
-        {
-            path.push_back({ xDest, yDest });
-        }
+    // could not find a way - return nothing
+    return false;
+}
 
-        TileCoords currentTile = evaluatedCoords[xDest][yDest].comeFrom;
+// path from the destination (included only if include_destination) back to the tile after the start;
+// unit_w tiles to the right of every tile on the way have to be free as well
+template <typename T> tile_list Astar(T*** field,
+                                      size_t w,
+                                      size_t h, 
+                                      bool(*checkFunc)(int x, int y),
+                                      int xStart,
+                                      int yStart,
+                                      int xDest,
+                                      int yDest,
+                                      bool include_destination,
+                                      int unit_w)
+{
+    PathfinderContext& context = GetThreadPathfinderContext();
+    context.Resize(w, h);
 
-        // ... until we reach the starting tile
-        while (currentTile.x != xStart || currentTile.y != yStart)
-        {
-            path.push_back(currentTile);
-            currentTile = evaluatedCoords[currentTile.x][currentTile.y].comeFrom;
-        }
+    tile_list path;
+    context.FindPath(checkFunc, xStart, yStart, xDest, yDest, include_destination, unit_w, &path);
+    return path;
+}
 
-        return path;
-    }
-    else
-    {
-        // could not find a way - return nothing
-        return {};
-    }
+// same for checks that can't be a plain function, e.g. lambdas capturing the map
+template <typename Check> tile_list Astar(size_t w,
+                                          size_t h,
+                                          Check checkFunc,
+                                          int xStart,
+                                          int yStart,
+                                          int xDest,
+                                          int yDest,
+                                          bool include_destination,
+                                          int unit_w)
+{
+    PathfinderContext& context = GetThreadPathfinderContext();
+    context.Resize(w, h);
+
+    UnitWidthCheck<Check> fits(checkFunc, static_cast<int>(w), static_cast<int>(h), unit_w);
+    tile_list path;
+    context.FindPath(fits, xStart, yStart, xDest, yDest, include_destination, &path);
+    return path;
 }
 
 
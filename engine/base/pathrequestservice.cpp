@@ -0,0 +1,253 @@
+/*
+Author: Vladimir Slav
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "pathrequestservice.h"
+#include "threadpool.h"
+#include "..\SDL2\include\SDL.h"
+
+PathRequestService::PathRequestService(const WalkabilityGrid* _grid, EngineRoutines::ThreadPool* _pool, size_t max_workers)
+    : grid(_grid)
+    , pool(_pool)
+    , maxWorkers(max_workers)
+    , lastId(0)
+    , runningWorkers(0)
+    , delivered(0)
+{
+    SDL_assert_release(grid != nullptr);
+    if (pool != nullptr)
+    {
+        // the calling thread counts in the thread amount, but it doesn't take pool tasks
+        size_t poolWorkers = std::max<size_t>(pool->GetThreadAmount(), 2) - 1;
+        if (maxWorkers == 0 || maxWorkers > poolWorkers)
+        {
+            maxWorkers = poolWorkers;
+        }
+    }
+    PublishSnapshot();
+}
+
+PathRequestService::~PathRequestService()
+{
+    // workers hold on to the service, let them run out of work
+    std::unique_lock<std::mutex> guard(lock);
+    queue.clear();
+    workersDone.wait(guard, [this]() { return runningWorkers == 0; });
+}
+
+void PathRequestService::PublishSnapshot()
+{
+    std::shared_ptr<const WalkabilityGrid> copy = std::make_shared<WalkabilityGrid>(*grid);
+    std::lock_guard<std::mutex> guard(lock);
+    snapshot.swap(copy);
+}
+
+bool PathRequestService::HasLowerPriority(const Job& a, const Job& b)
+{
+    // same priority: the one submitted earlier goes first
+    return a.request.priority < b.request.priority || (a.request.priority == b.request.priority && a.id > b.id);
+}
+
+PathRequestService::Job PathRequestService::PopJob()
+{
+    std::pop_heap(queue.begin(), queue.end(), HasLowerPriority);
+    Job job = std::move(queue.back());
+    queue.pop_back();
+    return job;
+}
+
+void PathRequestService::RunJob(const Job& job, const WalkabilityGrid& grid_snapshot, Result* result)
+{
+    PathfinderContext& context = GetThreadPathfinderContext();
+    context.Resize(grid_snapshot.GetWidth(), grid_snapshot.GetHeight());
+
+    const PathRequest& request = job.request;
+    result->id = job.id;
+    result->callback = job.callback;
+    result->found = context.FindPath(ClearanceCheck(&grid_snapshot, request.unitW),
+                                     request.xStart,
+                                     request.yStart,
+                                     request.xDest,
+                                     request.yDest,
+                                     request.includeDestination,
+                                     &result->path);
+}
+
+void PathRequestService::WorkerLoop()
+{
+    while (true)
+    {
+        Job job;
+        std::shared_ptr<const WalkabilityGrid> gridSnapshot;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (queue.empty())
+            {
+                runningWorkers--;
+                workersDone.notify_all();
+                return;
+            }
+            job = PopJob();
+            gridSnapshot = snapshot;
+        }
+
+        Result result;
+        RunJob(job, *gridSnapshot, &result);
+
+        std::lock_guard<std::mutex> guard(lock);
+        finished.push_back(std::move(result));
+    }
+}
+
+PathRequestHandle PathRequestService::Submit(const PathRequest& request, PathRequestCallback callback)
+{
+    PathRequestHandle handle = { ++lastId };
+    pending.insert(handle.id);
+
+    Job job = { handle.id, request, callback };
+    std::lock_guard<std::mutex> guard(lock);
+    queue.push_back(std::move(job));
+    std::push_heap(queue.begin(), queue.end(), HasLowerPriority);
+
+    // one more worker while there are jobs waiting for one
+    if (pool != nullptr && runningWorkers < maxWorkers && runningWorkers < queue.size())
+    {
+        runningWorkers++;
+        pool->Enqueue([this]() { WorkerLoop(); });
+    }
+    return handle;
+}
+
+void PathRequestService::Cancel(PathRequestHandle handle)
+{
+    pending.erase(handle.id);
+    ready.erase(handle.id);
+
+    std::lock_guard<std::mutex> guard(lock);
+    for (size_t i = 0; i < queue.size(); i++)
+    {
+        if (queue[i].id == handle.id)
+        {
+            queue.erase(queue.begin() + i);
+            std::make_heap(queue.begin(), queue.end(), HasLowerPriority);
+            break;
+        }
+    }
+}
+
+void PathRequestService::Deliver(Result* result)
+{
+    // cancelled while it was being searched
+    if (pending.erase(result->id) == 0)
+    {
+        return;
+    }
+
+    if (result->callback)
+    {
+        PathRequestHandle handle = { result->id };
+        result->callback(handle, result->found, result->path);
+    }
+    else
+    {
+        uint64_t id = result->id;
+        ready[id] = std::move(*result);
+    }
+}
+
+void PathRequestService::Update(double budget_ms)
+{
+    Uint64 start = SDL_GetPerformanceCounter();
+    Uint64 budget = static_cast<Uint64>(budget_ms * SDL_GetPerformanceFrequency() / 1000.0);
+    auto hasTime = [start, budget]() { return SDL_GetPerformanceCounter() - start < budget; };
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for (auto& result : finished)
+        {
+            delivering.push_back(std::move(result));
+        }
+        finished.clear();
+    }
+
+    // results left over from the last frame go first
+    while (delivered < delivering.size() && hasTime())
+    {
+        Deliver(&delivering[delivered]);
+        delivered++;
+    }
+    if (delivered == delivering.size())
+    {
+        delivering.clear();
+        delivered = 0;
+    }
+
+    if (pool != nullptr)
+    {
+        return;
+    }
+
+    while (hasTime())
+    {
+        Job job;
+        std::shared_ptr<const WalkabilityGrid> gridSnapshot;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (queue.empty())
+            {
+                break;
+            }
+            job = PopJob();
+            gridSnapshot = snapshot;
+        }
+
+        Result result;
+        RunJob(job, *gridSnapshot, &result);
+        Deliver(&result);
+    }
+}
+
+PathRequestState PathRequestService::GetState(PathRequestHandle handle)
+{
+    auto it = ready.find(handle.id);
+    if (it != ready.end())
+    {
+        return it->second.found ? PathRequestState::FOUND : PathRequestState::NOT_FOUND;
+    }
+    return pending.count(handle.id) != 0 ? PathRequestState::QUEUED : PathRequestState::UNKNOWN;
+}
+
+bool PathRequestService::TakeResult(PathRequestHandle handle, tile_list* path, bool* found)
+{
+    auto it = ready.find(handle.id);
+    if (it == ready.end())
+    {
+        return false;
+    }
+
+    path->swap(it->second.path);
+    *found = it->second.found;
+    ready.erase(it);
+    return true;
+}
+
+size_t PathRequestService::GetQueuedAmount()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return queue.size();
+}
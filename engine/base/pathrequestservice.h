@@ -0,0 +1,144 @@
+/*
+Author: Vladimir Slav
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+ Path requests served in the background. Game code submits a request and gets a handle back,
+ workers of the thread pool search with their own thread's context against a read-only snapshot of
+ the walkability grid, and the main thread picks up the results in Update, spending no more than
+ the given time on it. A frame never stalls on a long search.
+
+ The snapshot is a copy of the grid taken by PublishSnapshot, requests started after it see the new
+ map. Searches already running finish on the copy they started with.
+*/
+
+#ifndef __PATHREQUESTSERVICE_H__
+#define __PATHREQUESTSERVICE_H__
+
+#include "walkabilitygrid.h"
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace EngineRoutines
+{
+    class ThreadPool;
+}
+
+struct PathRequest
+{
+    int xStart;
+    int yStart;
+    int xDest;
+    int yDest;
+    int unitW;
+    bool includeDestination;
+    int priority; // higher ones are searched first
+};
+
+struct PathRequestHandle
+{
+    uint64_t id; // 0 is never given out
+};
+
+enum class PathRequestState
+{
+    QUEUED,
+    FOUND,
+    NOT_FOUND,
+    UNKNOWN // never submitted, cancelled or already taken
+};
+
+// called from Update on the main thread, the path is only valid during the call
+using PathRequestCallback = std::function<void(PathRequestHandle handle, bool found, const tile_list& path)>;
+
+class PathRequestService
+{
+private:
+    struct Job
+    {
+        uint64_t id;
+        PathRequest request;
+        PathRequestCallback callback;
+    };
+
+    struct Result
+    {
+        uint64_t id;
+        bool found;
+        tile_list path;
+        PathRequestCallback callback;
+    };
+
+    const WalkabilityGrid* grid;
+    EngineRoutines::ThreadPool* pool;
+    size_t maxWorkers;
+    uint64_t lastId;
+
+    // shared with the workers
+    std::mutex lock;
+    std::condition_variable workersDone;
+    std::shared_ptr<const WalkabilityGrid> snapshot;
+    std::vector<Job> queue; // heap by priority, then by submission
+    std::vector<Result> finished;
+    size_t runningWorkers;
+
+    // main thread only
+    std::unordered_set<uint64_t> pending; // submitted, not handed out or cancelled yet
+    std::vector<Result> delivering;
+    size_t delivered;
+    std::unordered_map<uint64_t, Result> ready;
+
+    static bool HasLowerPriority(const Job& a, const Job& b);
+    // takes the most important job, the lock has to be held
+    Job PopJob();
+    static void RunJob(const Job& job, const WalkabilityGrid& grid_snapshot, Result* result);
+    void WorkerLoop();
+    void Deliver(Result* result);
+
+public:
+    // no pool: the searches run on the main thread, inside the Update budget
+    // max_workers: pool threads used at once, 0 for all of them
+    PathRequestService(const WalkabilityGrid* _grid, EngineRoutines::ThreadPool* _pool, size_t max_workers = 0);
+    ~PathRequestService();
+
+    // copy the grid for the searches, call after changing it
+    void PublishSnapshot();
+
+    PathRequestHandle Submit(const PathRequest& request, PathRequestCallback callback = nullptr);
+    // dropped if still queued, its result is thrown away otherwise
+    void Cancel(PathRequestHandle handle);
+
+    // hand out the finished results until budget_ms runs out; without a pool also runs queued searches
+    void Update(double budget_ms);
+
+    PathRequestState GetState(PathRequestHandle handle);
+    // moves a finished path out, false if it isn't finished
+    bool TakeResult(PathRequestHandle handle, tile_list* path, bool* found);
+
+    size_t GetQueuedAmount();
+
+    PathRequestService(const PathRequestService&) = delete;
+    PathRequestService& operator=(const PathRequestService&) = delete;
+};
+
+#endif
@@ -0,0 +1,242 @@
+/*
+Author: Vladimir Slav
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "pixelmask.h"
+#include <algorithm>
+
+PixelMask::PixelMask()
+	: width(0)
+	, height(0)
+	, scale(1)
+	, wordsPerRow(0)
+{
+}
+
+PixelMask::PixelMask(const unsigned char* rgba, size_t w, size_t h, unsigned char alpha_threshold, size_t scale)
+{
+	if (scale == 0)
+	{
+		scale = 1;
+	}
+	Allocate((w + scale - 1) / scale, (h + scale - 1) / scale, scale);
+
+	for (size_t py = 0; py < h; py++)
+	{
+		const unsigned char* pixel = rgba + py * w * 4;
+		uint64_t* row = bits.data() + (py / scale) * wordsPerRow;
+		for (size_t px = 0; px < w; px++, pixel += 4)
+		{
+			if (pixel[3] > alpha_threshold)
+			{
+				size_t cell = px / scale;
+				row[cell / 64] |= (static_cast<uint64_t>(1) << (cell % 64));
+			}
+		}
+	}
+}
+
+PixelMask::PixelMask(const PixelMask& sheet, int frame_x, int frame_y, int frame_w, int frame_h)
+{
+	int s = static_cast<int>(sheet.scale);
+	int x0 = std::max(frame_x, 0) / s;
+	int y0 = std::max(frame_y, 0) / s;
+	int x1 = std::min((frame_x + frame_w + s - 1) / s, static_cast<int>(sheet.width));
+	int y1 = std::min((frame_y + frame_h + s - 1) / s, static_cast<int>(sheet.height));
+	Allocate(std::max(x1 - x0, 0), std::max(y1 - y0, 0), sheet.scale);
+
+	// rows are copied 64 cells at a time, realigned to the frame origin
+	for (size_t y = 0; y < height; y++)
+	{
+		const uint64_t* source = sheet.GetRow(y0 + y);
+		uint64_t* row = bits.data() + y * wordsPerRow;
+		for (size_t k = 0; k < wordsPerRow; k++)
+		{
+			row[k] = sheet.ReadBits(source, static_cast<long>(x0 + k * 64));
+		}
+		// neighbour frames must not leak into the padding
+		if (width % 64 != 0)
+		{
+			row[wordsPerRow - 1] &= (static_cast<uint64_t>(1) << (width % 64)) - 1;
+		}
+	}
+}
+
+void PixelMask::Allocate(size_t w, size_t h, size_t scale)
+{
+	width = w;
+	height = h;
+	this->scale = scale;
+	wordsPerRow = (w + 63) / 64;
+	bits.assign(wordsPerRow * h, 0);
+}
+
+const uint64_t* PixelMask::GetRow(size_t y) const
+{
+	return bits.data() + y * wordsPerRow;
+}
+
+uint64_t PixelMask::ReadBits(const uint64_t* row, long pos) const
+{
+	long rowBits = static_cast<long>(wordsPerRow * 64);
+	if (pos >= rowBits || pos <= -64)
+	{
+		return 0;
+	}
+
+	// floor division, pos can be negative
+	long word = (pos >= 0) ? pos / 64 : -((-pos + 63) / 64);
+	int shift = static_cast<int>(pos - word * 64);
+
+	uint64_t low = (word >= 0) ? row[word] >> shift : 0;
+	uint64_t high = 0;
+	if (shift != 0 && word + 1 < static_cast<long>(wordsPerRow))
+	{
+		high = row[word + 1] << (64 - shift);
+	}
+	return low | high;
+}
+
+bool PixelMask::Get(size_t x, size_t y) const
+{
+	return (bits[y * wordsPerRow + x / 64] >> (x % 64)) & 1;
+}
+
+void PixelMask::Set(size_t x, size_t y, bool value)
+{
+	uint64_t bit = static_cast<uint64_t>(1) << (x % 64);
+	if (value)
+	{
+		bits[y * wordsPerRow + x / 64] |= bit;
+	}
+	else
+	{
+		bits[y * wordsPerRow + x / 64] &= ~bit;
+	}
+}
+
+size_t PixelMask::GetWidth() const
+{
+	return width * scale;
+}
+
+size_t PixelMask::GetHeight() const
+{
+	return height * scale;
+}
+
+size_t PixelMask::GetScale() const
+{
+	return scale;
+}
+
+bool PixelMask::Overlaps(const PixelMask& other, int offset_x, int offset_y) const
+{
+	if (other.scale != scale)
+	{
+		// different resolutions: sample the other mask at the center of every solid cell of this one
+		for (size_t y = 0; y < height; y++)
+		{
+			for (size_t x = 0; x < width; x++)
+			{
+				if (Get(x, y) == false)
+				{
+					continue;
+				}
+
+				long px = static_cast<long>(x * scale + scale / 2) - offset_x;
+				long py = static_cast<long>(y * scale + scale / 2) - offset_y;
+				if (px >= 0 && py >= 0 && px < static_cast<long>(other.GetWidth()) && py < static_cast<long>(other.GetHeight()) &&
+					other.Get(px / other.scale, py / other.scale))
+				{
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	long s = static_cast<long>(scale);
+	long cellX = (offset_x >= 0) ? offset_x / s : -((-offset_x + s - 1) / s);
+	long cellY = (offset_y >= 0) ? offset_y / s : -((-offset_y + s - 1) / s);
+
+	long y0 = std::max(0L, cellY);
+	long y1 = std::min(static_cast<long>(height), cellY + static_cast<long>(other.height));
+	long x0 = std::max(0L, cellX);
+	long x1 = std::min(static_cast<long>(width), cellX + static_cast<long>(other.width));
+	if (x0 >= x1 || y0 >= y1)
+	{
+		return false;
+	}
+
+	size_t firstWord = static_cast<size_t>(x0 / 64);
+	size_t lastWord = static_cast<size_t>((x1 - 1) / 64);
+	for (long y = y0; y < y1; y++)
+	{
+		const uint64_t* row = GetRow(y);
+		const uint64_t* otherRow = other.GetRow(y - cellY);
+		for (size_t k = firstWord; k <= lastWord; k++)
+		{
+			// padding bits of both masks are zero, so no need to clip the overlap columns
+			if ((row[k] & other.ReadBits(otherRow, static_cast<long>(k * 64) - cellX)) != 0)
+			{
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+bool PixelMask::OverlapsRect(int x, int y, int w, int h) const
+{
+	long s = static_cast<long>(scale);
+	long x0 = std::max(0L, static_cast<long>(x) / s);
+	long y0 = std::max(0L, static_cast<long>(y) / s);
+	long x1 = std::min(static_cast<long>(width), (static_cast<long>(x) + w + s - 1) / s);
+	long y1 = std::min(static_cast<long>(height), (static_cast<long>(y) + h + s - 1) / s);
+	if (x0 >= x1 || y0 >= y1)
+	{
+		return false;
+	}
+
+	for (long cy = y0; cy < y1; cy++)
+	{
+		const uint64_t* row = GetRow(cy);
+		for (long k = x0 / 64; k <= (x1 - 1) / 64; k++)
+		{
+			// only the columns of the rect
+			uint64_t columns = ~static_cast<uint64_t>(0);
+			if (k == x0 / 64)
+			{
+				columns &= ~static_cast<uint64_t>(0) << (x0 % 64);
+			}
+			if (k == (x1 - 1) / 64 && x1 % 64 != 0)
+			{
+				columns &= (static_cast<uint64_t>(1) << (x1 % 64)) - 1;
+			}
+
+			if ((row[k] & columns) != 0)
+			{
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
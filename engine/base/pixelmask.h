@@ -0,0 +1,68 @@
+/*
+Author: Vladimir Slav
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+ Pixel mask: one bit per pixel (or per scale x scale block of pixels) telling whether it is solid,
+ built once from the alpha channel. Rows are padded to 64 bit words, so two masks are compared
+ 64 pixels at a time with a shift and an AND.
+*/
+
+#ifndef __PIXELMASK_H__
+#define __PIXELMASK_H__
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+class PixelMask
+{
+protected:
+	size_t width; // in mask cells
+	size_t height;
+	size_t scale; // pixels per cell side
+	size_t wordsPerRow;
+	std::vector<uint64_t> bits; // row by row, bit i of word k is column k * 64 + i
+
+	const uint64_t* GetRow(size_t y) const;
+	// 64 bits of a row starting at column pos, columns outside of the mask read as empty
+	uint64_t ReadBits(const uint64_t* row, long pos) const;
+	void Allocate(size_t w, size_t h, size_t scale);
+
+public:
+	PixelMask();
+	// rgba: 4 bytes per pixel, row by row; a cell is solid if any of its pixels has alpha above the threshold
+	PixelMask(const unsigned char* rgba, size_t w, size_t h, unsigned char alpha_threshold, size_t scale);
+	// part of a sprite sheet, the frame rect is in pixels
+	PixelMask(const PixelMask& sheet, int frame_x, int frame_y, int frame_w, int frame_h);
+
+	bool Get(size_t x, size_t y) const;
+	void Set(size_t x, size_t y, bool value);
+
+	// size in pixels
+	size_t GetWidth() const;
+	size_t GetHeight() const;
+	size_t GetScale() const;
+
+	// true if a solid pixel of this mask is also solid in other, placed offset_x, offset_y pixels to the right/bottom
+	bool Overlaps(const PixelMask& other, int offset_x, int offset_y) const;
+	// true if a solid pixel lies inside the rect, given in pixels relative to the mask origin
+	bool OverlapsRect(int x, int y, int w, int h) const;
+};
+
+#endif
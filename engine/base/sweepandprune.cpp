@@ -0,0 +1,388 @@
+/*
+Author: Vladimir Slav
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "sweepandprune.h"
+#include <algorithm>
+#include <cmath>
+
+static const uint32_t INVALID_INDEX = 0xFFFFFFFF;
+
+SweepAndPrune::SweepAndPrune(int top_border, int left_border, int w_in_pixels, int h_in_pixels, size_t square_w, size_t square_h, bool sweep_vertical)
+	: CollisionGrid(top_border, left_border, w_in_pixels, h_in_pixels, square_w, square_h)
+	, sweepVertical(sweep_vertical)
+	, sortedEndpoints(0)
+	, proxiesValid(true)
+	, maxExtent(0)
+{
+}
+
+int32_t SweepAndPrune::GetMin(const CellRange& range) const
+{
+	return sweepVertical ? range.y0 : range.x0;
+}
+
+int32_t SweepAndPrune::GetMax(const CellRange& range) const
+{
+	return sweepVertical ? range.y1 : range.x1;
+}
+
+bool SweepAndPrune::OverlapsOnOtherAxis(const CellRange& a, const CellRange& b) const
+{
+	if (sweepVertical)
+	{
+		return a.x0 < b.x1 && b.x0 < a.x1;
+	}
+	return a.y0 < b.y1 && b.y0 < a.y1;
+}
+
+CollideableHandle SweepAndPrune::AddObject(Collideable* new_obj)
+{
+	uint32_t id;
+	if (freeProxies.empty())
+	{
+		id = static_cast<uint32_t>(proxies.size());
+		proxies.push_back(Proxy());
+	}
+	else
+	{
+		id = freeProxies.back();
+		freeProxies.pop_back();
+	}
+
+	Proxy& proxy = proxies[id];
+	proxy.obj = new_obj;
+	proxy.objectIndex = static_cast<uint32_t>(objects.size());
+	proxy.activeIndex = INVALID_INDEX;
+	GetCellRange(new_obj, &proxy.range.x0, &proxy.range.y0, &proxy.range.x1, &proxy.range.y1);
+	SetProxyId(new_obj, id);
+
+	Endpoint start = { GetMin(proxy.range) * 2 + 1, id };
+	Endpoint end = { GetMax(proxy.range) * 2, id };
+	endpoints.push_back(start);
+	endpoints.push_back(end);
+	proxiesValid = false;
+
+	return CollisionGrid::AddObject(new_obj);
+}
+
+void SweepAndPrune::OnObjectRemoved(Collideable* obj)
+{
+	uint32_t id = GetProxyId(obj);
+	proxies[id].obj = nullptr;
+	removedProxies.push_back(id);
+	proxiesValid = false;
+}
+
+void SweepAndPrune::OnObjectMoved(Collideable* obj)
+{
+	proxiesValid = false;
+}
+
+void SweepAndPrune::UpdateProxies()
+{
+	// endpoints of removed objects are dropped in one pass, before their slots get reused
+	if (removedProxies.empty() == false)
+	{
+		size_t kept = 0;
+		size_t keptSorted = 0;
+		for (size_t i = 0; i < endpoints.size(); i++)
+		{
+			if (proxies[endpoints[i].proxy].obj != nullptr)
+			{
+				keptSorted += (i < sortedEndpoints) ? 1 : 0;
+				endpoints[kept++] = endpoints[i];
+			}
+		}
+		endpoints.resize(kept);
+		sortedEndpoints = keptSorted;
+		freeProxies.insert(freeProxies.end(), removedProxies.begin(), removedProxies.end());
+		removedProxies.clear();
+	}
+
+	maxExtent = 0;
+	for (size_t i = 0; i < objects.size(); i++)
+	{
+		Proxy& proxy = proxies[GetProxyId(objects[i])];
+		proxy.objectIndex = static_cast<uint32_t>(i);
+		proxy.activeIndex = INVALID_INDEX;
+		GetCellRange(objects[i], &proxy.range.x0, &proxy.range.y0, &proxy.range.x1, &proxy.range.y1);
+		maxExtent = std::max(maxExtent, GetMax(proxy.range) - GetMin(proxy.range));
+	}
+
+	for (auto& endpoint : endpoints)
+	{
+		const Proxy& proxy = proxies[endpoint.proxy];
+		endpoint.key = ((endpoint.key & 1) != 0) ? GetMin(proxy.range) * 2 + 1 : GetMax(proxy.range) * 2;
+	}
+}
+
+void SweepAndPrune::SortEndpoints()
+{
+	// insertion sort: objects move little between checks, so only a few endpoints are out of place
+	for (size_t i = 1; i < sortedEndpoints; i++)
+	{
+		Endpoint endpoint = endpoints[i];
+		size_t j = i;
+		while (j > 0 && endpoints[j - 1].key > endpoint.key)
+		{
+			endpoints[j] = endpoints[j - 1];
+			j--;
+		}
+		endpoints[j] = endpoint;
+	}
+
+	// freshly added objects can land anywhere, sort them separately and merge them in
+	if (sortedEndpoints < endpoints.size())
+	{
+		auto byKey = [](const Endpoint& a, const Endpoint& b) { return a.key < b.key; };
+		std::sort(endpoints.begin() + sortedEndpoints, endpoints.end(), byKey);
+		std::inplace_merge(endpoints.begin(), endpoints.begin() + sortedEndpoints, endpoints.end(), byKey);
+		sortedEndpoints = endpoints.size();
+	}
+}
+
+void SweepAndPrune::RefreshProxies()
+{
+	UpdateProxies();
+	SortEndpoints();
+	proxiesValid = true;
+}
+
+template <typename T> void SweepAndPrune::ForEachInSquares(int x0, int y0, int x1, int y1, T callback)
+{
+	if (x0 >= x1 || y0 >= y1)
+	{
+		return;
+	}
+
+	if (proxiesValid == false)
+	{
+		RefreshProxies();
+	}
+
+	// intervals starting more than maxExtent before the area end before it, the ones starting after it miss it
+	CellRange area = { x0, y0, x1, y1 };
+	auto byKey = [](const Endpoint& endpoint, int32_t key) { return endpoint.key < key; };
+	auto first = std::lower_bound(endpoints.begin(), endpoints.end(), (GetMin(area) - maxExtent) * 2 + 1, byKey);
+	auto last = std::lower_bound(first, endpoints.end(), GetMax(area) * 2 + 1, byKey);
+	for (auto it = first; it != last; ++it)
+	{
+		const Proxy& proxy = proxies[it->proxy];
+		const CellRange& range = proxy.range;
+		if ((it->key & 1) != 0 && range.x0 < range.x1 && range.y0 < range.y1 &&
+			range.x0 < x1 && x0 < range.x1 && range.y0 < y1 && y0 < range.y1)
+		{
+			callback(proxy);
+		}
+	}
+}
+
+bool SweepAndPrune::OccupiesSquares(const Proxy& proxy, int x0, int y0, int x1, int y1) const
+{
+	const CellRange& range = proxy.range;
+	if (proxy.obj->IsMaskFull())
+	{
+		return true;
+	}
+
+	for (int y = std::max(y0, range.y0); y < std::min(y1, range.y1); y++)
+	{
+		for (int x = std::max(x0, range.x0); x < std::min(x1, range.x1); x++)
+		{
+			if (proxy.obj->IsMaskSet(x - range.x0, y - range.y0))
+			{
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+void SweepAndPrune::UpdateGrid()
+{
+	RefreshProxies();
+}
+
+void SweepAndPrune::GeneratePairs(std::vector<uint64_t>* result)
+{
+	// derived objects may change their coordinates without SetCoords, so everything is refreshed every check
+	RefreshProxies();
+
+	result->clear();
+	active.clear();
+	for (auto& endpoint : endpoints)
+	{
+		Proxy& proxy = proxies[endpoint.proxy];
+		const CellRange& range = proxy.range;
+		if ((endpoint.key & 1) == 0)
+		{
+			// end of the interval, objects outside of the grid never became active
+			if (proxy.activeIndex != INVALID_INDEX)
+			{
+				proxies[active.back()].activeIndex = proxy.activeIndex;
+				active[proxy.activeIndex] = active.back();
+				active.pop_back();
+				proxy.activeIndex = INVALID_INDEX;
+			}
+			continue;
+		}
+
+		if (range.x0 >= range.x1 || range.y0 >= range.y1)
+		{
+			continue;
+		}
+
+		for (auto otherId : active)
+		{
+			const Proxy& other = proxies[otherId];
+			// filtered only once the squares are shared, so the layer stats count the same pairs as the grid does
+			if (OverlapsOnOtherAxis(range, other.range) &&
+				SharesCell(proxy.objectIndex, range, other.objectIndex, other.range) &&
+				FilterPair(proxy.obj, other.obj, layerStats) &&
+				PixelsOverlap(proxy.obj, other.obj))
+			{
+				uint64_t first = std::min(proxy.objectIndex, other.objectIndex);
+				uint64_t second = std::max(proxy.objectIndex, other.objectIndex);
+				result->push_back((first << 32) | second);
+			}
+		}
+
+		proxy.activeIndex = static_cast<uint32_t>(active.size());
+		active.push_back(endpoint.proxy);
+	}
+}
+
+Collideable* SweepAndPrune::GetObjectFromGridCoordinates(int x, int y)
+{
+	if (x < 0 || x >= static_cast<int>(wSquares) || y < 0 || y >= static_cast<int>(hSquares))
+	{
+		return nullptr;
+	}
+
+	// the lowest object index wins, like the first entry of a grid cell
+	Collideable* found = nullptr;
+	uint32_t foundIndex = INVALID_INDEX;
+	ForEachInSquares(x, y, x + 1, y + 1, [&](const Proxy& proxy)
+	{
+		if (proxy.objectIndex < foundIndex && OccupiesSquares(proxy, x, y, x + 1, y + 1))
+		{
+			found = proxy.obj;
+			foundIndex = proxy.objectIndex;
+		}
+	});
+
+	return found;
+}
+
+void SweepAndPrune::QueryRect(int x, int y, int w, int h, std::vector<Collideable*>* result)
+{
+	result->clear();
+	int x0 = std::max((x - leftBorder) / static_cast<int>(squareWidth), 0);
+	int y0 = std::max((y - topBorder) / static_cast<int>(squareHeight), 0);
+	int x1 = std::min((x + w - 1 - leftBorder) / static_cast<int>(squareWidth) + 1, static_cast<int>(wSquares));
+	int y1 = std::min((y + h - 1 - topBorder) / static_cast<int>(squareHeight) + 1, static_cast<int>(hSquares));
+
+	ForEachInSquares(x0, y0, x1, y1, [&](const Proxy& proxy)
+	{
+		Collideable* obj = proxy.obj;
+		if (OccupiesSquares(proxy, x0, y0, x1, y1) &&
+			obj->GetX() < x + w && obj->GetX() + obj->GetWidth() > x &&
+			obj->GetY() < y + h && obj->GetY() + obj->GetHeight() > y)
+		{
+			result->push_back(obj);
+		}
+	});
+}
+
+Collideable* SweepAndPrune::GetNearestObject(double x, double y, double max_distance)
+{
+	Collideable* nearest = nullptr;
+	uint32_t nearestIndex = INVALID_INDEX;
+	double best = max_distance;
+
+	// grow the searched area until something is found inside the radius it covers
+	double sw = static_cast<double>(squareWidth);
+	double sh = static_cast<double>(squareHeight);
+	double radius = std::max(sw, sh);
+	while (objects.empty() == false)
+	{
+		double searchRadius = std::min(radius, max_distance);
+		// objects stick out of their squares by less than a square
+		int x0 = static_cast<int>(std::max(std::floor((x - searchRadius - leftBorder) / sw) - 1.0, 0.0));
+		int y0 = static_cast<int>(std::max(std::floor((y - searchRadius - topBorder) / sh) - 1.0, 0.0));
+		int x1 = static_cast<int>(std::min(std::floor((x + searchRadius - leftBorder) / sw) + 2.0, static_cast<double>(wSquares)));
+		int y1 = static_cast<int>(std::min(std::floor((y + searchRadius - topBorder) / sh) + 2.0, static_cast<double>(hSquares)));
+
+		ForEachInSquares(x0, y0, x1, y1, [&](const Proxy& proxy)
+		{
+			Collideable* obj = proxy.obj;
+			double dx = std::max(std::max(obj->GetX() - x, x - (obj->GetX() + obj->GetWidth())), 0.0);
+			double dy = std::max(std::max(obj->GetY() - y, y - (obj->GetY() + obj->GetHeight())), 0.0);
+			double distance = std::sqrt(dx * dx + dy * dy);
+			// ties go to the lower index, so the result doesn't depend on the endpoint order
+			if (distance < best || (distance == best && proxy.objectIndex < nearestIndex))
+			{
+				best = distance;
+				nearest = obj;
+				nearestIndex = proxy.objectIndex;
+			}
+		});
+
+		if ((nearest != nullptr && best <= searchRadius) || searchRadius >= max_distance)
+		{
+			break;
+		}
+		radius *= 2.0;
+	}
+
+	return nearest;
+}
+
+bool SweepAndPrune::Sweep(Collideable* obj, double dx, double dy, SweepHit* hit)
+{
+	// squares under the box covering the start and end positions, one more around since targets stick out of theirs
+	double sw = static_cast<double>(squareWidth);
+	double sh = static_cast<double>(squareHeight);
+	double minX = obj->GetX() + std::min(dx, 0.0) - leftBorder;
+	double minY = obj->GetY() + std::min(dy, 0.0) - topBorder;
+	double maxX = obj->GetX() + obj->GetWidth() + std::max(dx, 0.0) - leftBorder;
+	double maxY = obj->GetY() + obj->GetHeight() + std::max(dy, 0.0) - topBorder;
+	int x0 = static_cast<int>(std::max(std::floor(minX / sw) - 1.0, 0.0));
+	int y0 = static_cast<int>(std::max(std::floor(minY / sh) - 1.0, 0.0));
+	int x1 = static_cast<int>(std::min(std::floor(maxX / sw) + 2.0, static_cast<double>(wSquares)));
+	int y1 = static_cast<int>(std::min(std::floor(maxY / sh) + 2.0, static_cast<double>(hSquares)));
+
+	SweepHit best = { nullptr, 1.0 };
+	uint32_t bestIndex = 0;
+	ForEachInSquares(x0, y0, x1, y1, [&](const Proxy& proxy)
+	{
+		ConsiderSweepCandidate(obj, dx, dy, proxy.objectIndex, &best, &bestIndex);
+	});
+
+	if (best.target == nullptr)
+	{
+		return false;
+	}
+
+	if (hit != nullptr)
+	{
+		*hit = best;
+	}
+	return true;
+}
@@ -0,0 +1,90 @@
+/*
+Author: Vladimir Slav
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+ Sweep and prune: same interface as CollisionGrid, but instead of filling grid cells every frame it keeps
+ the object extents sorted along one axis. The endpoint array is insertion sorted every check, which is close
+ to linear when objects move a little between frames. Suits levels where objects are spread along one axis.
+ Pairs are the same ones CollisionGrid reports: objects are compared by the squares they occupy and their masks.
+ Queries are answered from the sorted endpoints as well, so the grid cells are never built. Objects moved with
+ Collideable::Move/SetCoords are picked up by the next query.
+*/
+
+#ifndef __SWEEPANDPRUNE_H__
+#define __SWEEPANDPRUNE_H__
+
+#include "collisiongrid.h"
+
+class SweepAndPrune : public CollisionGrid
+{
+protected:
+	struct Proxy
+	{
+		Collideable* obj;
+		uint32_t objectIndex;
+		uint32_t activeIndex; // position in the active list during the sweep
+		CellRange range;
+	};
+
+	struct Endpoint
+	{
+		int32_t key; // square coordinate * 2, +1 for the start, so an end sorts before a start on the same square
+		uint32_t proxy;
+	};
+
+	bool sweepVertical;
+
+	std::vector<Proxy> proxies;
+	std::vector<uint32_t> freeProxies;
+	std::vector<uint32_t> removedProxies; // reusable once their endpoints are dropped
+	std::vector<Endpoint> endpoints;
+	size_t sortedEndpoints; // endpoints past this one were added since the last sort
+	std::vector<uint32_t> active;
+	bool proxiesValid; // ranges and endpoints match the objects, cleared when objects are added, removed or moved
+	int32_t maxExtent; // longest interval along the sweep axis, in squares
+
+	void UpdateProxies();
+	void SortEndpoints();
+	void RefreshProxies();
+	int32_t GetMin(const CellRange& range) const;
+	int32_t GetMax(const CellRange& range) const;
+	bool OverlapsOnOtherAxis(const CellRange& a, const CellRange& b) const;
+	// callback(const Proxy&) for every object whose squares overlap [x0, x1) x [y0, y1)
+	template <typename T> void ForEachInSquares(int x0, int y0, int x1, int y1, T callback);
+	// the object has a mask square inside [x0, x1) x [y0, y1), as a grid cell would hold it
+	bool OccupiesSquares(const Proxy& proxy, int x0, int y0, int x1, int y1) const;
+
+	virtual void GeneratePairs(std::vector<uint64_t>* result) override;
+	virtual void OnObjectRemoved(Collideable* obj) override;
+	virtual void OnObjectMoved(Collideable* obj) override;
+
+public:
+	SweepAndPrune(int top_border, int left_border, int w_in_pixels, int h_in_pixels, size_t square_w, size_t square_h, bool sweep_vertical = false);
+
+	virtual CollideableHandle AddObject(Collideable* new_obj) override;
+
+	virtual void UpdateGrid() override;
+	virtual Collideable* GetObjectFromGridCoordinates(int x, int y) override;
+	virtual void QueryRect(int x, int y, int w, int h, std::vector<Collideable*>* result) override;
+	virtual Collideable* GetNearestObject(double x, double y, double max_distance) override;
+
+	virtual bool Sweep(Collideable* obj, double dx, double dy, SweepHit* hit) override;
+};
+
+#endif
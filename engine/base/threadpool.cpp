@@ -0,0 +1,144 @@
+/*
+Author: Vladimir Slav
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "threadpool.h"
+#include <algorithm>
+#include <memory>
+
+namespace EngineRoutines
+{
+    ThreadPool::ThreadPool(size_t worker_amount)
+        : stopping(false)
+    {
+        if (worker_amount == 0)
+        {
+            unsigned int cores = std::thread::hardware_concurrency();
+            worker_amount = (cores > 1) ? cores - 1 : 1;
+        }
+
+        for (size_t i = 0; i < worker_amount; i++)
+        {
+            workers.emplace_back(&ThreadPool::WorkerLoop, this);
+        }
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(tasksLock);
+            stopping = true;
+        }
+        tasksAvailable.notify_all();
+
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    size_t ThreadPool::GetThreadAmount() const
+    {
+        return workers.size() + 1;
+    }
+
+    void ThreadPool::WorkerLoop()
+    {
+        while (true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(tasksLock);
+                tasksAvailable.wait(lock, [this] { return stopping || tasks.empty() == false; });
+                if (tasks.empty())
+                {
+                    return;
+                }
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    void ThreadPool::Enqueue(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(tasksLock);
+            tasks.push_back(std::move(task));
+        }
+        tasksAvailable.notify_one();
+    }
+
+    void ThreadPool::ParallelFor(size_t job_amount, const std::function<void(size_t)>& job)
+    {
+        if (job_amount == 0)
+        {
+            return;
+        }
+
+        if (job_amount == 1 || workers.empty())
+        {
+            for (size_t i = 0; i < job_amount; i++)
+            {
+                job(i);
+            }
+            return;
+        }
+
+        // shared, helpers can get scheduled after every job is taken and this call has returned
+        struct Batch
+        {
+            std::atomic<size_t> next;
+            std::atomic<size_t> finished;
+            size_t amount;
+            const std::function<void(size_t)>* job;
+            std::mutex doneLock;
+            std::condition_variable done;
+        };
+        auto batch = std::make_shared<Batch>();
+        batch->next = 0;
+        batch->finished = 0;
+        batch->amount = job_amount;
+        batch->job = &job;
+
+        auto work = [batch]()
+        {
+            size_t index;
+            while ((index = batch->next.fetch_add(1)) < batch->amount)
+            {
+                (*batch->job)(index);
+                if (batch->finished.fetch_add(1) + 1 == batch->amount)
+                {
+                    std::lock_guard<std::mutex> lock(batch->doneLock);
+                    batch->done.notify_all();
+                }
+            }
+        };
+
+        size_t helpers = std::min(workers.size(), job_amount - 1);
+        for (size_t i = 0; i < helpers; i++)
+        {
+            Enqueue(work);
+        }
+        work();
+
+        std::unique_lock<std::mutex> lock(batch->doneLock);
+        batch->done.wait(lock, [&batch] { return batch->finished.load() == batch->amount; });
+    }
+}
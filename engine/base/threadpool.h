@@ -0,0 +1,67 @@
+/*
+Author: Vladimir Slav
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __COMMIEENGINE_SDL_THREADPOOL_H__
+#define __COMMIEENGINE_SDL_THREADPOOL_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace EngineRoutines
+{
+    // fixed set of worker threads, created once and reused by the engine systems
+    class ThreadPool
+    {
+    private:
+        std::vector<std::thread> workers;
+        std::deque<std::function<void()>> tasks;
+        std::mutex tasksLock;
+        std::condition_variable tasksAvailable;
+        bool stopping;
+
+        void WorkerLoop();
+
+    public:
+        // 0: one worker per core, minus the calling thread
+        explicit ThreadPool(size_t worker_amount = 0);
+        ~ThreadPool();
+
+        // workers plus the calling thread
+        size_t GetThreadAmount() const;
+
+        // runs the task on a worker, returns immediately
+        void Enqueue(std::function<void()> task);
+
+        // calls job(i) for every i in [0, job_amount) and returns when all of them finished;
+        // the calling thread takes jobs as well, so it is safe to call from inside a task
+        void ParallelFor(size_t job_amount, const std::function<void(size_t)>& job);
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool(ThreadPool&&) = delete;
+        ThreadPool& operator=(ThreadPool&&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+    };
+}
+
+#endif
@@ -0,0 +1,123 @@
+/*
+Author: Vladimir Slav
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "walkabilitygrid.h"
+#include "..\SDL2\include\SDL.h"
+
+WalkabilityGrid::WalkabilityGrid(int map_w, int map_h)
+    : w(map_w)
+    , h(map_h)
+    , wordsPerRow((map_w + 63) / 64)
+    , bits(wordsPerRow * map_h, 0)
+    , clearance(map_w * map_h, 0)
+    , version(0)
+{
+    lastChange = { -1, -1 };
+}
+
+void WalkabilityGrid::SetBit(int x, int y, bool walkable)
+{
+    uint64_t& word = bits[y * wordsPerRow + (x >> 6)];
+    uint64_t bit = uint64_t(1) << (x & 63);
+    if (walkable)
+    {
+        word |= bit;
+    }
+    else
+    {
+        word &= ~bit;
+    }
+}
+
+void WalkabilityGrid::RebuildClearance()
+{
+    for (int y = 0; y < h; y++)
+    {
+        uint16_t run = 0;
+        for (int x = w - 1; x >= 0; x--)
+        {
+            if (IsWalkable(x, y))
+            {
+                if (run < MAX_CLEARANCE)
+                {
+                    run++;
+                }
+            }
+            else
+            {
+                run = 0;
+            }
+            clearance[y * w + x] = run;
+        }
+    }
+}
+
+void WalkabilityGrid::UpdateClearance(int x, int y)
+{
+    uint16_t* row = &clearance[y * w];
+    uint16_t run = (x + 1 < w) ? row[x + 1] : 0;
+    for (int i = x; i >= 0; i--)
+    {
+        if (IsWalkable(i, y) == false)
+        {
+            run = 0;
+        }
+        else if (run < MAX_CLEARANCE)
+        {
+            run++;
+        }
+
+        // once a clearance comes out the same, so do all of them further left
+        if (i != x && row[i] == run)
+        {
+            break;
+        }
+        row[i] = run;
+    }
+}
+
+void WalkabilityGrid::SetWalkable(int x, int y, bool walkable)
+{
+    SDL_assert_release(areValidCoordinates(x, y, w, h));
+    if (IsWalkable(x, y) == walkable)
+    {
+        return;
+    }
+
+    SetBit(x, y, walkable);
+    UpdateClearance(x, y);
+    version++;
+    lastChange = { x, y };
+}
+
+tile_list Astar(const WalkabilityGrid& grid,
+                int xStart,
+                int yStart,
+                int xDest,
+                int yDest,
+                bool include_destination,
+                int unit_w)
+{
+    PathfinderContext& context = GetThreadPathfinderContext();
+    context.Resize(grid.GetWidth(), grid.GetHeight());
+
+    tile_list path;
+    context.FindPath(ClearanceCheck(&grid, unit_w), xStart, yStart, xDest, yDest, include_destination, &path);
+    return path;
+}
@@ -0,0 +1,121 @@
+/*
+Author: Vladimir Slav
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+ Walkability of a tile map kept ready for the pathfinders: one bit per tile, row by row, plus a
+ horizontal clearance for every tile - how many walkable tiles start there going right. A unit
+ unit_w tiles wide fits on x, y exactly when the clearance there is at least unit_w, so the
+ searches check multi-tile units with one lookup instead of unit_w callbacks.
+ Built once from the game map, then kept up to date tile by tile as the map changes.
+*/
+
+#ifndef __WALKABILITYGRID_H__
+#define __WALKABILITYGRID_H__
+
+#include "pathfinding.h"
+
+class WalkabilityGrid
+{
+private:
+    static const uint16_t MAX_CLEARANCE = 0xFFFF;
+
+    int w;
+    int h;
+    size_t wordsPerRow;
+    std::vector<uint64_t> bits;
+    std::vector<uint16_t> clearance;
+    uint64_t version;
+    TileCoords lastChange;
+
+    void SetBit(int x, int y, bool walkable);
+    // recompute the clearances left of x, they are the only ones that depend on it
+    void UpdateClearance(int x, int y);
+
+public:
+    WalkabilityGrid(int map_w, int map_h);
+
+    // build from checkFunc, anything callable as bool(int x, int y)
+    template <typename Check> void Build(Check checkFunc)
+    {
+        for (int y = 0; y < h; y++)
+        {
+            for (int x = 0; x < w; x++)
+            {
+                SetBit(x, y, checkFunc(x, y));
+            }
+        }
+        RebuildClearance();
+        version++;
+    }
+
+    void RebuildClearance();
+
+    int GetWidth() const { return w; }
+    int GetHeight() const { return h; }
+    // changes whenever a tile does
+    uint64_t GetVersion() const { return version; }
+    // tile of the last SetWalkable that changed something
+    const TileCoords& GetLastChange() const { return lastChange; }
+
+    void SetWalkable(int x, int y, bool walkable);
+
+    // coordinates have to be on the map
+    bool IsWalkable(int x, int y) const
+    {
+        return ((bits[y * wordsPerRow + (x >> 6)] >> (x & 63)) & 1) != 0;
+    }
+    uint16_t GetClearance(int x, int y) const { return clearance[y * w + x]; }
+    bool UnitFits(int x, int y, int unit_w) const { return clearance[y * w + x] >= unit_w; }
+
+    const uint64_t* GetRow(int y) const { return &bits[y * wordsPerRow]; }
+    size_t GetWordsPerRow() const { return wordsPerRow; }
+};
+
+// fits check for the searches, see AstarSearch
+class ClearanceCheck
+{
+private:
+    const WalkabilityGrid* grid;
+    int unitW;
+
+public:
+    ClearanceCheck(const WalkabilityGrid* _grid, int unit_w)
+        : grid(_grid)
+        , unitW(unit_w)
+    {
+    }
+
+    bool operator()(int x, int y) const
+    {
+        return grid->UnitFits(x, y, unitW);
+    }
+
+    const WalkabilityGrid* GetGrid() const { return grid; }
+    int GetUnitWidth() const { return unitW; }
+};
+
+tile_list Astar(const WalkabilityGrid& grid,
+                int xStart,
+                int yStart,
+                int xDest,
+                int yDest,
+                bool include_destination,
+                int unit_w);
+
+#endif
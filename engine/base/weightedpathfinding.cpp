@@ -0,0 +1,49 @@
+/*
+Author: Vladimir Slav
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "weightedpathfinding.h"
+#include "..\SDL2\include\SDL.h"
+
+tile_list WeightedPath(const WalkabilityGrid& grid,
+                       const std::vector<uint8_t>& costs,
+                       int xStart,
+                       int yStart,
+                       int xDest,
+                       int yDest,
+                       bool include_destination,
+                       int unit_w,
+                       bool diagonal)
+{
+    SDL_assert_release(costs.size() == static_cast<size_t>(grid.GetWidth() * grid.GetHeight()));
+
+    PathfinderContext& context = GetThreadPathfinderContext();
+    context.Resize(grid.GetWidth(), grid.GetHeight());
+
+    ClearanceCheck fits(&grid, unit_w);
+    tile_list path;
+    if (diagonal)
+    {
+        FindWeightedPath<OctileHeuristic, DiagonalMovement::NO_CORNER_CUTTING>(&context, fits, costs.data(), xStart, yStart, xDest, yDest, include_destination, &path);
+    }
+    else
+    {
+        FindWeightedPath<ManhattanHeuristic, DiagonalMovement::NEVER>(&context, fits, costs.data(), xStart, yStart, xDest, yDest, include_destination, &path);
+    }
+    return path;
+}
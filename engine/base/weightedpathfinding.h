@@ -0,0 +1,230 @@
+/*
+Author: Vladimir Slav
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+ A* over terrain with per-tile movement costs and optional diagonal moves.
+
+ costs holds one uint8_t per tile, row by row. Stepping onto a tile costs its value times
+ JPS_STRAIGHT_COST, or times JPS_DIAGONAL_COST for a diagonal step; a cost of 0 means the tile can't
+ be entered. For units wider than a tile the cost of the leftmost tile is used. Walkability is the
+ same as for Astar otherwise: fits(x, y) has to hold and the destination can always be entered.
+
+ The heuristic and the diagonal rule are template parameters, so every combination gets its own
+ search loop without calls through pointers. The heuristic has to stay below the real cost for the
+ path to be the shortest: ManhattanHeuristic only for 4-connected searches, OctileHeuristic and
+ ChebyshevHeuristic for both.
+*/
+
+#ifndef __WEIGHTEDPATHFINDING_H__
+#define __WEIGHTEDPATHFINDING_H__
+
+#include "pathfinding.h"
+#include "walkabilitygrid.h"
+#include "jps.h"
+
+struct ManhattanHeuristic
+{
+    static int Estimate(int dx, int dy)
+    {
+        return JPS_STRAIGHT_COST * (dx + dy);
+    }
+};
+
+struct OctileHeuristic
+{
+    static int Estimate(int dx, int dy)
+    {
+        return JPS_STRAIGHT_COST * std::max(dx, dy) + (JPS_DIAGONAL_COST - JPS_STRAIGHT_COST) * std::min(dx, dy);
+    }
+};
+
+struct ChebyshevHeuristic
+{
+    static int Estimate(int dx, int dy)
+    {
+        return JPS_STRAIGHT_COST * std::max(dx, dy);
+    }
+};
+
+enum class DiagonalMovement
+{
+    NEVER,
+    NO_CORNER_CUTTING, // both tiles next to the diagonal step have to be walkable
+    ONE_CORNER,        // at least one of them
+    ALWAYS
+};
+
+// search on the scratch nodes, the path is the same shape as from AstarSearch
+template <typename Heuristic, DiagonalMovement Diagonal, typename Fits> bool WeightedAstarSearch(AstarNodes* scratch,
+                                                                                                size_t w,
+                                                                                                size_t h,
+                                                                                                Fits fits,
+                                                                                                const uint8_t* costs,
+                                                                                                int xStart,
+                                                                                                int yStart,
+                                                                                                int xDest,
+                                                                                                int yDest,
+                                                                                                bool include_destination,
+                                                                                                tile_list* path)
+{
+    path->clear();
+
+    int width = static_cast<int>(w);
+    int height = static_cast<int>(h);
+    if (areValidCoordinates(xStart, yStart, width, height) == false ||
+        areValidCoordinates(xDest, yDest, width, height) == false)
+    {
+        return false;
+    }
+
+    if (include_destination && fits(xDest, yDest) == false)
+    {
+        return false;
+    }
+
+    if (xStart == xDest && yStart == yDest)
+    {
+        return false;
+    }
+
+    int destIndex = yDest * width + xDest;
+    auto isWalkable = [&](int x, int y)
+    {
+        if (areValidCoordinates(x, y, width, height) == false)
+        {
+            return false;
+        }
+        int index = y * width + x;
+        return index == destIndex || (costs[index] != 0 && fits(x, y));
+    };
+    auto estimate = [&](int x, int y)
+    {
+        return Heuristic::Estimate(std::abs(x - xDest), std::abs(y - yDest));
+    };
+
+    scratch->Prepare(w, h);
+    int startIndex = yStart * width + xStart;
+    scratch->Open(startIndex, 0, estimate(xStart, yStart), -1);
+
+    // straight neighbours first, the diagonal ones are only looked at when Diagonal allows them
+    static const int neighbourX[] = { -1, 1, 0, 0, -1, 1, -1, 1 };
+    static const int neighbourY[] = { 0, 0, -1, 1, -1, -1, 1, 1 };
+    const int neighbourAmount = Diagonal == DiagonalMovement::NEVER ? 4 : 8;
+
+    while (scratch->HasOpen())
+    {
+        int current = scratch->PopBest();
+        if (current == destIndex)
+        {
+            if (include_destination)
+            {
+                path->push_back({ xDest, yDest });
+            }
+
+            int tile = scratch->Get(destIndex).parent;
+            while (tile != startIndex)
+            {
+                path->push_back({ tile % width, tile / width });
+                tile = scratch->Get(tile).parent;
+            }
+            return true;
+        }
+
+        int currentX = current % width;
+        int currentY = current / width;
+        int currentG = scratch->Get(current).G;
+        for (int i = 0; i < neighbourAmount; i++)
+        {
+            int adjX = currentX + neighbourX[i];
+            int adjY = currentY + neighbourY[i];
+            if (areValidCoordinates(adjX, adjY, width, height) == false)
+            {
+                continue;
+            }
+
+            int adjacent = adjY * width + adjX;
+            if (scratch->IsClosed(adjacent))
+            {
+                continue;
+            }
+
+            bool diagonal = i >= 4;
+            if (diagonal && Diagonal != DiagonalMovement::ALWAYS)
+            {
+                bool sideX = isWalkable(adjX, currentY);
+                bool sideY = isWalkable(currentX, adjY);
+                if (Diagonal == DiagonalMovement::NO_CORNER_CUTTING ? (sideX == false || sideY == false) :
+                                                                      (sideX == false && sideY == false))
+                {
+                    continue;
+                }
+            }
+
+            if (scratch->IsTouched(adjacent) == false && isWalkable(adjX, adjY) == false)
+            {
+                scratch->Close(adjacent);
+                continue;
+            }
+
+            // the destination may be a tile nobody can walk on, it still costs something to enter
+            int tileCost = std::max<int>(costs[adjacent], 1);
+            int G = currentG + tileCost * (diagonal ? JPS_DIAGONAL_COST : JPS_STRAIGHT_COST);
+            if (scratch->IsTouched(adjacent) == false)
+            {
+                scratch->Open(adjacent, G, estimate(adjX, adjY), current);
+            }
+            else if (G < scratch->Get(adjacent).G)
+            {
+                scratch->Improve(adjacent, G, current);
+            }
+        }
+    }
+
+    return false;
+}
+
+template <typename Heuristic, DiagonalMovement Diagonal, typename Fits> bool FindWeightedPath(PathfinderContext* context,
+                                                                                             Fits fits,
+                                                                                             const uint8_t* costs,
+                                                                                             int xStart,
+                                                                                             int yStart,
+                                                                                             int xDest,
+                                                                                             int yDest,
+                                                                                             bool include_destination,
+                                                                                             tile_list* path)
+{
+    return context->Run([&](AstarNodes* scratch, size_t w, size_t h, tile_list* result)
+    {
+        return WeightedAstarSearch<Heuristic, Diagonal>(scratch, w, h, fits, costs, xStart, yStart, xDest, yDest, include_destination, result);
+    }, path);
+}
+
+// on the context of the calling thread: octile heuristic without corner cutting if diagonal,
+// manhattan otherwise. costs has to have a value for every tile of the grid
+tile_list WeightedPath(const WalkabilityGrid& grid,
+                       const std::vector<uint8_t>& costs,
+                       int xStart,
+                       int yStart,
+                       int xDest,
+                       int yDest,
+                       bool include_destination,
+                       int unit_w,
+                       bool diagonal = false);
+
+#endif